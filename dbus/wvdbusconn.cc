@@ -306,7 +306,13 @@ void WvDBusConn::try_auth()
 
 void WvDBusConn::add_callback(CallbackPri pri, WvDBusCallback cb, void *cookie)
 {
-    callbacks.append(new CallbackInfo(pri, cb, cookie), true);
+    // keep the list in order, so filter_func()'s sorter finds it already
+    // sorted instead of sorting it again for every message
+    CallbackInfoList::Iter i(callbacks);
+    for (i.rewind(); i.next(); )
+	if (i->pri > pri)
+	    break;
+    callbacks.add_after(i.prev, new CallbackInfo(pri, cb, cookie), true);
 }
 
 
@@ -343,7 +349,7 @@ bool WvDBusConn::filter_func(WvDBusMsg &msg)
     }
 
     // handle all the generic filters
-    CallbackInfoList::Sorter i(callbacks, priority_order);
+    CallbackInfoList::Sorter i(callbacks, priority_order, true);
     for (i.rewind(); i.next(); )
     {
 	bool handled = i->cb(msg);
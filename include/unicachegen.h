@@ -43,6 +43,8 @@ public:
     virtual void commit();
     virtual void set(const UniConfKey &key, WvStringParm value);
     virtual WvString get(const UniConfKey &key);
+    virtual void getv(UniConfPairList &pairs);
+    virtual void existsv(UniConfPairList &pairs);
 };
 
 #endif // __UNICACHEGEN_H
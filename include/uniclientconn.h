@@ -27,6 +27,9 @@
 class UniClientConn : public WvStreamClone
 {
     WvDynBuf msgbuf;
+    WvDynBuf argbuf;    // the rest of a binary message's arguments
+    WvDynBuf framebuf;  // a binary message on its way out
+    bool binread, binwrite;
 
 protected:
     WvLog log;
@@ -77,8 +80,30 @@ public:
 	// events
 	EVENT_HELLO, /*!< HELLO <message> v18 */
 	EVENT_NOTICE, /*!< NOTICE <key> <oldval> <newval> v18 */
+
+	// tagged requests, so that several can be in progress at once
+	REQ_TAG, /*!< tag <id> <request> ... ==> TAGGED <id> <reply> ... v21 */
+	REPLY_TAGGED, /*!< TAGGED <id> <reply> ... v21 */
+
+	// batches of keys in one request
+	REQ_GETV, /*!< getv <key> ... ==> VAL ... OK v23 */
+	REQ_EXISTSV, /*!< existsv <key> ... ==> VAL <key> {} ... OK v23 */
+
+	// switching to binary framing (see request_binary())
+	REQ_BINARY, /*!< binary ==> BINARYOK v25 */
+	REPLY_BINARY, /*!< BINARYOK: the last message that isn't binary v25 */
     };
-    static const int NUM_COMMANDS = EVENT_NOTICE + 1;
+    static const int NUM_COMMANDS = REPLY_BINARY + 1;
+    
+    /** The first protocol version that understands REQ_TAG. */
+    static const int TAGGED_VERSION = 21;
+    /** The first protocol version that understands REQ_GETV/REQ_EXISTSV. */
+    static const int BATCH_VERSION = 23;
+    /** What a daemon says in its EVENT_HELLO if it can do binary framing. */
+    static const char BINARY_FEATURE[];
+    /** The biggest binary message we'll accept; anything claiming to be
+     * bigger gets the connection closed. */
+    static const size_t MAX_FRAME = 16*1024*1024;
     struct CommandInfo
     {
         const char *name;
@@ -107,6 +132,44 @@ public:
      */
     WvString readarg();
 
+    /**
+     * Returns the command called "name", or INVALID if there isn't one.
+     */
+    static Command findcmd(WvStringParm name);
+
+    /**
+     * Switches to the binary framing, which is much cheaper to produce and
+     * parse than TCL-escaped lines.  Each message is a varint command
+     * code, the varint length of the rest of the message, and then each
+     * argument as a varint length followed by that many bytes.  (A varint
+     * is 7 bits per byte, least significant first, with the top bit set
+     * on all but the last byte.)
+     *
+     * Only do this if the daemon listed BINARY_FEATURE in its EVENT_HELLO.
+     * This sends REQ_BINARY, and everything written after it is binary.
+     * Incoming messages stay text until the daemon's REPLY_BINARY, which
+     * readcmd() still returns.
+     */
+    void request_binary();
+
+    /**
+     * The daemon's half of request_binary(): call this after reading a
+     * REQ_BINARY.  It sends REPLY_BINARY and then switches both
+     * directions.
+     */
+    void accept_binary();
+
+    /** Returns true once messages in both directions are binary. */
+    bool isbinary() const
+        { return binread && binwrite; }
+
+    /**
+     * If this isn't null, every reply written (REPLY_* or PART_*) gets
+     * wrapped in a REPLY_TAGGED with this id.  The daemon sets it while
+     * it handles a REQ_TAG.
+     */
+    WvString reply_tag;
+
     /**
      * Writes a command to the connection.
      * "command" is the command
@@ -114,6 +177,20 @@ public:
      */
     void writecmd(Command command, WvStringParm payload = WvString::null);
 
+    /**
+     * Writes a command with up to two arguments, which (unlike writecmd()'s
+     * payload) aren't escaped yet.  Null arguments are left out.
+     */
+    void writeargs(Command command, WvStringParm arg1,
+		   WvStringParm arg2 = WvString::null);
+
+    /**
+     * Writes a REQ_TAG message asking for "command" to be run, and its
+     * replies tagged with "id".
+     */
+    void writetagged(unsigned id, Command command,
+		     WvStringParm payload = WvString::null);
+
     /**
      * Writes a REPLY_OK message.
      * "payload" is the payload, defaults to ""
@@ -146,12 +223,22 @@ public:
      */
     void writetext(WvStringParm text);
 
+protected:
+    virtual const std::type_info &select_cacheable_type() const
+        { return typeid(UniClientConn); }
+
 private:
     /** Reads a message from the connection. */
     WvString readmsg();
 
     /** Writes a message to the connection. */
     void writemsg(WvStringParm message);
+
+    /** Reads a binary message, or returns NONE if it's not all here yet. */
+    Command readframe(WvString &command);
+
+    /** Writes a binary message, whose arguments are already in 'args'. */
+    void writeframe(Command command, WvBuf &args);
 };
 
 #endif // __UNICONFCONN_H
@@ -24,24 +24,74 @@
  * hostname, a colon, and the port of a machine that serves
  * UniConfDaemon requests over TCP.
  * 
+ * Besides the usual (blocking) UniConfGen functions, there are _async()
+ * versions of the ones that have to wait for the daemon.  They send the
+ * request and return right away; the callback runs from the
+ * connection's callback (on the globallist) once the answer arrives, or
+ * with a failure if the connection dies first.  Any number of them can
+ * be in progress at once, so reading a few hundred keys takes about one
+ * round trip instead of a few hundred.  The blocking functions are just
+ * an _async() call followed by waiting for that one answer.
+ *
+ * getv() and existsv() go further and send a whole list of keys as one
+ * request, so the daemon doesn't have to handle each one separately
+ * either.
+ *
+ * Daemons older than protocol version 21 can't match up overlapping
+ * requests, so with them, requests are still queued up but only sent one
+ * at a time.  Daemons older than version 23 don't understand lists of
+ * keys, so getv() and existsv() ask them for one key at a time.
  */
 class UniClientGen : public UniConfGen
 {
+public:
+    /** Receives the value of a key, or WvString::null if it has none. */
+    typedef wv::function<void(const UniConfKey &, WvStringParm)>
+	GetCallback;
+    /** Receives whether a key has children. */
+    typedef wv::function<void(const UniConfKey &, bool)> HasChildrenCallback;
+    /** Receives whether a commit() or refresh() succeeded. */
+    typedef wv::function<void(bool)> DoneCallback;
+    /** Receives a new iterator (which it must delete), or NULL on error. */
+    typedef wv::function<void(Iter *)> IterCallback;
+
+private:
     UniClientConn *conn;
 
     WvLog log;
 
-    WvString result_key;        /*!< the key that the current result is from */
-    WvString result;            /*!< the result from the current key */
+    // A request we've queued up or sent, and are waiting for the answer to.
+    struct Request
+    {
+	unsigned id;            // the tag we sent it with, or 0 if none
+	UniClientConn::Command cmd;
+	UniConfKey key;
+	WvString payload;
+	bool sent, success;
+	WvString result;        // the value, or TRUE/FALSE for haschildren
+	UniListIter *list;      // the results of a REQ_SUBTREE
+	UniConfPairList *pairs; // the keys of a REQ_GETV or REQ_EXISTSV
+	UniConfPairList::Iter *cur;  // the last of 'pairs' we've answered
+	bool split;             // asking for 'pairs' one REQ_GET at a time
+	wv::function<void(Request &)> cb;  // called once when it's done
+	
+	Request(UniClientConn::Command _cmd, const UniConfKey &_key,
+		WvStringParm _payload)
+	    : id(0), cmd(_cmd), key(_key), payload(_payload),
+	      sent(false), success(false), list(NULL), pairs(NULL), cur(NULL),
+	      split(false) { }
+	~Request();
+    };
+    DeclareWvList(Request);
+    RequestList requests;       // in the order we queued them
+    unsigned next_id;
+    size_t unsent;              // requests we haven't been able to send yet
+    bool untagged;              // an untagged request is waiting for a reply
     
-    UniListIter *result_list;   /*!< result list for iterations */
-
-    bool cmdinprogress;     /*!< true while a command is in progress */
-    bool cmdsuccess;        /*!< true when a command completed successfully */
-
     time_t timeout; // command timeout in ms
 
     int version; /*!< version number of the protocol */
+    bool binary; /*!< use binary framing if the daemon offers it */
 
 public:
     /**
@@ -55,6 +105,19 @@ public:
 
     time_t set_timeout(time_t _timeout);
 
+    /**
+     * Whether to switch to the binary framing (see
+     * UniClientConn::request_binary()) if the daemon offers it.  It's on
+     * by default, and only makes a difference before the daemon's
+     * EVENT_HELLO arrives.
+     */
+    void set_binary(bool _binary)
+        { binary = _binary; }
+
+    /** Returns true if the connection has switched to binary framing. */
+    bool isbinary() const
+        { return conn && conn->isbinary(); }
+
     /***** Overridden members *****/
 
     virtual bool isok();
@@ -63,16 +126,64 @@ public:
     virtual void flush_buffers();
     virtual void commit(); 
     virtual WvString get(const UniConfKey &key);
+    virtual void getv(UniConfPairList &pairs);
+    virtual void existsv(UniConfPairList &pairs);
     virtual void set(const UniConfKey &key, WvStringParm value);
     virtual void setv(const UniConfPairList &pairs);
     virtual bool haschildren(const UniConfKey &key);
     virtual Iter *iterator(const UniConfKey &key);
     virtual Iter *recursiveiterator(const UniConfKey &key);
 
+    /***** Asynchronous requests *****/
+
+    void get_async(const UniConfKey &key, const GetCallback &cb);
+    void haschildren_async(const UniConfKey &key,
+			   const HasChildrenCallback &cb);
+    void iterator_async(const UniConfKey &key, bool recursive,
+			const IterCallback &cb);
+    void commit_async(const DoneCallback &cb = 0);
+
+    /**
+     * Like getv() and existsv().  'pairs' gets filled in as the answers
+     * arrive, so it has to stay around until 'cb' is called.
+     */
+    void getv_async(UniConfPairList &pairs, const DoneCallback &cb = 0);
+    void existsv_async(UniConfPairList &pairs, const DoneCallback &cb = 0);
+    void refresh_async(const DoneCallback &cb = 0);
+
+    /** The number of requests that haven't been answered yet. */
+    size_t pending() const
+        { return requests.count(); }
+
+    /**
+     * Wait (in the same way as the blocking functions do) until every
+     * request in progress has been answered.  Returns false if the
+     * connection died first.
+     */
+    bool wait();
+
 protected:
     virtual Iter *do_iterator(const UniConfKey &key, bool recursive);
     void conncallback();
-    bool do_select();
+    bool do_select(const bool *done = NULL);
+
+private:
+    void start(UniClientConn::Command cmd, const UniConfKey &key,
+	       WvStringParm payload, const wv::function<void(Request &)> &cb,
+	       bool subtree = false, UniConfPairList *pairs = NULL);
+    void send(Request &r);
+    void send_requests();
+    Request *find_reply(WvStringParm tag);
+    void handle(UniClientConn::Command command, Request *r);
+    void split_batch(Request &r);
+    void split_reply(Request *r, WvStringParm value);
+    void finish(Request *r, bool success);
+    void fail_requests();
+    
+    static void got_value(GetCallback cb, Request &r);
+    static void got_children(HasChildrenCallback cb, Request &r);
+    static void got_done(DoneCallback cb, Request &r);
+    static void got_iter(IterCallback cb, Request &r);
 };
 
 
@@ -180,6 +180,20 @@ public:
      */
     bool exists() const;
 
+    /**
+     * Fetches the values of many keys below this one at once.  The value
+     * of each pair in 'pairs' is replaced with the value of its key
+     * (relative to this one), or WvString::null if it doesn't exist.
+     * See UniConfGen::getv().
+     */
+    void getv(UniConfPairList &pairs) const;
+
+    /**
+     * Like getv(), but only finds out whether each key exists: its value
+     * becomes an empty string if it does, or WvString::null if it doesn't.
+     */
+    void existsv(UniConfPairList &pairs) const;
+
 
     /***** Key Storage API *****/
 
@@ -15,6 +15,8 @@
 
 #define NUM_WATCHES 113
 #define CONTINUE_SELECT_AT 100
+#define OUTBUF_HIGH_WATER (64*1024)
+#define OUTBUF_TIMEOUT (60*1000)
 
 class UniConfDaemon;
 
@@ -32,14 +34,24 @@ public:
 
     virtual void execute();
 
+    /**
+     * How long (in milliseconds) wait_for_outbuf() gives the client to
+     * read what we've sent before it gives up and closes the connection.
+     */
+    time_t outbuf_timeout;
+
 protected:
     UniConf root;
 
+    virtual const std::type_info &select_cacheable_type() const
+        { return typeid(UniConfDaemonConn); }
+
     virtual void do_invalid(WvStringParm c);
     virtual void do_malformed(UniClientConn::Command);
     virtual void do_noop();
     virtual void do_reply(WvStringParm reply);
     virtual void do_get(const UniConfKey &key);
+    virtual void do_getv(UniConfPairList &pairs, bool exists);
     virtual void do_set(const UniConfKey &key, WvStringParm value);
     virtual void do_remove(const UniConfKey &key);
     virtual void do_subtree(const UniConfKey &key, bool recursive);
@@ -48,11 +60,18 @@ protected:
     virtual void do_refresh();
     virtual void do_quit();
     virtual void do_help();
+    virtual void do_binary();
 
     virtual void addcallback();
     virtual void delcallback();
 
     void deltacallback(const UniConf &cfg, const UniConfKey &key);
+
+    /**
+     * Wait (with continue_select()) until the outbuf has drained, or
+     * close the connection if that takes longer than outbuf_timeout.
+     */
+    void wait_for_outbuf();
 };
 
 #endif // __UNICONFDAEMONCONN_H
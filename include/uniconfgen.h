@@ -110,6 +110,25 @@ public:
      */
     virtual bool exists(const UniConfKey &key) = 0;
 
+    /**
+     * Fetches the values of many keys at once: the value of each pair in
+     * 'pairs' is replaced with the value of its key, or WvString::null if
+     * the key doesn't exist.
+     *
+     * Generators where each get() is expensive (like a trip over the
+     * network) should do the whole list in one go.  The default
+     * implementation just calls get() for each key.
+     */
+    virtual void getv(UniConfPairList &pairs) = 0;
+
+    /**
+     * Like getv(), but only says whether each key exists: its value is set
+     * to an empty string if it does, or WvString::null if it doesn't.
+     *
+     * The default implementation just calls exists() for each key.
+     */
+    virtual void existsv(UniConfPairList &pairs) = 0;
+
 
     /**
      * Converts a string to an integer.  If the string is null or not
@@ -324,6 +343,8 @@ public:
     virtual void prefetch(const UniConfKey &key, bool recursive) { }
     virtual WvString get(const UniConfKey &key) = 0;
     virtual bool exists(const UniConfKey &key);
+    virtual void getv(UniConfPairList &pairs);
+    virtual void existsv(UniConfPairList &pairs);
     virtual int str2int(WvStringParm s, int defvalue) const;
 
     /***** Key Storage API *****/
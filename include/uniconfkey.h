@@ -232,6 +232,19 @@ public:
         store->ref_count++;
     }
 
+#if __cplusplus >= 201103L
+    /** Takes over the path in "other", leaving it empty. */
+    UniConfKey(UniConfKey &&other) :
+        store(other.store),
+        left(other.left),
+        right(other.right)
+    {
+        other.store = &EMPTY_store;
+        other.left = other.right = 0;
+        ++EMPTY_store.ref_count;
+    }
+#endif
+
     /**
      * Constructs a UniConfKey by concatenating two keys.
      * "path" is the initial part of the new path
@@ -383,15 +396,31 @@ public:
      */
     UniConfKey &operator= (const UniConfKey &other)
     {
+        ++other.store->ref_count; // first, in case other is us
         if (--store->ref_count == 0)
             delete store;
         store = other.store;
         left = other.left;
         right = other.right;
-        ++store->ref_count;
         return *this;
     }
 
+#if __cplusplus >= 201103L
+    /** Swaps paths with "other", which will release our old one. */
+    UniConfKey &operator= (UniConfKey &&other)
+    {
+        Store *s = store;
+        int l = left, r = right;
+        store = other.store;
+        left = other.left;
+        right = other.right;
+        other.store = s;
+        other.left = l;
+        other.right = r;
+        return *this;
+    }
+#endif
+
     /**
      * Compares two paths lexicographically.
      * Uses case-insensitive matching on the path string to produce
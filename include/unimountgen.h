@@ -8,6 +8,7 @@
 #define __UNIMOUNTGEN_H
 
 #include "uniconfgen.h"
+#include "uniconftree.h"
 #include "wvmoniker.h"
 #include "wvstringlist.h"
 #include "wvtr1.h"
@@ -22,17 +23,45 @@ protected:
     class UniGenMount
     {
     public:
-        UniGenMount(IUniConfGen *gen, const UniConfKey &key)
-            : gen(gen), key(key) 
+        UniGenMount(IUniConfGen *gen, const UniConfKey &key,
+		    unsigned serial)
+            : gen(gen), key(key), serial(serial)
 	    { }
 
         xplc_ptr<IUniConfGen> gen;
         UniConfKey key;
+        unsigned serial; // higher than anything mounted before it
     };
 
     typedef class WvList<UniGenMount> MountList;
     MountList mounts;
 
+    /**
+     * An index of the mounts, with one node per key segment, so finding
+     * the mounts above or below a key costs one lookup per segment of the
+     * key instead of a walk through the whole 'mounts' list.
+     */
+    class UniMountTree : public UniConfTree<UniMountTree>
+    {
+    public:
+        UniMountTree(UniMountTree *parent, const UniConfKey &key)
+            : UniConfTree<UniMountTree>(parent, key),
+	      count(0), subnewest(0)
+	    { }
+
+        MountList here;     // mounted right here, newest first (not owned)
+        size_t count;       // how many are mounted here or below
+        unsigned subnewest; // the newest serial mounted strictly below
+
+        /** The newest serial mounted here or below. */
+        unsigned newest() const
+	    { return here.isempty() || subnewest > here.first()->serial
+		    ? subnewest : here.first()->serial; }
+    };
+
+    UniMountTree mounttree;
+    unsigned lastserial;
+
     /** undefined. */
     UniMountGen(const UniMountGen &other);
 
@@ -98,6 +127,8 @@ public:
     virtual bool exists(const UniConfKey &key);
     virtual bool haschildren(const UniConfKey &key);
     virtual WvString get(const UniConfKey &key);
+    virtual void getv(UniConfPairList &pairs);
+    virtual void existsv(UniConfPairList &pairs);
     virtual void set(const UniConfKey &key, WvStringParm value);
     virtual void setv(const UniConfPairList &pairs);
     virtual void commit();
@@ -123,11 +154,18 @@ private:
 
     void makemount(const UniConfKey &key);
 
+    /** Add a mount to mounttree, or take it out again. */
+    void index(UniGenMount *mount);
+    void unindex(UniGenMount *mount);
+
     /** Return true if the given key has a subkey 
      *  if you used findmount first, give the result as a parameter to
      *  improve efficiency*/
     bool has_subkey(const UniConfKey &key, UniGenMount *found = NULL);
 
+    /** Does getv(), or existsv() if 'exists' is true. */
+    void batch(UniConfPairList &pairs, bool exists);
+
     struct UniGenMountPairs;
     DeclareWvDict(UniGenMountPairs, WvFastString, key);
 
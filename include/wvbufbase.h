@@ -975,6 +975,18 @@ public:
         WvBufBase<T>(& mystore),
         mystore(sizeof(Elem), _minalloc * sizeof(Elem),
             _maxalloc * sizeof(Elem)) { }
+
+#if __cplusplus >= 201103L
+    /**
+     * Creates a new buffer with the same tuning as "other", and takes
+     * over its contents without copying them.
+     */
+    WvDynBufBase(WvDynBufBase &&other) :
+        WvBufBase<T>(& mystore),
+        mystore(sizeof(Elem), other.mystore.get_minalloc(),
+            other.mystore.get_maxalloc())
+        { this->merge(other); }
+#endif
 };
 
 
@@ -123,10 +123,13 @@ protected:
     virtual bool unlinksubbuffer(WvBufStore *buffer,
         bool allowautofree)
         { /*assert(! "not supported");*/ return true; }
+
+    /** The link WvBufStoreList uses; see WvIntrusiveList. */
+    WvEmbeddedLink listlink;
 };
 
 // lists of buffer stores are sometimes useful
-DeclareWvList(WvBufStore);
+DeclareWvIntrusiveList(WvBufStore, listlink);
 
 
 
@@ -386,6 +389,19 @@ protected:
 
 
 
+/**
+ * Counters for the chunk cache that WvLinkedBufferStore (and so WvDynBuf)
+ * allocates its chunks from.  Each thread has its own cache.
+ */
+struct WvBufStorePoolStats
+{
+    size_t hits;         // chunks handed out from the cache
+    size_t misses;       // chunks that had to be allocated
+    size_t cached;       // chunks sitting in the cache right now
+    size_t cached_bytes; // bytes of chunk memory sitting in the cache
+};
+
+
 /**
  * The WvLinkedBuffer storage class.
  * 
@@ -407,6 +423,19 @@ protected:
 
 public:
     explicit WvLinkedBufferStore(int _granularity);
+    virtual ~WvLinkedBufferStore();
+
+    /**
+     * Returns the counters for the calling thread's chunk cache.
+     * 
+     * Chunks of up to 64k go back into a per-thread cache, sorted by
+     * size, when a buffer is done with them, and the next buffer that
+     * needs one of that size gets it from there instead of from malloc.
+     */
+    static WvBufStorePoolStats pool_stats();
+
+    /** Frees all the chunks in the calling thread's cache. */
+    static void pool_flush();
 
     /*** Overridden Members ***/
     virtual size_t used() const;
@@ -443,7 +472,8 @@ protected:
 
     /**
      * Called when a buffer with autofree is removed from the list.
-     * This function is not called during object destruction.
+     * This function is not called during object destruction, but
+     * chunks that came from newbuffer() go back to the cache anyway.
      *
      * "buffer" is the buffer to be destroyed
      */
@@ -486,6 +516,11 @@ public:
     WvDynBufStore(size_t _granularity,
         size_t _minalloc, size_t _maxalloc);
 
+    size_t get_minalloc() const
+        { return minalloc; }
+    size_t get_maxalloc() const
+        { return maxalloc; }
+
     /*** Overridden Members ***/
     virtual size_t free() const;
     virtual size_t optallocable() const;
@@ -190,7 +190,8 @@ public:
      * 'pri' defines the callback sort order.  When calling callbacks, we
      * call them in priority order until the first callback returns 'true'.
      * If you just want to log certain messages and let other people handle
-     * them, use a high priority but return 'false'.
+     * them, use a high priority but return 'false'.  Callbacks with the
+     * same priority are called in the order they were added.
      * 
      * 'cookie' is used to identify this callback for del_callback().  Your
      * 'this' pointer is a useful value here.
@@ -145,6 +145,12 @@ public:
 
     virtual size_t uread(void *buf, size_t size);
     virtual size_t uwrite(const void *buf, size_t size);
+    virtual size_t uwritebuf(WvBuf &buf, size_t count)
+        { return WvStream::uwritebuf(buf, count); } // encode it first!
+    virtual int uforward(int wfd, WvStream &out, size_t count)
+        { return -1; }
+    virtual int uwrite_fd()
+        { return -1; }
     
 protected:
     void pre_select(SelectInfo &si);
@@ -29,12 +29,15 @@ protected:
     /** Have we actually shut down the read/write sides? */
     bool shutdown_read, shutdown_write;
 
+    /** The pipe that uforward() splices data through, once it's needed. */
+    int splice_fds[2];
+
     /**
      * Sets the file descriptor for both reading and writing.
      * Convenience method.
      */
     void setfd(int fd)
-        { rfd = wfd = fd; }
+        { rfd = wfd = fd; select_changed(); }
 
 public:
     /**
@@ -104,10 +107,37 @@ public:
     virtual bool isok() const;
     virtual size_t uread(void *buf, size_t count);
     virtual size_t uwrite(const void *buf, size_t count);
+    virtual size_t uwritebuf(WvBuf &buf, size_t count);
+    virtual int uforward(int wfd, WvStream &out, size_t count);
+    virtual int uwrite_fd();
     virtual void pre_select(SelectInfo &si);
     virtual bool post_select(SelectInfo &si);
     virtual void maybe_autoclose();
 
+protected:
+    virtual const std::type_info &select_cacheable_type() const
+        { return typeid(WvFdStream); }
+
+    /**
+     * The most derived class whose uwritebuf() may hand the whole buffer
+     * to writev() instead of calling uwrite() for each chunk.  A subclass
+     * that overrides uwrite() doesn't inherit that, so its uwrite() always
+     * gets called; return your own typeid if your uwritebuf() is just as
+     * good.
+     */
+    virtual const std::type_info &writev_type() const
+        { return typeid(WvFdStream); }
+
+    /**
+     * The most derived class whose data may go around its uread() and
+     * uwrite() entirely, with uforward() and uwrite_fd(), when forward()
+     * moves it between streams.  A subclass doesn't inherit that, since
+     * its uread() or uwrite() might change the data; return your own
+     * typeid if they don't.
+     */
+    virtual const std::type_info &forward_type() const
+        { return typeid(WvFdStream); }
+
 public:
     const char *wstype() const { return "WvFdStream"; }
 };
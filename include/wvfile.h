@@ -44,6 +44,12 @@ public:
     virtual void pre_select(SelectInfo &si);
     virtual bool post_select(SelectInfo &si);
 
+protected:
+    virtual const std::type_info &writev_type() const
+        { return typeid(WvFile); }
+    virtual const std::type_info &forward_type() const
+        { return typeid(WvFile); }
+
 public:
     const char *wstype() const { return "WvFile"; }
 };
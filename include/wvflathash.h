@@ -0,0 +1,227 @@
+/* -*- Mode: C++ -*-
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2003 Net Integration Technologies, Inc.
+ *
+ * An open-addressing hash table container.
+ */
+#ifndef __WVFLATHASH_H
+#define __WVFLATHASH_H
+
+#include "wvhash.h"
+#include "wvsorter.h"
+#include "wvxplc.h"   // for deletev.  ick.
+#include <sys/types.h>
+
+/**
+ * The untyped base of WvFlatHash.
+ *
+ * Elements live directly in one big array of slots, so adding one doesn't
+ * allocate anything (unlike WvHashTable, where each element gets its own
+ * WvLink) and finding one doesn't chase pointers.  Next to the slots is an
+ * array of control bytes, one per slot, that says whether the slot is
+ * empty, deleted, or full, and if it's full, holds 7 bits of the element's
+ * hash.  A lookup reads the control bytes 16 at a time (with one SSE2
+ * compare, where we have it) and only calls compare() for slots whose 7
+ * bits match, which is almost never more than one.
+ *
+ * The table doubles in size whenever it gets 7/8 full, so the size you
+ * give the constructor is only a hint.
+ *
+ * Removing an element just marks its slot deleted, so like WvScatterHash,
+ * it's safe to remove elements (including the current one) while
+ * iterating.  Adding elements while iterating is not, since that might
+ * rebuild the table.
+ */
+class WvFlatHashBase
+{
+public:
+    WvFlatHashBase(unsigned _numslots);
+    virtual ~WvFlatHashBase()
+	{ deletev xslots; deletev xctrl; deletev xfree; }
+
+    static const unsigned null_idx = (unsigned)-1;
+
+    size_t count() const { return num; }
+    bool isempty() const { return !num; }
+    size_t slowcount() const;
+
+    /******* IterBase ******/
+    class IterBase
+    {
+    public:
+        IterBase(WvFlatHashBase &_table) : table(&_table) { }
+
+        IterBase(const IterBase &other)
+            : table(other.table), index(other.index) { }
+
+        void rewind() { index = 0; }
+	bool cur()
+	    { return index <= table->numslots; }
+	void *vptr()
+	    { return get(); }
+
+        bool next()
+        {
+            while (++index <= table->numslots
+		   && table->xctrl[index-1] < 0) { }
+	    return index <= table->numslots;
+        }
+
+        bool get_autofree() const
+	{
+            return table->xfree[index-1];
+	}
+
+        void set_autofree(bool autofree)
+	{
+            table->xfree[index-1] = autofree;
+	}
+
+    protected:
+        void *get() const { return table->xslots[index-1]; }
+
+        WvFlatHashBase *table;
+        unsigned index;
+    };
+
+protected:
+    // the control bytes only keep 7 bits of the hash, so rebuilding the
+    // table has to ask for the whole thing again
+    virtual unsigned do_hash(const void *data) = 0;
+    virtual void do_delete(void *data) = 0;
+    virtual bool compare(const void *key, const void *elem) const = 0;
+
+    friend class IterBase;
+
+    typedef void *Slot;
+
+    // xctrl[i] is EMPTY, DELETED, or (if the slot is full) the low 7 bits
+    // of the element's hash.
+    enum { EMPTY = -128, DELETED = -2, GROUP = 16 };
+
+    Slot *xslots;
+    signed char *xctrl;
+    bool *xfree;
+    unsigned numslots;   // always a power of two, and at least GROUP
+
+    unsigned genfind(const void *data, unsigned hash) const;
+    Slot genfind_or_null(const void *data, unsigned hash) const;
+    void _add(void *data, unsigned hash, bool autofree);
+    void _remove(const void *data, unsigned hash);
+    void _zap();
+    void _set_autofree(const void *data, unsigned hash, bool autofree);
+    bool _get_autofree(const void *data, unsigned hash);
+
+private:
+    void alloc(unsigned _numslots);
+    void rebuild(unsigned _numslots);
+    void insert(void *data, unsigned hash, bool autofree);
+
+    size_t num;      // full slots
+    size_t used;     // full or deleted slots
+};
+
+
+template <
+    class T,                                            // element type
+    class K,                                            // key type
+    class Accessor,                                     // element to key
+    template <class> class Comparator = OpEqComp        // comparison func
+>
+class WvFlatHash : public WvFlatHashBase
+{
+    // copy constructor: not defined anywhere!
+    WvFlatHash(const WvFlatHash &h);
+protected:
+    typedef Comparator<K> MyComparator;
+
+    virtual bool compare(const void *key, const void *elem) const
+        { return MyComparator::compare((const K *)key,
+                Accessor::get_key((const T *)elem)); }
+
+    unsigned hash(const T *data)
+        { return WvHash(*Accessor::get_key(data)); }
+
+    virtual unsigned do_hash(const void *data)
+        { return hash((const T *)data); }
+
+    virtual void do_delete(void *data)
+        { delete (T *)data; }
+
+public:
+    WvFlatHash(unsigned _numslots = 0) : WvFlatHashBase(_numslots) { }
+    virtual ~WvFlatHash() { _zap(); }
+
+    T *operator[] (const K &key) const
+        { return (T *)(genfind_or_null(&key, WvHash(key))); }
+
+    void add(const T *data, bool autofree = false)
+        { _add((void *)data, hash(data), autofree); }
+
+    void remove(const T *data)
+        { _remove(Accessor::get_key(data), hash(data)); }
+
+    void set_autofree(const K &key, bool autofree)
+	{ _set_autofree(&key, WvHash(key), autofree); }
+
+    void set_autofree(const T *data, bool autofree)
+	{ _set_autofree(Accessor::get_key(data), hash(data), autofree); }
+
+    bool get_autofree(const K &key)
+	{ return _get_autofree(&key, WvHash(key)); }
+
+    bool get_autofree(const T *data)
+	{ return _get_autofree(Accessor::get_key(data), hash(data)); }
+
+    void zap()
+        { _zap(); }
+
+
+    class Iter : public WvFlatHashBase::IterBase
+    {
+    public:
+        Iter(WvFlatHash &_table) : IterBase(_table) { }
+        Iter(const Iter &other) : IterBase(other) { }
+
+        T *ptr() const
+            { return (T *)(get()); }
+
+        WvIterStuff(T);
+    };
+
+    typedef class WvSorter<T, WvFlatHashBase, WvFlatHashBase::IterBase>
+	Sorter;
+};
+
+
+/*
+ * These work just like DeclareWvDict and DeclareWvTable in wvhashtable.h
+ * (and DeclareWvScatterDict and DeclareWvScatterTable), but give you a
+ * WvFlatHash instead.
+ */
+#define DeclareWvFlatDict2(_classname_,  _type_, _ftype_, _field_)        \
+        __WvFlatDict_base(_classname_, _type_, _ftype_, &obj->_field_)
+
+#define DeclareWvFlatDict(_type_, _ftype_, _field_)                       \
+        DeclareWvFlatDict2(_type_##Dict, _type_, _ftype_, _field_)
+
+#define DeclareWvFlatTable2(_classname_, _type_)                          \
+        __WvFlatDict_base(_classname_, _type_, _type_, obj)
+
+#define DeclareWvFlatTable(_type_)                                        \
+        DeclareWvFlatTable2(_type_##Table, _type_)
+
+
+#define __WvFlatDict_base(_classname_, _type_, _ftype_, _field_)          \
+    template <class T, class K>                                           \
+    struct _classname_##Accessor                                          \
+    {                                                                     \
+        static const K *get_key(const T *obj)                             \
+            { return _field_; }                                           \
+    };                                                                    \
+                                                                          \
+    typedef WvFlatHash<_type_, _ftype_,                                   \
+             _classname_##Accessor<_type_, _ftype_> > _classname_
+
+
+#endif // __WVFLATHASH_H
@@ -3,7 +3,7 @@
  *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
  *
  * A hash table container.  See also wvscatterhash.h, which is newer, faster,
- * and better.
+ * and better, and wvflathash.h, which is newer still.
  */
 #ifndef __WVHASHTABLE_H
 #define __WVHASHTABLE_H
@@ -55,6 +55,12 @@ protected:
     
     virtual size_t uread(void *buf, size_t count);
     virtual size_t uwrite(const void *buf, size_t count);
+    virtual size_t uwritebuf(WvBuf &buf, size_t count)
+        { return WvStream::uwritebuf(buf, count); } // one packet at a time
+    virtual int uforward(int wfd, WvStream &out, size_t count)
+        { return -1; }
+    virtual int uwrite_fd()
+        { return -1; }
 
 public:
     const char *wstype() const { return "WvIPRawStream"; }
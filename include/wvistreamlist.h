@@ -9,9 +9,26 @@
 #define __WVISTREAMLIST_H
 
 #include "wvstream.h"
+#include <map>
+#include <set>
+#include <vector>
 
-/** Create the WvStreamListBase class - a simple linked list of WvStreams */
-DeclareWvList2(WvIStreamListBase, IWvStream);
+/**
+ * WvIStreamListBase - a simple linked list of IWvStreams.  Like a
+ * WvIntrusiveList, it uses a stream's own link (WvStream::listlink) when
+ * it can, so adding a WvStream doesn't cost a malloc.
+ */
+class WvIStreamListBase : public WvList<IWvStream>
+{
+    // copy constructor: not defined anywhere!
+    WvIStreamListBase(const WvIStreamListBase &list);
+
+    static WvEmbeddedLink *streamlink(void *data);
+
+public:
+    WvIStreamListBase()
+	{ ownlink = streamlink; }
+};
 
 /**
  * WvStreamList holds a list of WvStream objects -- and its select() and
@@ -28,7 +45,11 @@ public:
     virtual void execute();
     
     void unlink(IWvStream *data)
-        { sure_thing.unlink(data); WvIStreamListBase::unlink(data); }
+    {
+	if (sure_set.erase(data))
+	    sure_thing.unlink(data);
+	WvIStreamListBase::unlink(data);
+    }
 
     void add_after(WvLink *after, IWvStream *data, bool autofree,
 		   const char *id)
@@ -51,6 +72,128 @@ public:
 protected:
     WvIStreamListBase sure_thing;
 
+    /** The streams in sure_thing, so membership checks don't need a scan. */
+    std::set<IWvStream *> sure_set;
+
+    /**
+     * Add 's' to sure_thing unless it's already there.  Returns true if it
+     * was added.
+     */
+    bool add_sure(IWvStream *s, const char *id);
+
+private:
+    /**
+     * What each child asked for during the last pre_select(): the fds it
+     * added to the SelectInfo and the timeout it wanted (-1 for none).
+     * post_select() uses this to skip children that can't possibly be
+     * ready, so that a wakeup costs time proportional to the number of
+     * streams with something to do instead of the total number of streams.
+     * 
+     * A child is skipped if none of its fds came back ready and it either
+     * didn't ask for a timeout, or asked for one no sooner than its own
+     * alarm and that alarm still hasn't gone off.  Streams that can become
+     * ready in other ways (buffered data, force_select()) always lower
+     * msec_timeout in pre_select(), so they are never skipped.
+     */
+    struct ChildSelect
+    {
+	IWvStream *s;
+	WvStream *ws; // s, if it's in the list by its own listlink
+	const char *id;
+	size_t awake_index;
+	time_t msec_timeout;
+	size_t firstfd, nfds;
+	bool known_fds;
+	bool candidate; // might go quiet if it turns out to be idle
+    };
+    struct ChildFd
+    {
+	int fd;
+	unsigned char rwx; // READ_BIT, etc. for the sets it was in
+    };
+    enum { READ_BIT = 1, WRITE_BIT = 2, EXCEPT_BIT = 4 };
+    std::vector<ChildSelect> child_selects;
+    std::vector<ChildFd> child_fds;
+    const SelectInfo *child_selects_si;
+    unsigned child_selects_gen;
+    WvTime child_selects_time;
+    
+    /**
+     * A "quiet" child is an idle one whose select_is_cacheable() stream
+     * we've made ourselves the select_watcher of.  We stop calling its
+     * pre_select() and post_select() and just keep selecting on the fds it
+     * last asked for, until one of them comes back ready, its alarm goes
+     * off (WvStream::next_alarm() tells us), or it calls select_changed().
+     * Then it "wakes up" and is treated like any other child again.
+     * 
+     * So pre_select() only visits the children in 'awake', which holds
+     * the list's links in order (plus any woken since, at the end), and
+     * is rebuilt only when the list changes.
+     */
+    struct QuietChild
+    {
+	int fds[2];
+	unsigned char rwx[2];
+	bool timed; // it asked for a timeout, so it has an alarm set
+    };
+    typedef std::map<WvStream *, QuietChild> QuietMap;
+    QuietMap quiet;
+    size_t nquiet_timed;
+#ifndef _WIN32
+    fd_set quiet_read, quiet_write, quiet_except;
+    std::vector<WvStream *> quiet_owner; // indexed by fd
+    int quiet_max_fd;
+#endif
+    SelectRequest quiet_wants; // the si.wants the quiet fds were for
+    
+    struct AwakeChild
+    {
+	WvLink *link;
+	WvStream *ws;
+    };
+    std::vector<AwakeChild> awake;
+    unsigned awake_gen;
+    bool awake_stale;
+    
+    /**
+     * Children that pre_select() thought might go quiet.  We're already
+     * their select_watcher, so that we hear if they change before
+     * post_select() finds out whether they were idle.
+     */
+    std::vector<WvStream *> pending;
+    
+    /** Quiet children that woke up since pre_select(). */
+    std::vector<WvStream *> woken;
+    
+    bool child_is_member(WvStream *s)
+	{ return s->listlink.data
+		&& s->listlink.list == static_cast<WvListBase *>(this); }
+    void rebuild_awake();
+    void child_pre_select(size_t k, SelectInfo &si, SelectInfo &csi);
+#ifndef _WIN32
+    void move_fd(int fd, SelectInfo &si, SelectInfo &csi);
+    void merge_quiet(SelectInfo &si);
+    void wake_ready(const SelectInfo &si);
+#endif
+    bool child_maybe_ready(const ChildSelect &c,
+			   const std::vector<ChildFd> &fds,
+			   const SelectInfo &si) const;
+    bool go_quiet(const ChildSelect &c, const std::vector<ChildFd> &fds);
+    void wake(WvStream *s, bool requeue);
+    void wake_all(bool requeue);
+    void forget_pending(WvStream *s);
+    void clear_pending();
+    bool child_post_select(IWvStream &s, const char *id, SelectInfo &si,
+			   const SelectRequest &oldwant);
+    void full_post_select(SelectInfo &si, const SelectRequest &oldwant,
+			  const std::set<IWvStream *> &done,
+			  bool &already_sure);
+    void prune(IWvStream *s);
+
+protected:
+    virtual void watched_select_changed(WvStream *s);
+    virtual void watched_destroyed(WvStream *s);
+
 private:
     // Create some undefined overrides to prevent accidentally using a
     // WvString as an id; these functions will keep a long-term reference to
@@ -29,15 +29,39 @@ public:
 
 private:
     bool autofree : 1;
+    bool embedded : 1;
 
 public:
     WvLink(void *_data, bool _autofree, const char *_id = NULL):
-	data(_data), next(NULL), id(_id), autofree(_autofree)
+	data(_data), next(NULL), id(_id), autofree(_autofree), embedded(false)
     {}
 
     WvLink(void *_data, WvLink *prev, WvLink *&tail, bool _autofree,
 	   const char *_id = NULL);
 
+protected:
+    /** For WvEmbeddedLink. */
+    WvLink():
+	data(NULL), next(NULL), id(NULL), autofree(false), embedded(true)
+    {}
+
+public:
+    /** Puts this link in a list right after 'prev'. */
+    void insert(void *_data, WvLink *prev, WvLink *&tail, bool _autofree,
+		const char *_id = NULL);
+
+    /** True if this is an embedded link that isn't in any list now. */
+    bool available() const
+    {
+	return embedded && !data;
+    }
+
+    /** True if this is a WvEmbeddedLink rather than an allocated one. */
+    bool is_embedded() const
+    {
+	return embedded;
+    }
+
     bool get_autofree()
     {
 	return autofree;
@@ -51,7 +75,52 @@ public:
     void unlink(WvLink *prev)
     {
 	prev->next = next;
-	delete this;
+	if (embedded)
+	{
+	    data = NULL;
+	    next = NULL;
+	}
+	else
+	    delete this;
+    }
+};
+
+class WvListBase;
+
+/**
+ * A WvLink that lives inside a list element, for WvIntrusiveList to use
+ * instead of allocating one.  It isn't in any list until insert() puts it
+ * there, and unlink() doesn't delete it, just makes it available() again.
+ *
+ * It remembers which list it's in.  If its element is destroyed while
+ * it's still in a list (one that doesn't own the element, presumably),
+ * it takes itself out of that list first.
+ */
+class WvEmbeddedLink : public WvLink
+{
+public:
+    WvListBase *list;
+
+    WvEmbeddedLink():
+	list(NULL)
+    {}
+
+    /** A copy of an element starts out in no list at all. */
+    WvEmbeddedLink(const WvEmbeddedLink &):
+	WvLink(), list(NULL)
+    {}
+
+    WvEmbeddedLink &operator= (const WvEmbeddedLink &)
+	{ return *this; }
+
+    ~WvEmbeddedLink();
+
+    /** Puts this link in 'l' right after 'prev'. */
+    void insert(WvListBase *l, void *_data, WvLink *prev, WvLink *&tail,
+		bool _autofree, const char *_id = NULL)
+    {
+	list = l;
+	WvLink::insert(_data, prev, tail, _autofree, _id);
     }
 };
 
@@ -9,6 +9,9 @@
 
 #include "wvtypetraits.h"
 #include "wvsorter.h"
+#if __cplusplus >= 201103L
+#include <utility>
+#endif
 
 /**
  * @internal
@@ -28,8 +31,22 @@ private:
 public:
     WvLink head, *tail;
 
+    /**
+     * If the elements carry their own links (see WvIntrusiveList),
+     * returns the link of the element "data" if it's free for this list
+     * to use, or NULL if a WvLink has to be allocated.  NULL for a plain
+     * WvList.
+     */
+    WvEmbeddedLink *(*ownlink)(void *data);
+
+    /**
+     * Goes up every time a link is added or removed, so that anything
+     * remembering links from the list can tell when it has to look again.
+     */
+    unsigned generation;
+
     /** Creates an empty linked list. */
-    WvListBase() : head(NULL, false)
+    WvListBase() : head(NULL, false), ownlink(NULL), generation(0)
         { tail = &head; }
 
     /**
@@ -52,6 +69,13 @@ public:
      */
     void reverse();
 
+    /**
+     * Takes "link" out of the list without destroying anything.  This
+     * has to search the list, so it's meant for things like a
+     * WvEmbeddedLink whose element is going away.
+     */
+    void unlink_link(WvLink *link);
+
     /**
      * Quickly determines if the list is empty.
      * 
@@ -181,7 +205,7 @@ public:
  * in a list, and then used object->next instead of all the
  * List Iterator stuff, but the end result was pure ugliness, so I
  * gave up.  At least this way, the same object can be in multiple
- * lists.
+ * lists.  (WvIntrusiveList, below, gets most of the way there anyway.)
  * 
  * List type construction is facilitated by the following macros:
  * 
@@ -263,7 +287,12 @@ public:
     void add_after(WvLink *after, T *data, bool autofree,
 			const char *id = NULL )
     {
-	(void)new WvLink((void *)data, after, tail, autofree, id);
+	WvEmbeddedLink *own = (ownlink && data) ? ownlink((void *)data) : NULL;
+	generation++;
+	if (own)
+	    own->insert(this, (void *)data, after, tail, autofree, id);
+	else
+	    (void)new WvLink((void *)data, after, tail, autofree, id);
     }
 
     /**
@@ -293,6 +322,32 @@ public:
     void prepend(T *data, bool autofree, const char *id = NULL)
 	{ add_after(&head, data, autofree, id); }
 
+#if __cplusplus >= 201103L
+    /**
+     * Constructs a new element from "args" right in the list, appending
+     * it with autofree == true.  Returns the new element.
+     */
+    template<typename... Args>
+    T *append_new(Args&&... args)
+    {
+	T *data = new T(std::forward<Args>(args)...);
+	append(data, true);
+	return data;
+    }
+
+    /**
+     * Like append_new(), but adds the new element to the beginning of
+     * the list.
+     */
+    template<typename... Args>
+    T *prepend_new(Args&&... args)
+    {
+	T *data = new T(std::forward<Args>(args)...);
+	prepend(data, true);
+	return data;
+    }
+#endif
+
     /**
      * Unlinks the specified element from the list.
      * 
@@ -330,6 +385,7 @@ public:
             T *obj = (destroy && next->get_autofree()) ?
             static_cast<T*>(next->data) : NULL;
             if (next == tail) tail = after;
+            generation++;
             next->unlink(after);
 	    if (obj)
 	        WvTraits<T>::release(obj);
@@ -423,4 +479,56 @@ public:
 #define DeclareWvList(_type_) DeclareWvList2(_type_##List, _type_)
 
 
+/**
+ * A WvList that doesn't allocate a WvLink for each element.  Instead,
+ * each element has a WvEmbeddedLink of its own (the one given by
+ * "member"), and that's what goes in the list.  Everything else, including
+ * Iter and Sorter, works just like WvList, and since it's WvList::add_after()
+ * that picks the link, it doesn't matter whether you add elements through
+ * a WvIntrusiveList or a plain WvList<T> reference.
+ *
+ * The link is used whether or not the list owns the element.  If the
+ * element is destroyed while it's still in a list that doesn't own it,
+ * its link takes itself out of that list, so the list doesn't end up
+ * pointing at freed memory.  That can't help an iterator that's sitting on
+ * the element at the time, though: don't destroy the element an iterator
+ * is on, except through that iterator's own unlink().
+ *
+ * An element's own link can only be in one list at a time, so when it's
+ * busy (the element is already in another list, or in this one twice),
+ * adding the element just allocates a WvLink the usual way.  That means
+ * it's still fine to put an element in as many lists as you like; only one
+ * of them gets it for free.
+ *
+ * Use DeclareWvIntrusiveList(Type, member) to create TypeList, or
+ * DeclareWvIntrusiveList2(name, Type, member) to call it something else.
+ *
+ * "T" is the object type
+ * "member" is the WvEmbeddedLink member of T to use
+ */
+template<class T, WvEmbeddedLink T::*member>
+class WvIntrusiveList : public WvList<T>
+{
+    // copy constructor: not defined anywhere!
+    WvIntrusiveList(const WvIntrusiveList &list);
+
+    static WvEmbeddedLink *getlink(void *data)
+    {
+	WvEmbeddedLink *link = &(static_cast<T *>(data)->*member);
+	return link->available() ? link : NULL;
+    }
+
+public:
+    /** Creates an empty linked list. */
+    WvIntrusiveList()
+	{ this->ownlink = getlink; }
+};
+
+#define DeclareWvIntrusiveList2(_classname_, _type_, _member_)  \
+    typedef class WvIntrusiveList<_type_, &_type_::_member_> _classname_
+
+#define DeclareWvIntrusiveList(_type_, _member_) \
+    DeclareWvIntrusiveList2(_type_##List, _type_, _member_)
+
+
 #endif // __WVLINKLIST_H
@@ -32,6 +32,17 @@ protected:
     virtual void log(WvStringParm source, int loglevel,
 		     const char *_buf, size_t len) = 0;
 
+    /**
+     * Returns the highest log level that log() might do anything with.
+     * WvLog doesn't bother formatting messages above the highest level
+     * any receiver wants, so if you override log() to look at more than
+     * that, override this too.  The default is every level.
+     */
+    virtual int max_loglevel();
+
+    /** Call this whenever the value of max_loglevel() changes. */
+    static void levels_changed();
+
 private:
     static void cleanup_on_fork(pid_t p);
     static void static_init();
@@ -40,10 +51,13 @@ public:
     bool force_new_line;
     WvLogRcvBase();
     virtual ~WvLogRcvBase();
+
+    /** The link WvLog::receivers uses; see WvIntrusiveList. */
+    WvEmbeddedLink listlink;
 };
 
 
-DeclareWvList(WvLogRcvBase);
+DeclareWvIntrusiveList(WvLogRcvBase, listlink);
 
 typedef wv::function<WvString(WvStringParm)> WvLogFilter;
 
@@ -76,8 +90,11 @@ protected:
     static WvLogRcvBaseList *receivers;
     static int num_receivers, num_logs;
     static WvLogRcvBase *default_receiver;
+    static int max_wanted; // the highest level any receiver wants
     WvLogFilter* filter;
 
+    static void update_max_wanted();
+
 public:
     WvLog(WvStringParm _app, LogLevel _loglevel = Info,  
             WvLogFilter* filter = 0);
@@ -98,9 +115,24 @@ public:
     WvLog &lvl(LogLevel _loglevel)
         { loglevel = _loglevel; return *this; }
     
+    /**
+     * Returns true if any receiver wants messages at level '_loglevel'.
+     * Messages that nobody wants are dropped before they're formatted,
+     * but you can also use this to skip building an expensive message
+     * (like a hex dump) yourself.
+     */
+    static bool wanted(LogLevel _loglevel)
+        { return _loglevel <= max_wanted; }
+    
+    /** Returns true if any receiver wants messages at our loglevel. */
+    bool wanted() const
+        { return wanted(loglevel); }
+    
     /** change the loglevel and then print a message. */
     size_t operator() (LogLevel _loglevel, WvStringParm s)
     { 
+	if (!wanted(_loglevel))
+	    return 0;
 	LogLevel l = loglevel; 
 	size_t x = lvl(_loglevel).write(filter ? (*filter)(s) : s);
 	lvl(l);
@@ -110,6 +142,8 @@ public:
     /** change the loglevel and then print a formatted message */
     size_t operator() (LogLevel _loglevel, WVSTRING_FORMAT_DECL)
     { 
+	if (!wanted(_loglevel))
+	    return 0;
 	LogLevel l = loglevel;
         size_t x;
         if (filter)
@@ -125,12 +159,25 @@ public:
      * since the above operator()s caused them to be hidden
      */
     size_t operator() (WvStringParm s)
-        { return WvStream::operator()(filter ? (*filter)(s) : s); }
+    {
+	if (!wanted())
+	    return 0;
+	return WvStream::operator()(filter ? (*filter)(s) : s);
+    }
     size_t operator() (WVSTRING_FORMAT_DECL)
-        { return (filter ? 
+    {
+	if (!wanted())
+	    return 0;
+	return (filter ? 
             WvStream::operator()((*filter)(WvString(WVSTRING_FORMAT_CALL))) :
             WvStream::operator()(WVSTRING_FORMAT_CALL) );
-        }
+    }
+    
+    /** print() is the same as operator(), and skips unwanted messages too */
+    size_t print(WvStringParm s)
+        { return wanted() ? WvStream::print(s) : 0; }
+    size_t print(WVSTRING_FORMAT_DECL)
+        { return wanted() ? WvStream::print(WVSTRING_FORMAT_CALL) : 0; }
     
     /**
      * split off a new WvLog object with the requested loglevel.  This way
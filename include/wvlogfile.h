@@ -10,6 +10,9 @@
 
 #include "wvfile.h"
 #include "wvlogrcv.h"
+#include "wvbuf.h"
+
+class WvLogWriter;
 
 /// Basic WvLogRcv that logs to a file. Always logs to the same file.
 /// No auto-rotation of log files.
@@ -18,9 +21,44 @@ class WvLogFileBase : public WvLogRcv, public WvFile
 public:
     WvLogFileBase(WvStringParm _filename,
 		  WvLog::LogLevel _max_level = WvLog::NUM_LOGLEVELS);
+    virtual ~WvLogFileBase();
     
     // run fsync() every so many log messages.  0 never fsyncs.
     int fsync_every;
+    
+    // in async mode, also fsync() this many milliseconds after a write.
+    // 0 means only fsync_every counts.
+    int fsync_msec;
+    
+    /**
+     * Stop writing log lines from whichever callback logged them, and
+     * hand them to a background thread instead, so a slow disk can't stall
+     * the main loop.  Up to 'ringsize' bytes of complete lines can be
+     * waiting at once; the thread writes everything waiting with a single
+     * writev().  If a line doesn't fit, it's thrown away and counted in
+     * dropped() rather than making the caller wait.
+     *
+     * Like the rest of WvLog, this expects to be called from one thread
+     * only.  Returns false if the thread couldn't be started, in which
+     * case we keep writing directly.  A process forked after this also
+     * writes directly, since the thread doesn't come along.
+     */
+    bool start_async(size_t ringsize = 1024*1024);
+    
+    /** Write out everything still waiting, and go back to writing directly. */
+    void stop_async();
+    
+    /** Wait until the background thread has written every waiting line. */
+    void flush_async();
+    
+    bool is_async();
+    
+    /** The number of lines thrown away because the async queue was full. */
+    size_t dropped() const
+        { return num_dropped; }
+    
+    /** Waits for the async queue to empty before closing the file. */
+    virtual void close();
 
 protected:
     WvLogFileBase(WvLog::LogLevel _max_level);
@@ -29,6 +67,14 @@ protected:
     virtual void _end_line();
 
     int fsync_count;
+
+private:
+    WvLogWriter *writer;
+    WvDynBuf linebuf;
+    size_t num_dropped;
+    
+    void queue_line();
+    void check_fork();
 };
 
 
@@ -71,6 +71,8 @@ private:
         { _mid_line(str, len); 
 	    if (len>0 && str[len-1] == '\n') at_newline = true; }
     
+    virtual int max_loglevel();
+
 public:
     virtual void log(WvStringParm source, int loglevel,
 		     const char *_buf, size_t len);
@@ -86,8 +88,7 @@ public:
     
     WvLog::LogLevel level() const
         { return max_level; }
-    void level(WvLog::LogLevel lvl)
-        { max_level = lvl; }
+    void level(WvLog::LogLevel lvl);
     
     /*
      * Allows you to override debug levels for specific sources
@@ -0,0 +1,92 @@
+/* -*- Mode: C++ -*-
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Pluggable backends for the wait at the bottom of WvStream::select().
+ */
+#ifndef __WVPOLLER_H
+#define __WVPOLLER_H
+
+#include "iwvstream.h"
+#include <sys/types.h>
+
+/**
+ * A WvPoller does the actual blocking wait once pre_select() has filled
+ * in a SelectInfo.  It takes the read, write and except fd_sets (up to
+ * si.max_fd) and si.msec_timeout, waits, and leaves only the ready fds
+ * in the sets, exactly the way ::select() would.  Because the interface
+ * is the same as ::select(), streams don't know or care which backend is
+ * in use.
+ *
+ * Available backends are:
+ *   "select" - plain ::select().  This is the default.
+ *   "poll"   - ::poll(), which costs O(fds in use) rather than O(max_fd)
+ *              in the kernel.
+ *   "epoll"  - Linux epoll, with persistent registrations: only fds whose
+ *              interest changed since the last wait cost an epoll_ctl(),
+ *              and the wait itself is independent of the number of idle
+ *              fds.  Small selects (like the ones done by isreadable())
+ *              are handed to poll() so they don't disturb the persistent
+ *              set built up by the main loop.
+ *   "uring"  - Linux io_uring, with one-shot poll requests that stay armed
+ *              in the kernel until their fd is ready.  Re-arming the fds
+ *              that fired and the wait itself take a single system call.
+ *              Small selects go to poll(), as with epoll.  Needs Linux 5.11
+ *              or later.
+ *
+ * The backend is chosen at runtime with WvPoller::use(), or by setting
+ * the WVSTREAMS_POLLER environment variable before the first select().
+ */
+class WvPoller
+{
+public:
+    virtual ~WvPoller();
+
+    /** Returns the name of this backend, as accepted by create(). */
+    virtual const char *name() const = 0;
+
+    /**
+     * Wait for the fds described in 'si'.  Returns the number of ready
+     * fds (counting each set separately), 0 on timeout, or -1 with errno
+     * set, just like ::select().
+     */
+    virtual int poll(IWvStream::SelectInfo &si) = 0;
+
+    /**
+     * Tell the backend that 'fd' is about to be closed, so any state it
+     * keeps about that fd can be dropped before the number gets reused.
+     * WvFdStream does this for you.
+     */
+    virtual void forget(int fd)
+        { }
+
+    /**
+     * Create a new backend by name.  Returns NULL if the name is unknown
+     * or that backend isn't available on this system.
+     */
+    static WvPoller *create(WvStringParm backend);
+
+    /**
+     * Returns the backend that WvStream::select() currently uses,
+     * creating the default one if necessary.
+     */
+    static WvPoller *current();
+
+    /**
+     * Switch WvStream::select() to the named backend.  Returns false (and
+     * leaves the current backend alone) if it can't be created.
+     */
+    static bool use(WvStringParm backend);
+
+    /** Calls forget() on the current backend, if there is one yet. */
+    static void forget_fd(int fd);
+
+private:
+    static WvPoller *cur;
+
+#ifndef _WIN32
+    static void onfork(pid_t p);
+#endif
+};
+
+#endif // __WVPOLLER_H
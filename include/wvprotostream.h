@@ -41,6 +41,10 @@ public:
     
     /** override uwrite() so we can log all output */
     virtual size_t uwrite(const void *buffer, size_t size);
+    virtual size_t uwritebuf(WvBuf &buf, size_t count)
+        { return WvStream::uwritebuf(buf, count); }
+    virtual int uwrite_fd()
+        { return -1; }
 
     // Routines to convert an input line into a set of Tokens.
     virtual Token *next_token();
@@ -14,16 +14,39 @@
 
 #define REBUILD_LOAD_FACTOR 0.45
 #define RESIZE_LOAD_FACTOR 0.4
+#define SHRINK_LOAD_FACTOR 0.1
+
+// how many slots of the old table to move to the new one on each add()
+// while we're resizing
+#define MIGRATE_SLOTS 16
+
+// tables smaller than this are still rebuilt all at once, since that's
+// quick anyway
+#define INCREMENTAL_SLOTS 4093
 
 #define IS_OCCUPIED(x) ((x) >> 1)
 #define IS_AUTO_FREE(x) ((x) == 3)
 #define IS_DELETED(x) ((x) == 1)
 
+/**
+ * The untyped base of WvScatterHash.
+ *
+ * When a big table needs to grow (or shrink, or get rid of deleted
+ * slots), it doesn't rehash everything at once, which can take a long
+ * time.  Instead it allocates the new table and keeps the old one
+ * around, and each add() moves a few slots' worth of elements from the
+ * old table to the new one.  Until that's done, lookups check both.
+ *
+ * Resizing only ever starts or moves along in add(), so removing elements
+ * (including the current one) while iterating is safe.  A big table that
+ * has had most of its elements removed shrinks the next time something is
+ * added to it; call compact() to make that happen right away.
+ */
 class WvScatterHashBase
 {
 public:
     WvScatterHashBase(unsigned _numslots);
-    virtual ~WvScatterHashBase() { deletev xslots; deletev xstatus; }
+    virtual ~WvScatterHashBase();
 
     static const unsigned null_idx = (unsigned)-1;
     static const unsigned prime_numbers[];
@@ -31,6 +54,13 @@ public:
     size_t count() const { return num; }
     bool isempty() const { return !num; }
     size_t slowcount() const;
+
+    /**
+     * Finish any resize in progress, and shrink the table to fit what's
+     * in it now.  This rehashes everything at once, so it's slow for a
+     * big table, and it's not safe while iterating.
+     */
+    void compact();
   
     /******* IterBase ******/
     class IterBase
@@ -43,34 +73,35 @@ public:
 
         void rewind() { index = 0; }
 	bool cur()
-	    { return index <= table->numslots; }
+	    { return index <= table->allslots(); }
 	void *vptr()
 	    { return get(); }
 	
+        // the new table's slots come first, then the old one's (if any)
         bool next()
         {
             if (!table)
                 return false;
 
-	    /* FIXME: Couldn't this be a *little* clearer? */
-            while (++index <= table->numslots &&
-                   !IS_OCCUPIED(table->xstatus[index-1])) { }
+	    unsigned all = table->allslots();
+            while (++index <= all && !IS_OCCUPIED(table->status(index-1)))
+		{ }
 
-	    return index <= table->numslots;
+	    return index <= all;
         }
 
         bool get_autofree() const
 	{
-            return IS_AUTO_FREE(table->xstatus[index-1]);
+            return IS_AUTO_FREE(table->status(index-1));
 	}
 
         void set_autofree(bool autofree)
 	{
-            table->xstatus[index-1] = autofree ? 3 : 2;
+            table->status(index-1) = autofree ? 3 : 2;
 	}
 
     protected:
-        void *get() const { return table->xslots[index-1]; }
+        void *get() const { return table->slot(index-1); }
 
         WvScatterHashBase *table;
         unsigned index;
@@ -91,6 +122,21 @@ protected:
     int prime_index;
     unsigned numslots;
 
+    // the table we're moving elements out of, if we're resizing.  Slots
+    // before migrate_pos have already been moved.
+    Slot *oldslots;
+    Status *oldstatus;
+    unsigned oldnumslots, migrate_pos;
+
+    // slot numbers from genfind() count through the new table and then
+    // the old one
+    unsigned allslots() const
+        { return numslots + oldnumslots; }
+    Status &status(unsigned i) const
+        { return i < numslots ? xstatus[i] : oldstatus[i - numslots]; }
+    Slot &slot(unsigned i) const
+        { return i < numslots ? xslots[i] : oldslots[i - numslots]; }
+
     unsigned genfind(const void *data, unsigned hash) const;
     Slot genfind_or_null(const void *data, unsigned hash) const;
     void _add(void *data, bool autofree);
@@ -104,15 +150,23 @@ protected:
 
 
 private:
-    void rebuild();
-    unsigned second_hash(unsigned hash) const
-        { return (hash % (numslots - 1)) + 1; }
-    unsigned curhash(unsigned hash, unsigned hash2, unsigned attempt) const
-        //{ return (hash + attempt * attempt) % numslots; }
-        { return (hash + attempt*hash2) % numslots; }
-
-    size_t used;
-    size_t num;
+    void alloc(int _prime_index);
+    void start_resize(int index);
+    int fit_index(size_t extra) const;
+    void migrate(unsigned n);
+    void place(void *data, unsigned hash, Status status);
+    unsigned find_in(Slot *slots, Status *stat, unsigned nslots,
+		     const void *data, unsigned hash) const;
+    static unsigned second_hash(unsigned hash, unsigned nslots)
+        { return (hash % (nslots - 1)) + 1; }
+    static unsigned curhash(unsigned hash, unsigned hash2, unsigned attempt,
+			    unsigned nslots)
+        //{ return (hash + attempt * attempt) % nslots; }
+        { return (hash + attempt*hash2) % nslots; }
+
+    size_t used;      // occupied or deleted slots in the new table
+    size_t num;       // elements in both tables
+    int min_index;    // never shrink below the size we started with
 };
 
 
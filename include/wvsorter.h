@@ -11,12 +11,15 @@
 
 #include "wvxplc.h"
 #include "wvlink.h"
+#include <string.h>
+#include <algorithm>
 
 // the base class for sorted list iterators.
 // It is similar to IterBase, except for rewind(), next(), and cur().
-// The sorting is done in rewind(), which makes an array of WvLink
-// pointers and calls qsort.  "lptr" is a pointer to the current WvLink *
-// in the array, and next() increments to the next one.
+// The sorting is done in rewind(), which makes an array of element
+// pointers and sorts it with std::sort.  "lptr" is a pointer to the
+// current element pointer in the array, and next() increments to the
+// next one.
 // NOTE: we do not keep "prev" because it makes no sense to do so.
 //       I guess Sorter::unlink() will be slow... <sigh>
 //       ...so we didn't implement it.
@@ -29,29 +32,49 @@ public:
     void **array;
     void **lptr;
     
-    WvSorterBase(void *_list)
-    	{ list = _list; array = lptr = NULL; }
-    ~WvSorterBase()
-    	{ if (array) deletev array; }
+    WvSorterBase(void *_list, bool _stable);
+    ~WvSorterBase();
     bool next()
 	{ return *(++lptr) != 0; }
     bool cur()
     	{ return *lptr != 0; }
     
+    /**
+     * If 'cache' is true, rewind() remembers which elements it sorted,
+     * and if the list holds exactly the same ones (in the same order) the
+     * next time, it skips the sort and reuses the last result.  That's
+     * worthwhile if you keep a sorter around and rewind it a lot.  But it
+     * can't tell if an element changed in a way that affects the order,
+     * so call invalidate() when that happens.
+     */
+    void set_cache(bool _cache)
+        { cache = _cache; valid = false; }
+    
+    /** Make the next rewind() sort from scratch. */
+    void invalidate()
+        { valid = false; }
+    
 protected:
-    template <class _list_,class _iter_> void rewind(CompareFunc *cmp);
+    template <class _list_, class _iter_, class _less_>
+        void rewind(_less_ less);
+    
+private:
+    bool stable, cache, valid;
+    size_t count, size;
+    void **seen;  // the elements in list order, the last time we sorted
     
-    static int magic_compare(const void *_a, const void *_b);
-    static CompareFunc *actual_compare;
+    void reserve(size_t n);
 };
 
 // the actual type-specific sorter.  Set _list_ and _iter_ to be your
 // common base class (eg. WvListBase and WvListBase::IterBase) if possible,
 // so we don't need to generate a specific rewind(cmp) function for each
-// specific type of list.  Since rewind(cmp) is the only non-inline function
-// in a sorter, that means you only need one of them per top-level container
-// type (ie. one for WvList and one for HashTable), not one per data type
-// you might store in such a container.
+// specific type of list.  rewind(cmp) is generated once per element type,
+// so that std::sort can call the compare function directly, instead of
+// through a wrapper like qsort did.
+//
+// If 'stable' is true, elements that compare equal stay in the order the
+// list had them in.
 template <class _type_,class _list_,class _iter_>
 class WvSorter : public WvSorterBase
 {
@@ -59,8 +82,8 @@ public:
     typedef int (RealCompareFunc)(const _type_ *a, const _type_ *b);
     RealCompareFunc *cmp;
     
-    WvSorter(_list_ &_list, RealCompareFunc *_cmp)
-	: WvSorterBase(&_list)
+    WvSorter(_list_ &_list, RealCompareFunc *_cmp, bool _stable = false)
+	: WvSorterBase(&_list, _stable)
 	{ cmp = _cmp; }
     _type_ *ptr() const
 	{ return (_type_ *)(*lptr); }
@@ -69,54 +92,70 @@ public:
     WvIterStuff(_type_);
     
     void rewind()
-      { WvSorterBase::rewind<_list_,_iter_>((CompareFunc *)cmp); }
+      { WvSorterBase::rewind<_list_,_iter_>(Less(cmp)); }
+    
+private:
+    struct Less
+    {
+        RealCompareFunc *cmp;
+        Less(RealCompareFunc *_cmp) : cmp(_cmp) { }
+        bool operator() (void *a, void *b) const
+            { return cmp((const _type_ *)a, (const _type_ *)b) < 0; }
+    };
 };
 
 
-// Note that this is largely the same as WvLink::SorterBase::rewind(),
-// except we iterate through a bunch of lists instead of a single one.
-template <class _list_,class _iter_>
-void WvSorterBase::rewind(CompareFunc *cmp)
+template <class _list_, class _iter_, class _less_>
+void WvSorterBase::rewind(_less_ less)
 {
-    int n, remaining;
-    
-    if (array)
-        deletev array;
-    array = lptr = NULL;
-
     _iter_ i(*(_list_ *)list);
     
-    // count the number of elements
-    n = 0;
-    for (i.rewind(); i.next(); )
-	n++;
-
-    typedef void *VoidPtr;
-    array = new VoidPtr[n+2];
-    void **aptr = array;
-
-    *aptr++ = NULL; // initial link is NULL, to act like a normal iterator
+    // count the number of elements, and see if they're the ones we
+    // sorted last time
+    size_t n = 0;
+    bool same = cache && valid;
+    for (i.rewind(); i.next(); n++)
+    {
+	if (same && (n >= count || seen[n] != i.vptr()))
+	    same = false;
+    }
     
-    for (remaining = n, i.rewind(); i.next() && remaining; remaining--)
+    if (same && n == count)
     {
-        *aptr = i.vptr();
-        aptr++;
+	lptr = array;
+	return;
     }
     
+    reserve(n);
+    size_t got = 0;
+    for (i.rewind(); got < n && i.next(); got++)
+	seen[got] = i.vptr();
+    
     // weird: list length changed?
     // (this can happen with "virtual" lists like ones from WvDirIter)
-    if (remaining)
-	n -= remaining;
+    n = got;
+    
+    // initial link is NULL, to act like a normal iterator
+    array[0] = NULL;
+    memcpy(array + 1, seen, n * sizeof(void *));
+    array[n+1] = NULL;
+    count = n;
+    valid = true;
+    
+    // lists that are kept in order (or nearly) are common, so check for
+    // that first; it's only one compare per element, and usually far less
+    // when they're not.
+    void **first = array + 1, **last = array + 1 + n, **p;
+    for (p = first + 1; p < last && !less(*p, *(p-1)); p++)
+	;
+    if (p < last)
+    {
+	if (stable)
+	    std::stable_sort(first, last, less);
+	else
+	    std::sort(first, last, less);
+    }
     
-    *aptr = NULL;
-
-    // sort the array.  "Very nearly re-entrant" (unless the compare function
-    // ends up being called recursively or something really weird...)
-    CompareFunc *old_compare = actual_compare;
-    actual_compare = cmp;
-    qsort(array+1, n, sizeof(void *), magic_compare);
-    actual_compare = old_compare;
-
     lptr = array;
 }
 
@@ -78,6 +78,12 @@ protected:
     SSL *ssl;
     
     virtual size_t uwrite(const void *buf, size_t len);
+    virtual size_t uwritebuf(WvBuf &buf, size_t count)
+        { return WvStream::uwritebuf(buf, count); } // encrypt it first!
+    virtual int uforward(int wfd, WvStream &out, size_t count)
+        { return -1; }
+    virtual int uwrite_fd()
+        { return -1; }
     virtual size_t uread(void *buf, size_t len);
     
 private:
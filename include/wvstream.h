@@ -8,10 +8,12 @@
 #define __WVSTREAM_H
 
 #include "iwvstream.h"
+#include "wvlink.h"
 #include "wvtimeutils.h"
 #include "wvstreamsdebugger.h"
 #include <errno.h>
 #include <limits.h>
+#include <typeinfo>
 #include "wvattrs.h"
 
 /**
@@ -72,7 +74,7 @@ public:
     /** Override seterr() from WvError so that it auto-closes the stream. */
     virtual void seterr(int _errnum);
     void seterr(WvStringParm specialerr)
-        { WvErrorBase::seterr(specialerr); }
+        { WvErrorBase::seterr(specialerr); select_changed(); }
     void seterr(WVSTRING_FORMAT_DECL)
         { seterr(WvString(WVSTRING_FORMAT_CALL)); }
     
@@ -156,6 +158,43 @@ public:
     virtual size_t uwrite(const void *buf, size_t count)
         { return count; /* basic WvStream doesn't actually do anything! */ }
 
+    /**
+     * Write up to 'count' bytes from the front of 'buf' without blocking,
+     * and remove whatever got written from 'buf'.  Returns the number of
+     * bytes written.  flush_outbuf() and write(WvBuf&) use this, so a
+     * stream that can send several buffer chunks at once (WvFdStream does
+     * it with writev()) makes only one system call for all of them.
+     * 
+     * The default gives the first chunk of 'buf' to uwrite().  If you
+     * override uwrite() in a class whose parent overrides this, override
+     * this too (usually by calling WvStream::uwritebuf()), or your
+     * uwrite() will be skipped.
+     */
+    virtual size_t uwritebuf(WvBuf &buf, size_t count);
+
+    /**
+     * Move up to 'count' bytes from this stream's input directly to the
+     * fd 'wfd', which belongs to 'out', without passing them through any
+     * buffer.  Returns the number of bytes moved, or -1 if that's not
+     * possible (in which case nothing was read) and forward() should use
+     * read() and write() instead.  Anything read but not accepted by
+     * 'wfd' must be written to 'out' normally.  The default returns -1.
+     * 
+     * As with uwritebuf(), if you override uread() in a class whose
+     * parent overrides this, override this too.  (WvFdStream only does it
+     * for classes that ask for it; see WvFdStream::forward_type().)
+     */
+    virtual int uforward(int wfd, WvStream &out, size_t count)
+        { return -1; }
+
+    /**
+     * Returns the fd that uwrite() writes to, if writing to it directly
+     * is exactly the same as calling write() right now, or -1 if not.
+     * The default returns -1.  Same warning as for uforward().
+     */
+    virtual int uwrite_fd()
+        { return -1; }
+
     /**
      * Read up to one line of data from the stream and return a
      * pointer to the internal buffer containing this line.  If the
@@ -230,7 +269,7 @@ public:
      * WARNING: getline() sets queuemin to 0 automatically!
      */ 
     void queuemin(size_t count)
-        { queue_min = count; }
+        { queue_min = count; select_changed(); }
 
     /**
      * drain the input buffer (read and discard data until select(0)
@@ -498,6 +537,15 @@ public:
      */
     void autoforward(WvStream &s);
 
+    /**
+     * Move up to 'count' bytes of input from this stream to 'out', as the
+     * autoforward() callback does.  If both ends are plain fds with
+     * nothing buffered, the data goes straight from one fd to the other
+     * inside the kernel (see uforward()); otherwise it goes through
+     * read() and write() as usual.  Returns the number of bytes moved.
+     */
+    size_t forward(WvStream &out, size_t count);
+
     /** Stops autoforwarding. */
     void noautoforward();
     static void autoforward_callback(WvStream &input, WvStream &output);
@@ -531,6 +579,47 @@ public:
      */
     time_t alarm_remaining();
 
+    /**
+     * return the number of milliseconds until the earliest alarm set on
+     * any stream goes off, or -1 if there are none.  Alarms that have
+     * already gone off don't count, but each of those streams gets a
+     * select_changed() so that whoever is caching its select state finds
+     * out.  This only looks at the alarms that have gone off, not at every
+     * stream.
+     */
+    static time_t next_alarm();
+
+    /**
+     * Whoever is reusing this stream's last pre_select() instead of
+     * calling it again, usually the WvIStreamList it's in, or NULL.
+     * select_changed() tells it when that stops being safe.
+     */
+    WvStream *select_watcher;
+
+    /**
+     * Call this whenever something changes that might change what
+     * pre_select() asks for: buffered data, callbacks, alarms, fds,
+     * closing, and so on.  WvStream and the classes that promise
+     * select_is_cacheable() already do.
+     */
+    void select_changed()
+        { if (select_watcher) select_watcher->watched_select_changed(this); }
+
+    /**
+     * True if a WvIStreamList may keep reusing what pre_select() last asked
+     * for, and stop calling pre_select() and post_select() until one of
+     * those fds comes back ready, the alarm goes off, or select_changed()
+     * is called.
+     * 
+     * That's only true for classes that promise it, by returning their own
+     * typeid from select_cacheable_type(), and only while
+     * select_state_cacheable() agrees.  A subclass doesn't inherit the
+     * promise, since it might override pre_select().
+     */
+    bool select_is_cacheable() const
+        { return typeid(*this) == select_cacheable_type()
+		&& select_state_cacheable(); }
+
     /**
      * print a preformatted WvString to the stream.
      * see the simple version of write() way up above.
@@ -563,6 +652,12 @@ public:
     virtual WvString getattr(WvStringParm name) const
 	{ return attrs.get(name); }
 
+    /**
+     * The link WvIStreamList uses for this stream, so that putting it
+     * in a list doesn't allocate anything.  See WvIntrusiveList.
+     */
+    WvEmbeddedLink listlink;
+
     // ridiculous hackery for now so that the wvstream unit test can poke
     // around in the insides of WvStream.  Eventually, inbuf will go away
     // from the base WvStream class, so nothing like this will be needed.
@@ -635,9 +730,13 @@ protected:
     bool is_flushing;
 
     size_t queue_min;		// minimum bytes to read()
+    // how much of the front of inbuf getline() already knows doesn't
+    // contain getline_sep.  Reset it whenever data leaves the front of inbuf.
+    size_t getline_scanned;
+    int getline_sep;
     time_t autoclose_time;	// close eventually, even if output is queued
     WvTime alarm_time;          // select() returns true at this time
-    WvTime last_alarm_check;    // last time we checked the alarm_remaining
+    int alarm_slot;             // our index in the alarm heap, or -1
     
     /**
      * The callback() function calls execute(), and then calls the user-
@@ -651,6 +750,30 @@ protected:
      */
     virtual void execute()
         { }
+
+    /**
+     * The most derived class whose pre_select() and post_select() depend
+     * only on state that calls select_changed() when it changes, and
+     * whose pre_select() only asks for a timeout because of an alarm.
+     * See select_is_cacheable().
+     */
+    virtual const std::type_info &select_cacheable_type() const
+        { return typeid(WvStream); }
+
+    /** Anything about the stream's current state that rules out caching. */
+    virtual bool select_state_cacheable() const
+        { return !autoclose_time; }
+
+    /** Called when a stream we're the select_watcher of changes. */
+    virtual void watched_select_changed(WvStream *s)
+        { }
+
+    /**
+     * Called when a stream we're the select_watcher of is destroyed.
+     * By default, that's just another change.
+     */
+    virtual void watched_destroyed(WvStream *s)
+        { watched_select_changed(s); }
     
     // every call to select() selects on the globalstream.
     static WvStream *globalstream;
@@ -673,6 +796,17 @@ private:
 
     void legacy_callback();
 
+    /**
+     * All the streams with an alarm set live in one binary min-heap on
+     * alarm_time, so the next alarm to go off is always at the front and
+     * arming or cancelling an alarm costs O(log n).  Each stream remembers
+     * its own position in alarm_slot, so nothing ever has to search.
+     */
+    void alarm_fixup();
+    void alarm_dequeue();
+    static void alarm_swap(int a, int b);
+    static void alarm_skew_check();
+
     /** Prevent accidental copying of WvStream.  These don't actually exist. */
     WvStream(const WvStream &s);
     WvStream& operator= (const WvStream &s);
@@ -76,6 +76,9 @@ public:
     virtual bool flush_internal(time_t msec_timeout);
     virtual size_t uread(void *buf, size_t size);
     virtual size_t uwrite(const void *buf, size_t size);
+    virtual size_t uwritebuf(WvBuf &buf, size_t count);
+    virtual int uforward(int wfd, WvStream &out, size_t count);
+    virtual int uwrite_fd();
     virtual bool isok() const;
     virtual int geterr() const;
     virtual WvString errstr() const;
@@ -90,8 +93,19 @@ public:
 private:
     void close_callback();
 
+    /** cloned, if we're its select_watcher. */
+    WvStream *watched;
+
 protected:
     WvString my_type;
+
+    virtual const std::type_info &select_cacheable_type() const
+        { return typeid(WvStreamClone); }
+    virtual bool select_state_cacheable() const;
+    virtual void watched_select_changed(WvStream *s)
+        { select_changed(); }
+    virtual void watched_destroyed(WvStream *s)
+        { watched = NULL; select_changed(); }
 public:
     const char *wstype() const { return my_type; }
 };
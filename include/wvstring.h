@@ -24,6 +24,13 @@
 /* 1 byte for terminating NUL */
 #define WVSTRING_EXTRA 1
 
+/*
+ * Strings shorter than this (including the terminating NUL) are stored
+ * right inside the WvString instead of in a separately allocated
+ * WvStringBuf.
+ */
+#define WVSTRING_INLINE 24
+
 
 #define __WVS_F(n) WvStringParm __wvs_##n
 #define __WVS_FORM(n) WvStringParm __wvs_##n = WvFastString::null
@@ -72,6 +79,12 @@ struct WvStringBuf
 };
 
 
+// set in WvStringBuf::links for buffers that may be shared between
+// threads (see WvStringCache).  Their link counts are changed atomically,
+// and since links is never 1, nobody ever edits them in place.
+#define WVSTRINGBUF_SHARED 0x80000000u
+
+
 // the _actual_ space taken by a WvStringBuf, without the data[] array
 // (which is variable-sized, not really 1 byte)
 #define WVSTRINGBUF_SIZE(s) (s->data - (char *)s)
@@ -89,15 +102,29 @@ struct WvStringBuf
  * object and then you modify the original (char *).
  * 
  * For almost all purposes, use WvString instead.  At worst, it's a bit slower.
+ *
+ * Short strings that we own (see WVSTRING_INLINE) live in the object
+ * itself, in place of the 'buf' pointer; str then points at inl[].  Those
+ * are never shared: copying one to a WvString copies the characters, and
+ * copying one to a WvFastString just points at them, like a char*.
  */
 class WvFastString
 {
     friend class WvString; // so WvString can access members of _other_ objects
+    friend class WvStringCache; // marks its buffers WVSTRINGBUF_SHARED
     
 protected:
-    WvStringBuf *buf;
+    union
+    {
+	WvStringBuf *buf;
+	char inl[WVSTRING_INLINE];
+    };
     char *str;
     
+    /** true if our string is in inl[] rather than in a WvStringBuf */
+    bool is_inline() const
+        { return str == inl; }
+    
     // WvStringBuf used for char* strings that have not been cloned.
     static WvStringBuf nullbuf;
     
@@ -232,6 +259,9 @@ protected:
     void link(WvStringBuf *_buf, const char *_str);
     void unlink();
     
+    // take over the string in 's' (we must be unlinked), leaving it NULL
+    void steal(WvFastString &s);
+    
     // allocate new space for buffers - needed only by the (int i) constructor,
     // for now.
     WvStringBuf *alloc(size_t size);
@@ -360,6 +390,12 @@ public:
     WvString(const WvFastString &s)
         { copy_constructor(s); }
     
+#if __cplusplus >= 201103L
+    /** Take over the string in 's' without copying it, leaving 's' NULL. */
+    WvString(WvString &&s) : WvFastString()
+        { unlink(); steal(s); }
+#endif
+    
     /**
      * Create a WvString out of a char* string.  We always allocate memory
      * and make a copy here.  To avoid memory copies, you can (carefully)
@@ -384,14 +420,25 @@ public:
     WvString(WVSTRING_FORMAT_DECL) : WvFastString(WVSTRING_FORMAT_CALL)
         { }
     
+    /**
+     * Add 's' to the end of this string.  If we're the only user of our
+     * buffer and it has room, this happens in place; otherwise the new
+     * buffer gets some extra room, so appending in a loop is cheap.
+     */
     WvString &append(WvStringParm s);
     WvString &append(WVSTRING_FORMAT_DECL)
         { return append(WvString(WVSTRING_FORMAT_CALL)); }
 
     WvString &operator= (int i);
     WvString &operator= (const WvFastString &s2);
+    WvString &operator= (const WvString &s2)
+        { return *this = (const WvFastString &)s2; }
     WvString &operator= (const char *s2)
         { return *this = WvFastString(s2); }
+#if __cplusplus >= 201103L
+    WvString &operator= (WvString &&s2)
+        { if (&s2 != this) { unlink(); steal(s2); } return *this; }
+#endif
     
     /** make the buf and str pointers owned only by this WvString. */
     WvString &unique();
@@ -421,12 +468,13 @@ protected:
  * A ridiculous class needed because UniConf::operator->() needs to return
  * a pointer, even though that pointer is going to be dereferenced
  * immediately anyway.  We can instantiate a temporary WvStringStar, which
- * can then return its 'this' pointer.
+ * can then return its 'this' pointer.  It's a real WvString, since the
+ * string it's made from is usually a temporary too.
  */
-class WvStringStar : public WvFastString
+class WvStringStar : public WvString
 {
 public:
-    WvStringStar(WvStringParm s) : WvFastString(s)
+    WvStringStar(WvStringParm s) : WvString(s)
         { }
     WvFastString *operator -> ()
         { return this; }
@@ -9,6 +9,19 @@
 
 #include "wvstringtable.h"
 
+/**
+ * Counters for the table shared by all WvStringCaches.
+ */
+struct WvStringCacheStats
+{
+    size_t lookups;  // calls to get() that could have been shared
+    size_t hits;     // ...and that found the string already in the table
+    size_t strings;  // strings in the table right now
+    size_t bytes;    // memory used by those strings
+    size_t saved;    // memory not allocated because copies share a string
+};
+
+
 /**
  * A cache table of WvString objects.  If you think you might be reusing
  * the same string objects over and over (for example, because the user
@@ -21,19 +34,26 @@
  * content) in its place.  The string will be saved in the cache table for
  * next time.
  * 
- * Every once and a while, you should call clean() to remove any strings from
- * the table that are no longer referenced elsewhere.  This is especially
- * important after deleting a large data structure, because you won't actually
- * free up the memory used by those strings until clean() is called.
+ * Strings that no one else uses anymore are dropped from the table a few
+ * at a time, each time a new one is added, so the table never has to be
+ * walked all at once.  You can still call clean() to drop them all right
+ * away, for example after deleting a large data structure.
  * 
  * All WvStringCaches in the app are shared, to optimize the benefits of
- * the cache.
+ * the cache, and they may be used from several threads at once.  The
+ * table is split into shards with a lock each, and the strings it hands
+ * out are reference counted atomically, so the same string can be used
+ * in several threads.  Strings short enough to be stored inside the
+ * WvString object (see WVSTRING_INLINE) gain nothing from sharing, so
+ * get() just copies them.
  */
 class WvStringCache
 {
-    static WvStringTable *t;
     static int refcount;
-    static size_t clean_threshold;
+    
+    friend class WvStringCacheTable;
+    static bool is_unused(const WvString &s);
+    static size_t memsize(const WvString &s, size_t *saved);
     
 public:
     WvStringCache();
@@ -44,6 +64,9 @@ public:
     
     /** Remove any now-unused strings from the cache. */
     void clean();
+    
+    /** Return the statistics for the whole cache. */
+    static WvStringCacheStats stats();
 };
 
 
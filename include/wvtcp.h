@@ -39,6 +39,7 @@ class WvTCPListener;
 class WvTCPConn : public WvFDStream
 {
     friend class WvTCPListener;
+    friend class WvWorkerPool;
 protected:
     bool resolved, connected;
     WvString hostname;
@@ -46,8 +47,13 @@ protected:
     WvIPPortAddr remaddr;
     WvResolver dns;
     
-    /** Start a WvTCPConn on an already-open socket (used by WvTCPListener) */
-    WvTCPConn(int _fd, const WvIPPortAddr &_remaddr);
+    /**
+     * Start a WvTCPConn on an already-open socket (used by WvTCPListener).
+     * If fd_flags_set is true, the socket is already non-blocking and
+     * close-on-exec, as accept4() can make it.
+     */
+    WvTCPConn(int _fd, const WvIPPortAddr &_remaddr,
+	      bool fd_flags_set = false);
     
     /** Connect to the remote end - note the "Protected" above ;) */
     void do_connect();
@@ -74,9 +80,10 @@ public:
     
     /**
      * function to set up a TCP socket the way we like
-     * (Read/Write, Non-Blocking, KeepAlive)
+     * (Read/Write, Non-Blocking, KeepAlive).  If fd_flags_set is true,
+     * the socket is known to be non-blocking and close-on-exec already.
      */
-    void nice_tcpopts();
+    void nice_tcpopts(bool fd_flags_set = false);
     
     /**
      * function to set up a TCP socket the way we like
@@ -124,6 +131,20 @@ public:
 
     virtual size_t uread(void *buf, size_t count);
     virtual size_t uwrite(const void *buf, size_t count);
+    virtual size_t uwritebuf(WvBuf &buf, size_t count);
+    virtual int uforward(int wfd, WvStream &out, size_t count);
+    virtual int uwrite_fd();
+
+protected:
+    virtual const std::type_info &select_cacheable_type() const
+        { return typeid(WvTCPConn); }
+    virtual bool select_state_cacheable() const
+        { return resolved && connected
+		&& WvFDStream::select_state_cacheable(); }
+    virtual const std::type_info &writev_type() const
+        { return typeid(WvTCPConn); }
+    virtual const std::type_info &forward_type() const
+        { return typeid(WvTCPConn); }
 
 public:
     const char *wstype() const { return "WvTCPConn"; }
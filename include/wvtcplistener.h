@@ -19,8 +19,12 @@ public:
     /**
      * Create a WvStream that listens on _listenport of the current machine
      * This is how you set up a TCP Server.
+     * 
+     * If reuseport is true, the socket is bound with SO_REUSEPORT, so that
+     * several processes can each have their own listener on the same port
+     * and let the kernel spread the incoming connections between them.
      */
-    WvTCPListener(const WvIPPortAddr &_listenport);
+    WvTCPListener(const WvIPPortAddr &_listenport, bool reuseport = false);
 
     virtual ~WvTCPListener();
     
@@ -32,6 +36,12 @@ public:
      */
     virtual IWvStream *accept();
     
+    /**
+     * Accept all the connections that are waiting (up to a limit, so other
+     * streams still get a turn) instead of just one per select().
+     */
+    virtual void callback();
+    
     /** src() is a bit of a misnomer, but it returns the listener port. */
     virtual const WvIPPortAddr *src() const;
     
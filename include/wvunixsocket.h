@@ -33,6 +33,7 @@ class WvUnixConn;
 class WvUnixConn : public WvFdStream
 {
     friend class WvUnixListener;
+    friend class WvWorkerPool;
 protected:
     WvUnixAddr addr;
     
@@ -60,6 +61,14 @@ public:
      */
     virtual const WvUnixAddr *src() const;
     
+protected:
+    virtual const std::type_info &select_cacheable_type() const
+        { return typeid(WvUnixConn); }
+    virtual const std::type_info &writev_type() const
+        { return typeid(WvUnixConn); }
+    virtual const std::type_info &forward_type() const
+        { return typeid(WvUnixConn); }
+
 public:
     const char *wstype() const { return "WvUnixConn"; }
 };
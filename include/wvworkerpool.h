@@ -0,0 +1,168 @@
+/* -*- Mode: C++ -*-
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Spreads incoming connections over several worker processes, each with
+ * its own main loop.
+ */
+#ifndef __WVWORKERPOOL_H
+#define __WVWORKERPOOL_H
+
+#include "wvistreamlist.h"
+#include "iwvlistener.h"
+#include "wvlog.h"
+#include "wvaddr.h"
+#include <vector>
+
+class WvFdStream;
+
+/**
+ * WvWorkerPool forks a set of worker processes (one per CPU by default).
+ * Each worker runs its own WvIStreamList::globallist, so it also gets its
+ * own poller, alarms and WvTaskMan.  The pool stays in the parent and
+ * accepts connections from its listeners.  Each new connection goes to
+ * whichever worker currently has the fewest streams on its globallist.
+ * This lets a server use every CPU, and WvStreams itself doesn't have to
+ * become thread-safe: the only thing workers share is the file descriptors
+ * passed to them.
+ *
+ * Connections are passed as file descriptors over a unix socket.  The
+ * worker turns each one back into a stream: an AF_INET socket becomes a
+ * WvTCPConn, an AF_UNIX socket becomes a WvUnixConn, and anything else
+ * becomes a plain WvFdStream.  Wrappers such as SSL would be lost if the
+ * parent applied them, so add them to the pool with addwrap() instead of
+ * to the listener; the pool runs them in the worker.
+ *
+ * For TCP, add_sharded_listener() can skip the parent entirely: each
+ * worker opens its own SO_REUSEPORT socket on the same port, and the
+ * kernel spreads connections between them.
+ *
+ * The parent can also send() a message to one worker or to all of them.
+ * It arrives at the onmessage() callback, inside the worker's main loop,
+ * and is how the parent wakes a worker up and asks it to do something.
+ *
+ * Typical use: create the pool, set onaccept() and friends, add_listener()
+ * your listeners, call start(), and put the pool on the parent's globallist.
+ * Workers exit when the pool is destroyed or the parent process dies.
+ * A worker that dies is not restarted; its share of the load goes to the
+ * others.
+ */
+class WvWorkerPool : public WvIStreamList
+{
+public:
+    typedef wv::function<void(WvStringParm)> MessageCallback;
+    typedef wv::function<void(int)> StartCallback;
+
+    /** Create a pool of 'nworkers' workers, or one per CPU if it's 0. */
+    WvWorkerPool(int nworkers = 0);
+    virtual ~WvWorkerPool();
+
+    /**
+     * Hand out the connections accepted from 'l'.  The pool takes
+     * ownership of the listener.
+     */
+    void add_listener(IWvListener *l);
+
+    /**
+     * Have every worker open its own SO_REUSEPORT TCP listener on 'addr',
+     * and let the kernel spread new connections between them.  This avoids
+     * passing each connection through the parent.  If 'addr' has port 0,
+     * a free port is picked.  Returns the address actually used, or one
+     * with port 0 if it can't be bound.  Without SO_REUSEPORT, this falls
+     * back to add_listener() with an ordinary WvTCPListener.  Call it
+     * before start().
+     */
+    WvIPPortAddr add_sharded_listener(const WvIPPortAddr &addr);
+
+    /** Like IWvListener::addwrap(), but the wrapper runs in the worker. */
+    void addwrap(IWvListenerWrapper _wrapper);
+
+    /**
+     * Set the function that receives each new connection.  It runs in
+     * the worker, and usually puts the stream on the globallist.
+     */
+    void onaccept(IWvListenerCallback _cb)
+        { acceptor = _cb; }
+
+    /** Set the function that receives messages sent with send(). */
+    void onmessage(MessageCallback _cb)
+        { messenger = _cb; }
+
+    /**
+     * Set a function to run in each worker just after it starts.  It is
+     * given the worker number, from 0 to num_workers()-1.
+     */
+    void onstart(StartCallback _cb)
+        { starter = _cb; }
+
+    /**
+     * Fork the workers.  This returns only in the parent process; the
+     * workers run their main loop until the pool goes away and then exit.
+     */
+    bool start();
+
+    /**
+     * Give the connected stream 's' to the least busy worker, and release
+     * our reference to it.  The stream must be a plain file descriptor,
+     * not something with state of its own like an SSL stream.  Returns
+     * false (and keeps our reference) if that isn't possible.
+     */
+    bool handoff(IWvStream *s);
+
+    /**
+     * Send 'msg' to worker number 'worker', or to all of them if 'worker'
+     * is -1.  Returns false if it couldn't be delivered everywhere.
+     */
+    bool send(int worker, WvStringParm msg);
+
+    /** The number of workers started, including any that have died. */
+    int num_workers() const
+        { return workers.size(); }
+
+    /** The number of streams that worker number 'worker' last reported. */
+    int load(int worker) const
+        { return workers[worker].load; }
+
+    /** True if worker number 'worker' is still running. */
+    bool alive(int worker) const
+        { return workers[worker].ctl != NULL; }
+
+private:
+    struct Worker
+    {
+	pid_t pid;
+	WvFdStream *ctl;
+	int load;
+    };
+    std::vector<Worker> workers;
+    int nworkers;
+    WvLog log;
+
+    // the ports added with add_sharded_listener(), and the sockets that
+    // keep them reserved in the parent
+    std::vector<WvIPPortAddr> shards;
+    std::vector<int> shard_fds;
+
+    IWvListenerCallback acceptor;
+    IWvListenerWrapper wrapper;
+    MessageCallback messenger;
+    StartCallback starter;
+
+    void accept_cb(IWvStream *s);
+    void parent_ctl_cb(int worker);
+    void lost_worker(int worker);
+
+    // these are only used inside the worker processes
+    WvFdStream *worker_ctl;
+    int base_load, reported_load;
+    void run_worker(int worker, int fd);
+    void worker_ctl_cb();
+    void deliver(IWvStream *s);
+    void report_load();
+    static IWvStream *fd_to_stream(int fd);
+
+public:
+    const char *wstype() const { return "WvWorkerPool"; }
+};
+
+#endif // __WVWORKERPOOL_H
@@ -100,3 +100,50 @@ WVTEST_MAIN("connection refused 2")
     WVPASSEQ(tcp.geterr(), ECONNREFUSED);
     printf("Error string is '%s'\n", tcp.errstr().cstr());
 }
+
+
+static void count_accept(int *count, IWvStream *s)
+{
+    (*count)++;
+    WVRELEASE(s);
+}
+
+
+WVTEST_MAIN("tcp listener accepts in batches")
+{
+    WvTCPListener listen(WvIPPortAddr("127.0.0.1", 0));
+    WVPASS(listen.isok());
+    WvIPPortAddr port(*listen.src());
+    int count = 0;
+    listen.onaccept(wv::bind(count_accept, &count, _1));
+    
+    const int nconns = 5;
+    WvTCPConn *conns[nconns];
+    for (int i = 0; i < nconns; i++)
+	conns[i] = new WvTCPConn(port);
+    for (int i = 0; i < nconns; i++)
+	conns[i]->runonce(100); // finish connecting
+    
+    // one callback picks up everything that's waiting
+    listen.callback();
+    WVPASSEQ(count, nconns);
+    
+    for (int i = 0; i < nconns; i++)
+	WVRELEASE(conns[i]);
+}
+
+
+WVTEST_MAIN("tcp listener SO_REUSEPORT")
+{
+    WvTCPListener a(WvIPPortAddr("127.0.0.1", 0), true);
+    WVPASS(a.isok());
+    WvIPPortAddr port(*a.src());
+    
+    WvTCPListener b(port, true);
+    WVPASS(b.isok());
+    WVPASSEQ(WvString(*b.src()), WvString(port));
+    
+    // without it, the port is taken
+    WvTCPListener c(port);
+    WVFAIL(c.isok());
+}
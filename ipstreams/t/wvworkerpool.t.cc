@@ -0,0 +1,149 @@
+#include "wvworkerpool.h"
+#include "wvtcp.h"
+#include "wvtcplistener.h"
+#include "wvistreamlist.h"
+#include "wvtest.h"
+#include <stdio.h>
+#include <unistd.h>
+
+// the number of this worker, in the worker processes
+static int worker_num = -1;
+static int msgfd = -1;
+
+
+static void worker_started(int n)
+{
+    worker_num = n;
+}
+
+
+static void echo(WvStreamClone *s)
+{
+    const char *line = s->getline(0);
+    if (line)
+	s->print("%s:%s\n", worker_num, line);
+}
+
+
+static void worker_accept(IWvStream *_s)
+{
+    WvStreamClone *s = new WvStreamClone(_s);
+    s->setcallback(wv::bind(echo, s));
+    WvIStreamList::globallist.append(s, true, "echo");
+}
+
+
+static void worker_message(WvStringParm msg)
+{
+    WvString rec("%s:%s\n", worker_num, msg);
+    ::write(msgfd, rec.cstr(), rec.len());
+}
+
+
+WVTEST_MAIN("worker pool")
+{
+    int pipefds[2];
+    WVPASS(!pipe(pipefds));
+    msgfd = pipefds[1];
+
+    WvWorkerPool *pool = new WvWorkerPool(2);
+    pool->onstart(worker_started);
+    pool->onaccept(worker_accept);
+    pool->onmessage(worker_message);
+    WvTCPListener *listener = new WvTCPListener(WvIPPortAddr("127.0.0.1", 0));
+    WvIPPortAddr port(*listener->src());
+    pool->add_listener(listener);
+    WVPASS(pool->start());
+    WVPASSEQ(pool->num_workers(), 2);
+    WvIStreamList::globallist.append(pool, false, "worker pool");
+
+    // every connection gets answered, and they're spread over both workers
+    const int count = 6;
+    WvTCPConn *conns[count];
+    WvString replies[count];
+    for (int i = 0; i < count; i++)
+    {
+	conns[i] = new WvTCPConn(port);
+	conns[i]->print("hello %s\n", i);
+	WvIStreamList::globallist.runonce(10);
+    }
+    for (int i = 0; i < count; i++)
+    {
+	for (int tries = 0; tries < 100 && !replies[i]; tries++)
+	{
+	    WvIStreamList::globallist.runonce(10);
+	    if (conns[i]->isreadable())
+		replies[i] = conns[i]->getline(0);
+	}
+	WVPASS(!!replies[i]);
+    }
+    int hits[2] = { 0, 0 };
+    for (int i = 0; i < count; i++)
+    {
+	WVPASSEQ(replies[i].cstr() + 1, WvString(":hello %s", i));
+	if (replies[i][0] == '0')
+	    hits[0]++;
+	else if (replies[i][0] == '1')
+	    hits[1]++;
+    }
+    WVPASSEQ(hits[0] + hits[1], count);
+    WVPASS(hits[0] > 0);
+    WVPASS(hits[1] > 0);
+
+    // messages get to the workers' main loops
+    WVPASS(pool->send(1, "one"));
+    char buf[64];
+    ssize_t len = read(pipefds[0], buf, sizeof(buf) - 1);
+    WVPASS(len > 0);
+    buf[len > 0 ? len : 0] = 0;
+    WVPASSEQ(buf, "1:one\n");
+    WVPASS(pool->alive(0));
+    WVPASS(pool->alive(1));
+
+    for (int i = 0; i < count; i++)
+	WVRELEASE(conns[i]);
+    WvIStreamList::globallist.unlink(pool);
+    delete pool;
+    ::close(pipefds[0]);
+    ::close(pipefds[1]);
+}
+
+
+WVTEST_MAIN("worker pool with sharded listeners")
+{
+    WvWorkerPool *pool = new WvWorkerPool(2);
+    pool->onstart(worker_started);
+    pool->onaccept(worker_accept);
+    WvIPPortAddr port
+	= pool->add_sharded_listener(WvIPPortAddr("127.0.0.1", 0));
+    WVPASS(port.port != 0);
+    WVPASS(pool->start());
+    WvIStreamList::globallist.append(pool, false, "worker pool");
+
+    // the workers answer directly; the parent never sees the connections
+    const int count = 4;
+    WvTCPConn *conns[count];
+    for (int i = 0; i < count; i++)
+    {
+	conns[i] = new WvTCPConn(port);
+	conns[i]->print("hello %s\n", i);
+    }
+    for (int i = 0; i < count; i++)
+    {
+	WvString reply;
+	for (int tries = 0; tries < 100 && !reply; tries++)
+	{
+	    WvIStreamList::globallist.runonce(10);
+	    if (conns[i]->isreadable())
+		reply = conns[i]->getline(0);
+	}
+	WVPASS(!!reply);
+	if (!!reply)
+	    WVPASSEQ(reply.cstr() + 1, WvString(":hello %s", i));
+    }
+
+    for (int i = 0; i < count; i++)
+	WVRELEASE(conns[i]);
+    WvIStreamList::globallist.unlink(pool);
+    delete pool;
+}
@@ -57,6 +57,9 @@
 #define FORCE_NONZERO 0
 #endif
 
+// the most connections WvTCPListener::callback() accepts in one go
+#define MAX_ACCEPT_BATCH 64
+
 #ifdef SOLARIS
 #define SOL_TCP 6
 #define SOL_IP 0
@@ -105,7 +108,8 @@ WvTCPConn::WvTCPConn(const WvIPPortAddr &_remaddr)
 }
 
 
-WvTCPConn::WvTCPConn(int _fd, const WvIPPortAddr &_remaddr)
+WvTCPConn::WvTCPConn(int _fd, const WvIPPortAddr &_remaddr,
+		     bool fd_flags_set)
     : WvFDStream(_fd)
 {
     remaddr = (_remaddr.is_zero() && FORCE_NONZERO)
@@ -113,7 +117,7 @@ WvTCPConn::WvTCPConn(int _fd, const WvIPPortAddr &_remaddr)
     resolved = true;
     connected = true;
     incoming = true;
-    nice_tcpopts();
+    nice_tcpopts(fd_flags_set);
 }
 
 
@@ -161,10 +165,13 @@ WvTCPConn::~WvTCPConn()
 
 // Set a few "nice" options on our socket... (read/write, non-blocking, 
 // keepalive)
-void WvTCPConn::nice_tcpopts()
+void WvTCPConn::nice_tcpopts(bool fd_flags_set)
 {
-    set_close_on_exec(true);
-    set_nonblock(true);
+    if (!fd_flags_set)
+    {
+	set_close_on_exec(true);
+	set_nonblock(true);
+    }
     
     int value = 1;
     setsockopt(getfd(), SOL_SOCKET, SO_KEEPALIVE, &value, sizeof(value));
@@ -399,9 +406,37 @@ size_t WvTCPConn::uwrite(const void *buf, size_t count)
 }
 
 
+size_t WvTCPConn::uwritebuf(WvBuf &buf, size_t count)
+{
+    if (connected)
+	return WvFDStream::uwritebuf(buf, count);
+    else
+	return 0; // can't write yet; let them enqueue it instead
+}
+
+
+int WvTCPConn::uforward(int wfd, WvStream &out, size_t count)
+{
+    if (connected)
+	return WvFDStream::uforward(wfd, out, count);
+    else
+	return 0;
+}
+
+
+int WvTCPConn::uwrite_fd()
+{
+    if (connected)
+	return WvFDStream::uwrite_fd();
+    else
+	return -1;
+}
+
+
 
 
-WvTCPListener::WvTCPListener(const WvIPPortAddr &_listenport)
+WvTCPListener::WvTCPListener(const WvIPPortAddr &_listenport,
+			     bool reuseport)
 	: WvListener(new WvFdStream(socket(PF_INET, SOCK_STREAM, 0)))
 {
     WvFdStream *fds = (WvFdStream *)cloned;
@@ -414,8 +449,12 @@ WvTCPListener::WvTCPListener(const WvIPPortAddr &_listenport)
     fds->set_nonblock(true);
     if (getfd() < 0
 	|| setsockopt(getfd(), SOL_SOCKET, SO_REUSEADDR, &x, sizeof(x))
+#ifdef SO_REUSEPORT
+	|| (reuseport
+	    && setsockopt(getfd(), SOL_SOCKET, SO_REUSEPORT, &x, sizeof(x)))
+#endif
 	|| bind(getfd(), sa, listenport.sockaddr_len())
-	|| listen(getfd(), 5))
+	|| listen(getfd(), SOMAXCONN))
     {
 	seterr(errno);
 	return;
@@ -448,10 +487,18 @@ IWvStream *WvTCPListener::accept()
     
     if (!isok()) return NULL;
 
+#if HAVE_ACCEPT4
+    // set the flags right away, instead of with two more syscalls later
+    int newfd = ::accept4(getfd(), (struct sockaddr *)&sin, &len,
+			  SOCK_NONBLOCK | SOCK_CLOEXEC);
+    bool fd_flags_set = true;
+#else
     int newfd = ::accept(getfd(), (struct sockaddr *)&sin, &len);
+    bool fd_flags_set = false;
+#endif
     if (newfd >= 0)
-	return wrap(new WvTCPConn(newfd, WvIPPortAddr(&sin)));
-    else if (errno == EAGAIN || errno == EINTR)
+	return wrap(new WvTCPConn(newfd, WvIPPortAddr(&sin), fd_flags_set));
+    else if (errno == EAGAIN || errno == EINTR || errno == ECONNABORTED)
 	return NULL; // this listener is doing weird stuff
     else
     {
@@ -461,6 +508,18 @@ IWvStream *WvTCPListener::accept()
 }
 
 
+void WvTCPListener::callback()
+{
+    for (int i = 0; acceptor && i < MAX_ACCEPT_BATCH; i++)
+    {
+	IWvStream *s = accept();
+	if (!s)
+	    break;
+	acceptor(s);
+    }
+}
+
+
 void WvTCPListener::accept_callback(WvIStreamList *list,
 				    wv::function<void(IWvStream*)> cb,
 				    IWvStream *_conn)
@@ -0,0 +1,456 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Spreads incoming connections over several worker processes, each with
+ * its own main loop.  See wvworkerpool.h.
+ */
+#include "wvworkerpool.h"
+#include "wvfdstream.h"
+#include "wvfork.h"
+#include "wvtcp.h"
+#include "wvtcplistener.h"
+#include "wvunixsocket.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#ifndef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC 0
+#endif
+
+// how often an idle worker tells the parent how busy it is
+#define LOAD_REPORT_MSEC 250
+
+// the biggest message we can send() to a worker
+#define MAX_MESSAGE 4096
+
+
+// Messages on the control socket are single SOCK_SEQPACKET records.  The
+// first byte says what they are:
+//   'F': (to worker) a new connection; the fd comes along as SCM_RIGHTS.
+//   'M': (to worker) the rest of the record is a message for onmessage().
+//   'L': (to parent) the rest is the number of streams the worker has.
+static bool send_fd(int sock, int fd)
+{
+    char type = 'F';
+    struct iovec iov;
+    iov.iov_base = &type;
+    iov.iov_len = 1;
+
+    union {
+	struct cmsghdr hdr;
+	char buf[CMSG_SPACE(sizeof(int))];
+    } cbuf;
+    memset(&cbuf, 0, sizeof(cbuf));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf.buf;
+    msg.msg_controllen = sizeof(cbuf.buf);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == 1;
+}
+
+
+// Receive one record (without blocking) into buf, and the fd that came
+// with it, if any, into *fd.  Returns the record length like recv().
+static ssize_t recv_fd(int sock, char *buf, size_t len, int *fd)
+{
+    struct iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = len;
+
+    union {
+	struct cmsghdr hdr;
+	char buf[CMSG_SPACE(sizeof(int))];
+    } cbuf;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf.buf;
+    msg.msg_controllen = sizeof(cbuf.buf);
+
+    *fd = -1;
+    ssize_t ret = recvmsg(sock, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (ret < 0)
+	return ret;
+
+    struct cmsghdr *cmsg;
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+	if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+	    && cmsg->cmsg_len >= CMSG_LEN(sizeof(int)))
+	    memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    return ret;
+}
+
+
+// Turn a file descriptor from the parent back into the kind of stream the
+// listener would have made.
+IWvStream *WvWorkerPool::fd_to_stream(int fd)
+{
+    struct sockaddr_storage ss;
+    socklen_t len = sizeof(ss);
+
+    if (getpeername(fd, (struct sockaddr *)&ss, &len) == 0
+	&& ss.ss_family == AF_INET)
+	return new WvTCPConn(fd, WvIPPortAddr((struct sockaddr_in *)&ss));
+
+    len = sizeof(ss);
+    if (getsockname(fd, (struct sockaddr *)&ss, &len) == 0
+	&& ss.ss_family == AF_UNIX)
+    {
+	struct sockaddr_un *saun = (struct sockaddr_un *)&ss;
+	bool named = len > offsetof(struct sockaddr_un, sun_path);
+	return new WvUnixConn(fd, WvUnixAddr(named ? saun->sun_path : ""));
+    }
+
+    WvFdStream *s = new WvFdStream(fd);
+    s->set_close_on_exec(true);
+    s->set_nonblock(true);
+    return s;
+}
+
+
+WvWorkerPool::WvWorkerPool(int _nworkers)
+    : log("WvWorkerPool", WvLog::Debug)
+{
+    nworkers = _nworkers;
+    if (nworkers <= 0)
+	nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nworkers <= 0)
+	nworkers = 1;
+    worker_ctl = NULL;
+    base_load = 0;
+    reported_load = -1;
+}
+
+
+WvWorkerPool::~WvWorkerPool()
+{
+    // closing the control sockets tells the workers to finish up
+    zap();
+
+    std::vector<Worker>::iterator i;
+    for (i = workers.begin(); i != workers.end(); ++i)
+	waitpid(i->pid, NULL, 0);
+
+    std::vector<int>::iterator fd;
+    for (fd = shard_fds.begin(); fd != shard_fds.end(); ++fd)
+	::close(*fd);
+}
+
+
+void WvWorkerPool::add_listener(IWvListener *l)
+{
+    l->onaccept(wv::bind(&WvWorkerPool::accept_cb, this, _1));
+    append(l, true, "worker pool listener");
+}
+
+
+WvIPPortAddr WvWorkerPool::add_sharded_listener(const WvIPPortAddr &addr)
+{
+#ifdef SO_REUSEPORT
+    // Bind a socket here first, but don't listen on it, so it never gets
+    // any connections.  That picks the port number if we have to, checks
+    // that the workers will be able to bind it too, and keeps anyone else
+    // from taking it in the meantime.
+    WvIPPortAddr bound(addr);
+    struct sockaddr *sa = bound.sockaddr();
+    socklen_t len = bound.sockaddr_len();
+    int x = 1;
+    int fd = socket(PF_INET, SOCK_STREAM, 0);
+    if (fd < 0
+	|| setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &x, sizeof(x))
+	|| setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &x, sizeof(x))
+	|| bind(fd, sa, len)
+	|| getsockname(fd, sa, &len))
+    {
+	log(WvLog::Error, "Can't bind %s: %s\n", addr, strerror(errno));
+	if (fd >= 0)
+	    ::close(fd);
+	delete sa;
+	return WvIPPortAddr(addr, 0);
+    }
+    bound = WvIPPortAddr((struct sockaddr_in *)sa);
+    delete sa;
+
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    shard_fds.push_back(fd);
+    shards.push_back(bound);
+    return bound;
+#else
+    WvTCPListener *l = new WvTCPListener(addr);
+    WvIPPortAddr bound(*l->src());
+    add_listener(l);
+    return bound;
+#endif
+}
+
+
+static IWvStream *wrapper_runner(IWvListenerWrapper newer,
+				 IWvListenerWrapper older, IWvStream *s)
+{
+    return newer(older(s));
+}
+
+
+void WvWorkerPool::addwrap(IWvListenerWrapper _wrapper)
+{
+    // the first wrapper added is the innermost, as in IWvListener
+    if (wrapper)
+	wrapper = wv::bind(&wrapper_runner, _wrapper, wrapper, _1);
+    else
+	wrapper = _wrapper;
+}
+
+
+bool WvWorkerPool::start()
+{
+    for (int i = 0; i < nworkers; i++)
+    {
+	int socks[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, socks) < 0)
+	{
+	    seterr(errno);
+	    return false;
+	}
+
+	// the workers that come after this one mustn't get either end
+	fcntl(socks[0], F_SETFD, FD_CLOEXEC);
+	fcntl(socks[1], F_SETFD, FD_CLOEXEC);
+
+	pid_t pid = wvfork(socks[1]);
+	if (pid < 0)
+	{
+	    seterr(errno);
+	    ::close(socks[0]);
+	    ::close(socks[1]);
+	    return false;
+	}
+	else if (pid == 0)
+	    run_worker(i, socks[1]); // never returns
+
+	::close(socks[1]);
+
+	Worker w;
+	w.pid = pid;
+	w.ctl = new WvFdStream(socks[0]);
+	w.load = 0;
+	w.ctl->setcallback(wv::bind(&WvWorkerPool::parent_ctl_cb, this, i));
+	append(w.ctl, true, "worker pool control");
+	workers.push_back(w);
+
+	log("Started worker %s (pid %s).\n", i, pid);
+    }
+    return true;
+}
+
+
+void WvWorkerPool::accept_cb(IWvStream *s)
+{
+    if (!handoff(s))
+    {
+	log(WvLog::Warning, "No worker could take a new connection.\n");
+	WVRELEASE(s);
+    }
+}
+
+
+bool WvWorkerPool::handoff(IWvStream *s)
+{
+    int fd = s->getrfd();
+    if (fd < 0 || s->getwfd() != fd)
+	return false;
+
+    for (;;)
+    {
+	int best = -1;
+	for (int i = 0; i < (int)workers.size(); i++)
+	{
+	    if (workers[i].ctl
+		&& (best < 0 || workers[i].load < workers[best].load))
+		best = i;
+	}
+	if (best < 0)
+	    return false;
+
+	if (send_fd(workers[best].ctl->getwfd(), fd))
+	{
+	    // count it right away, so a burst of connections doesn't all
+	    // land on the same worker before it can report back
+	    workers[best].load++;
+	    WVRELEASE(s);
+	    return true;
+	}
+	lost_worker(best);
+    }
+}
+
+
+bool WvWorkerPool::send(int worker, WvStringParm msg)
+{
+    if (msg.len() + 1 > MAX_MESSAGE)
+	return false;
+
+    WvString rec("M%s", msg);
+    bool ok = true;
+    for (int i = 0; i < (int)workers.size(); i++)
+    {
+	if (worker >= 0 && i != worker)
+	    continue;
+	if (!workers[i].ctl
+	    || ::send(workers[i].ctl->getwfd(), rec.cstr(), rec.len(),
+		      MSG_NOSIGNAL) != (ssize_t)rec.len())
+	    ok = false;
+    }
+    return ok;
+}
+
+
+void WvWorkerPool::parent_ctl_cb(int worker)
+{
+    WvFdStream *ctl = workers[worker].ctl;
+    char buf[32];
+    ssize_t len;
+
+    while ((len = ::recv(ctl->getrfd(), buf, sizeof(buf) - 1,
+			 MSG_DONTWAIT)) > 0)
+    {
+	buf[len] = 0;
+	if (buf[0] == 'L')
+	    workers[worker].load = atoi(buf + 1);
+    }
+
+    if (len == 0 || (errno != EAGAIN && errno != EINTR))
+	lost_worker(worker);
+}
+
+
+void WvWorkerPool::lost_worker(int worker)
+{
+    Worker &w = workers[worker];
+    if (!w.ctl)
+	return;
+
+    log(WvLog::Warning, "Lost worker %s (pid %s).\n", worker, w.pid);
+    unlink(w.ctl);
+    w.ctl = NULL;
+}
+
+
+void WvWorkerPool::run_worker(int worker, int fd)
+{
+    // wvfork() has already closed every close-on-exec fd, which includes
+    // our listeners and the other workers' sockets, and the globallist
+    // starts out empty.  The parent's stream objects are still in memory,
+    // but their fd numbers may get reused, so we never touch them again
+    // and leave with _exit() instead of running any destructors.
+    worker_ctl = new WvFdStream(fd);
+    worker_ctl->set_close_on_exec(true);
+    worker_ctl->setcallback(wv::bind(&WvWorkerPool::worker_ctl_cb, this));
+    WvIStreamList::globallist.append(worker_ctl, false, "worker control");
+
+    std::vector<WvIPPortAddr>::iterator i;
+    for (i = shards.begin(); i != shards.end(); ++i)
+    {
+	WvTCPListener *l = new WvTCPListener(*i, true);
+	if (!l->isok())
+	    log(WvLog::Error, "Worker %s can't listen on %s: %s\n",
+		worker, *i, l->errstr());
+	l->onaccept(wv::bind(&WvWorkerPool::deliver, this, _1));
+	WvIStreamList::globallist.append(l, true, "sharded listener");
+    }
+    base_load = WvIStreamList::globallist.count();
+
+    if (starter)
+	starter(worker);
+    report_load();
+    worker_ctl->alarm(LOAD_REPORT_MSEC);
+
+    while (worker_ctl->isok())
+	WvIStreamList::globallist.runonce();
+
+    _exit(0);
+}
+
+
+void WvWorkerPool::worker_ctl_cb()
+{
+    char buf[MAX_MESSAGE + 1];
+    int fd;
+    ssize_t len;
+
+    while ((len = recv_fd(worker_ctl->getrfd(), buf, sizeof(buf) - 1,
+			  &fd)) > 0)
+    {
+	buf[len] = 0;
+	if (buf[0] == 'F' && fd >= 0)
+	    deliver(fd_to_stream(fd));
+	else
+	{
+	    if (fd >= 0)
+		::close(fd);
+	    if (buf[0] == 'M' && messenger)
+		messenger(buf + 1);
+	}
+    }
+
+    if (len == 0 || (errno != EAGAIN && errno != EINTR))
+    {
+	// the parent is gone, or the pool was destroyed
+	worker_ctl->close();
+	return;
+    }
+
+    report_load();
+    worker_ctl->alarm(LOAD_REPORT_MSEC);
+}
+
+
+void WvWorkerPool::deliver(IWvStream *s)
+{
+    if (wrapper)
+	s = wrapper(s);
+    if (acceptor)
+	acceptor(s);
+    else
+	WVRELEASE(s);
+}
+
+
+void WvWorkerPool::report_load()
+{
+    // our own control stream and listeners don't count
+    int load = WvIStreamList::globallist.count() - base_load;
+    if (load == reported_load)
+	return;
+
+    WvString rec("L%s", load);
+    if (::send(worker_ctl->getwfd(), rec.cstr(), rec.len(), MSG_NOSIGNAL)
+	== (ssize_t)rec.len())
+	reported_load = load;
+}
@@ -6,6 +6,7 @@
 #endif
 #include <string.h>
 
+#include "wvautoconf.h"
 #include "wvfdstream.h"
 #include "wvfile.h"
 #include "wvfileutils.h"
@@ -341,3 +342,209 @@ WVTEST_MAIN("Test undo_force_select() on a WvFDStream")
     unlink(testfile);
 }
 
+
+
+class CountFD : public WvFDStream
+{
+public:
+    int ureads, uwrites;
+
+    CountFD(int fd) : WvFDStream(fd)
+        { ureads = uwrites = 0; }
+
+    virtual size_t uread(void *buf, size_t count)
+    {
+	ureads++;
+	return WvFDStream::uread(buf, count);
+    }
+
+    virtual size_t uwrite(const void *buf, size_t count)
+    {
+	uwrites++;
+	return WvFDStream::uwrite(buf, count);
+    }
+};
+
+// CountFD's uwrite() is its own, but this one promises that skipping it
+// is fine.
+class WritevCountFD : public CountFD
+{
+public:
+    WritevCountFD(int fd) : CountFD(fd)
+        { }
+
+protected:
+    virtual const std::type_info &writev_type() const
+        { return typeid(WritevCountFD); }
+};
+
+// ...and this one that skipping uread() and uwrite() for forward() is.
+class ForwardCountFD : public CountFD
+{
+public:
+    ForwardCountFD(int fd) : CountFD(fd)
+        { }
+
+protected:
+    virtual const std::type_info &forward_type() const
+        { return typeid(ForwardCountFD); }
+};
+
+
+// Writes 20 messages through a delayed-output clone of 's1', each into its
+// own chunk of the outbuf, then flushes them.  Returns how many times
+// s1->uwrite() got called for the flush.
+static int flush_messages(CountFD *s1, int peerfd)
+{
+    WvFdStream s2(peerfd);
+    WvStreamClone clone(s1);
+    clone.delay_output(true);
+
+    WvString expect("");
+    for (int i = 0; i < 20; i++)
+    {
+	WvDynBuf msg;
+	WvString line("message %s\n", i);
+	msg.putstr(line);
+	WVPASSEQ(clone.write(msg), line.len());
+	WVPASSEQ(msg.used(), 0);
+	expect.append(line);
+    }
+    WVPASSEQ(s1->uwrites, 0);
+
+    clone.flush(1000);
+    s1->flush(1000);
+    WVPASSEQ(s1->geterr(), 0);
+    int uwrites = s1->uwrites;
+
+    char buf[1024];
+    size_t len = 0;
+    while (len < expect.len() && s2.select(1000, true, false))
+	len += s2.read(buf + len, sizeof(buf) - 1 - len);
+    buf[len] = 0;
+    WVPASSEQ(buf, expect);
+    return uwrites;
+}
+
+
+WVTEST_MAIN("vectored flush")
+{
+    int socks[2];
+    
+    // a class that overrides uwrite() still has it called
+    WVPASS(!wvsocketpair(SOCK_STREAM, socks));
+    WVPASS(flush_messages(new CountFD(socks[0]), socks[1]) > 0);
+
+    // ...unless it asks for writev(), and then they all go out together
+    WVPASS(!wvsocketpair(SOCK_STREAM, socks));
+    WVPASSEQ(flush_messages(new WritevCountFD(socks[0]), socks[1]), 0);
+}
+
+
+// reads everything available from 'fd' for up to a second, until 'want'
+// bytes have arrived
+static WvString slurp(int fd, size_t want)
+{
+    WvFdStream s(dup(fd));
+    WvDynBuf buf;
+    while (buf.used() < want && s.select(1000, true, false))
+	s.read(buf, want - buf.used());
+    return buf.getstr();
+}
+
+
+WVTEST_MAIN("zero-copy forward")
+{
+    int a[2], b[2];
+    WvString data("");
+    for (int i = 0; i < 1000; i++)
+	data.append("line %s\n", i);
+    size_t moved = 0;
+    
+    // classes that override uread() and uwrite() still have them called
+    {
+	WVPASS(!wvsocketpair(SOCK_STREAM, a));
+	WVPASS(!wvsocketpair(SOCK_STREAM, b));
+	CountFD in(a[1]), out(b[0]);
+	WVPASSEQ(::write(a[0], data.cstr(), data.len()), (int)data.len());
+	while (moved < data.len() && in.select(1000, true, false))
+	    moved += in.forward(out, 65536);
+	WVPASSEQ(moved, data.len());
+	WVPASS(slurp(b[1], data.len()) == data);
+	WVPASS(in.ureads > 0);
+	WVPASS(out.uwrites > 0);
+	::close(a[0]);
+	::close(b[1]);
+    }
+    
+    WVPASS(!wvsocketpair(SOCK_STREAM, a));
+    WVPASS(!wvsocketpair(SOCK_STREAM, b));
+    ForwardCountFD in(a[1]), out(b[0]);
+    WVPASSEQ(::write(a[0], data.cstr(), data.len()), (int)data.len());
+    
+    // ...but otherwise, with nothing buffered, the data never goes through
+    // our buffers
+    moved = 0;
+    while (moved < data.len() && in.select(1000, true, false))
+	moved += in.forward(out, 65536);
+    WVPASSEQ(moved, data.len());
+    WVPASS(slurp(b[1], data.len()) == data);
+#ifdef HAVE_SPLICE
+    WVPASSEQ(in.ureads, 0);
+    WVPASSEQ(out.uwrites, 0);
+#endif
+
+    // anything that was already read ahead has to go first
+    WVPASSEQ(::write(a[0], "first\nsecond\nthird\n", 19), 19);
+    WVPASSEQ(in.blocking_getline(1000), "first");
+    ::write(a[0], "fourth\n", 7);
+    moved = 0;
+    while (moved < 20 && in.select(1000, true, false))
+	moved += in.forward(out, 65536);
+    WVPASSEQ(slurp(b[1], 20), "second\nthird\nfourth\n");
+
+    // the end of file still gets noticed
+    ::close(a[0]);
+    for (int tries = 0; tries < 10 && in.isok(); tries++)
+	if (in.select(100, true, false))
+	    in.forward(out, 65536);
+    WVFAIL(in.isok());
+    ::close(b[1]);
+}
+
+
+WVTEST_MAIN("zero-copy forward from a file")
+{
+    WvString testfile = wvtmpfilename("wvfdstream-sendfile-");
+    WvString data("");
+    for (int i = 0; i < 5000; i++)
+	data.append("line %s\n", i);
+    {
+	WvFile f(testfile, O_CREAT|O_WRONLY|O_TRUNC, 0666);
+	f.write(data);
+    }
+
+    int b[2];
+    WVPASS(!wvsocketpair(SOCK_STREAM, b));
+    CountFD *out = new ForwardCountFD(b[0]);
+    WvStreamClone outclone(out);
+    WvFile in(testfile, O_RDONLY);
+    in.autoforward(outclone);
+    
+    WvDynBuf got;
+    WvFdStream reader(b[1]);
+    for (int tries = 0; tries < 1000 && got.used() < data.len(); tries++)
+    {
+	if (in.isok() && in.select(0, true, false))
+	    in.callback();
+	if (reader.select(10, true, false))
+	    reader.read(got, 65536);
+    }
+    WVPASSEQ(got.used(), data.len());
+    WVPASS(got.getstr() == data);
+#ifdef HAVE_SYS_SENDFILE_H
+    WVPASSEQ(out->uwrites, 0);
+#endif
+    
+    unlink(testfile);
+}
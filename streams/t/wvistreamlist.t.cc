@@ -1,7 +1,9 @@
 #include "wvistreamlist.h"
 #include "wvtest.h"
 #include "wvloopback.h"
+#include "wvfdstream.h"
 #include "wvtimeutils.h"
+#include "wvsocketpair.h"
 #ifdef _WIN32
 #include "streams.h"
 #endif
@@ -89,3 +91,148 @@ WVTEST_MAIN("spinning list 2")
     WVPASSEQ(scount, 0);
     WVPASSEQ(lcount, 0);
 }
+
+
+class CountingStream : public WvFdStream
+{
+public:
+    int posts;
+    
+    CountingStream(int fd) : WvFdStream(fd)
+        { posts = 0; }
+    
+    virtual bool post_select(SelectInfo &si)
+    {
+	posts++;
+	return WvFdStream::post_select(si);
+    }
+};
+
+
+WVTEST_MAIN("idle streams skip post_select")
+{
+    const int count = 10;
+    int socks[count][2];
+    CountingStream *s[count];
+    int scount = 0;
+    
+    WvIStreamList l;
+    for (int i = 0; i < count; i++)
+    {
+	WVPASS(!wvsocketpair(SOCK_STREAM, socks[i]));
+	s[i] = new CountingStream(socks[i][0]);
+	l.append(s[i], true, "counting");
+    }
+    s[3]->setcallback(wv::bind(cb, &scount));
+    
+    // only the stream with data waiting is looked at after the select
+    ::write(socks[3][1], "x", 1);
+    l.runonce(1000);
+    WVPASSEQ(scount, 1);
+    for (int i = 0; i < count; i++)
+	WVPASSEQ(s[i]->posts, i == 3 ? 1 : 0);
+    s[3]->drain();
+    
+    // a stream whose alarm has gone off is checked, but one whose alarm
+    // is still far away isn't
+    s[5]->alarm(0);
+    s[6]->alarm(60000);
+    l.runonce(0);
+    WVPASSEQ(s[5]->posts, 1);
+    WVPASSEQ(s[6]->posts, 0);
+    WVPASSEQ(s[7]->posts, 0);
+    
+    s[6]->alarm(1);
+    for (int tries = 0; tries < 10 && !s[6]->posts; tries++)
+	l.runonce(100);
+    WVPASSEQ(s[6]->posts, 1);
+    
+    // force_select() makes a stream ready without any fds
+    s[7]->force_select(false, true);
+    l.runonce(0);
+    WVPASS(s[7]->posts > 0);
+    
+    for (int i = 0; i < count; i++)
+	::close(socks[i][1]);
+}
+
+
+static bool all_quiet(WvIStreamList &l, WvFdStream **s, int count)
+{
+    for (int i = 0; i < count; i++)
+	if (s[i]->select_watcher != &l)
+	    return false;
+    return true;
+}
+
+
+WVTEST_MAIN("idle streams go quiet")
+{
+    const int count = 10;
+    int socks[count][2];
+    WvFdStream *s[count];
+    int scount[count];
+    
+    WvIStreamList l;
+    for (int i = 0; i < count; i++)
+    {
+	WVPASS(!wvsocketpair(SOCK_STREAM, socks[i]));
+	s[i] = new WvFdStream(socks[i][0]);
+	scount[i] = 0;
+	s[i]->setcallback(wv::bind(cb, &scount[i]));
+	l.append(s[i], true, "quiet");
+    }
+    
+    // after one idle pass, nobody needs pre_select() anymore
+    l.runonce(0);
+    WVPASS(all_quiet(l, s, count));
+    l.runonce(0);
+    WVPASS(all_quiet(l, s, count));
+    
+    // but they still wake up when data arrives
+    ::write(socks[3][1], "x", 1);
+    l.runonce(1000);
+    WVPASSEQ(scount[3], 1);
+    WVPASS(s[3]->select_watcher != &l);
+    char buf[10];
+    WVPASSEQ(s[3]->read(buf, sizeof(buf)), 1);
+    l.runonce(0);
+    WVPASS(all_quiet(l, s, count));
+    
+    // ...or when their alarms go off
+    s[5]->alarm(50);
+    l.runonce(0);
+    WVPASS(all_quiet(l, s, count));
+    for (int tries = 0; tries < 20 && !scount[5]; tries++)
+	l.runonce(100);
+    WVPASSEQ(scount[5], 1);
+    
+    // ...or when anything else changes what they'd select on
+    l.runonce(0);
+    WVPASS(all_quiet(l, s, count));
+    s[7]->force_select(false, true);
+    WVPASS(s[7]->select_watcher != &l);
+    l.runonce(0);
+    WVPASS(scount[7] > 0);
+    s[7]->undo_force_select(false, true);
+    
+    // a stream that closes gets pruned, and one that goes away stops
+    // being watched
+    l.runonce(0);
+    WVPASS(all_quiet(l, s, count));
+    ::close(socks[8][1]);
+    l.runonce(1000);
+    WVPASSEQ(scount[8], 1);
+    WVPASSEQ(s[8]->read(buf, sizeof(buf)), 0);
+    WVPASS(!s[8]->isok());
+    l.runonce(0);
+    WVPASSEQ(l.count(), (size_t)count - 1);
+    
+    WvFdStream *x = s[9];
+    l.unlink(x);
+    WVPASSEQ(l.count(), (size_t)count - 2);
+    
+    for (int i = 0; i < count; i++)
+	if (i != 8)
+	    ::close(socks[i][1]);
+}
@@ -4,6 +4,9 @@
 #include "wvlogbuffer.h"
 #include "wvlogfile.h"
 #include "wvfileutils.h"
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
 
 
 WVTEST_MAIN("extremely basic test")
@@ -197,6 +200,174 @@ WVTEST_MAIN("Recursion avoidance")
     WVPASSEQ(unlink(logfilename), 0);
 }
 
+static int filtered = 0;
+
+static WvString count_filter(WvStringParm s)
+{
+    filtered++;
+    return s;
+}
+
+
+WVTEST_MAIN("unwanted levels are skipped")
+{
+    WvLogFilter filter(count_filter);
+    WvLog log("skiptest", WvLog::Debug5, &filter);
+    
+    {
+        WvLogBuffer buf(10, WvLog::Info);
+        WVPASS(WvLog::wanted(WvLog::Info));
+        WVFAIL(WvLog::wanted(WvLog::Debug));
+        WVFAIL(log.wanted());
+        
+        // nobody wants these, so they never even get to the filter
+        filtered = 0;
+        log("not %s\n", "wanted");
+        log.print("not wanted either\n");
+        log(WvLog::Debug2, "still %s\n", "not wanted");
+        WVPASSEQ(filtered, 0);
+        WVPASSEQ(log.lvl(WvLog::Debug).write("x\n", 2), 2);
+        log.lvl(WvLog::Debug5);
+        
+        log(WvLog::Info, "wanted %s\n", 1);
+        WVPASSEQ(filtered, 1);
+        
+        // a second receiver or a custom level can raise the bar
+        {
+            WvLogBuffer buf2(10, WvLog::Debug);
+            WVPASS(WvLog::wanted(WvLog::Debug));
+            WVFAIL(WvLog::wanted(WvLog::Debug2));
+        }
+        WVFAIL(WvLog::wanted(WvLog::Debug));
+        
+        WVPASS(buf.set_custom_levels("skiptest=10"));
+        WVPASS(log.wanted());
+        log("wanted %s\n", 2);
+        WVPASSEQ(filtered, 2);
+        WVPASS(buf.set_custom_levels(""));
+        WVFAIL(log.wanted());
+        
+        buf.level(WvLog::Debug5);
+        WVPASS(log.wanted());
+        
+        WvLogBuffer::MsgList::Iter i(buf.messages());
+        i.rewind();
+        WVPASS(i.next());
+        WVPASSEQ(i->message, "wanted 1");
+        WVPASS(i.next());
+        WVPASSEQ(i->message, "wanted 2");
+        WVFAIL(i.next());
+    }
+    
+    // with no receivers at all, everything goes to stderr
+    WVPASS(WvLog::wanted(WvLog::Debug5));
+}
+
+
+WVTEST_MAIN("async log file")
+{
+    WvString logfilename = wvtmpfilename("wvlog-async");
+    
+    {
+        WvLogFileBase logfile(logfilename, WvLog::Debug);
+        WvLog log("asynctest", WvLog::Info);
+        logfile.fsync_msec = 10;
+        WVPASS(logfile.start_async(64*1024));
+        WVPASS(logfile.is_async());
+        
+        for (int i = 0; i < 1000; i++)
+            log("line %s\n", i);
+        logfile.flush_async();
+        WVPASSEQ(logfile.dropped(), 0);
+        
+        // a queue smaller than a line can't hold it
+        logfile.stop_async();
+        WVPASS(logfile.start_async(1));
+        WvString big("%s\n", WvString("%65536s", "x"));
+        log(big);
+        WVPASSEQ(logfile.dropped(), 1);
+        log("last\n");
+        
+        // stopping writes out half-finished lines too
+        log("unfinished");
+        logfile.stop_async();
+        WVFAIL(logfile.is_async());
+        logfile.close();
+    }
+    
+    WvFile file(logfilename, O_RDONLY);
+    const char *line;
+    int i;
+    for (i = 0; i < 1000; i++)
+    {
+        line = file.getline();
+        if (!line || !strstr(line, WvString("<Info>: line %s", i)))
+            break;
+    }
+    WVPASSEQ(i, 1000);
+    line = file.getline();
+    WVPASS(line && strstr(line, "<Info>: last"));
+    line = file.getline();
+    WVPASS(line && strstr(line, "<Info>: unfinished"));
+    WVFAIL(file.getline());
+    file.close();
+    WVPASSEQ(unlink(logfilename), 0);
+}
+
+
+#ifndef _WIN32
+WVTEST_MAIN("async log file and fork")
+{
+    WvString logfilename = wvtmpfilename("wvlog-asyncfork");
+    
+    {
+        WvLogFileBase logfile(logfilename, WvLog::Debug);
+        WvLog log("forktest", WvLog::Info);
+        WVPASS(logfile.start_async());
+        log("before\n");
+        
+        pid_t pid = fork();
+        if (!pid)
+        {
+            // the writer thread doesn't come along, so the child has to
+            // write directly; if it waited for the thread, it'd hang.
+            alarm(10);
+            log("child\n");
+            logfile.flush_async();
+            _exit(logfile.is_async() ? 1 : 0);
+        }
+        int status = -1;
+        WVPASSEQ(waitpid(pid, &status, 0), pid);
+        WVPASS(WIFEXITED(status));
+        WVPASSEQ(WEXITSTATUS(status), 0);
+        
+        WVPASS(logfile.is_async());
+        log("parent\n");
+        logfile.stop_async();
+        logfile.close();
+    }
+    
+    // everybody's line is there, and only once
+    WvFile file(logfilename, O_RDONLY);
+    int before = 0, child = 0, parent = 0;
+    const char *line;
+    while ((line = file.getline()) != NULL)
+    {
+        if (strstr(line, "<Info>: before"))
+            before++;
+        else if (strstr(line, "<Info>: child"))
+            child++;
+        else if (strstr(line, "<Info>: parent"))
+            parent++;
+    }
+    WVPASSEQ(before, 1);
+    WVPASSEQ(child, 1);
+    WVPASSEQ(parent, 1);
+    file.close();
+    WVPASSEQ(unlink(logfilename), 0);
+}
+#endif
+
 #if 0
 WVTEST_MAIN("wvlog performance")
 {
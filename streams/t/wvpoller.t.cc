@@ -0,0 +1,303 @@
+#include "wvpoller.h"
+#include "wvfdstream.h"
+#include "wvistreamlist.h"
+#include "wvsocketpair.h"
+#include "wvtest.h"
+#include <unistd.h>
+
+static const char *backends[] = { "select", "poll", "epoll", "uring", NULL };
+
+
+static void cb(int *x)
+{
+    (*x)++;
+}
+
+
+// Runs 'count' socketpairs through a WvIStreamList and checks that only
+// the ones we wrote to get their callbacks.  Enough streams are used that
+// epoll really uses its persistent set instead of falling back to poll.
+static void check_backend(const char *backend)
+{
+    const int count = 20;
+    WvFdStream *near[count], *far[count];
+    int hits[count];
+
+    WvIStreamList l;
+    for (int i = 0; i < count; i++)
+    {
+	int socks[2];
+	WVPASS(!wvsocketpair(SOCK_STREAM, socks));
+	near[i] = new WvFdStream(socks[0]);
+	far[i] = new WvFdStream(socks[1]);
+	hits[i] = 0;
+	near[i]->setcallback(wv::bind(cb, &hits[i]));
+	l.append(near[i], true, "poller near");
+    }
+
+    for (int round = 0; round < 3; round++)
+    {
+	far[round * 3]->write("x", 1);
+	for (int tries = 0; tries < 10 && !hits[round * 3]; tries++)
+	    l.runonce(100);
+	near[round * 3]->drain();
+
+	for (int i = 0; i < count; i++)
+	    WVPASSEQ(hits[i], i <= round * 3 && !(i % 3) ? 1 : 0);
+    }
+
+    // closing the far end should wake up the near end exactly once more
+    hits[1] = 0;
+    far[1]->close();
+    for (int tries = 0; tries < 10 && !hits[1]; tries++)
+	l.runonce(100);
+    WVPASS(hits[1] >= 1);
+
+    // an idle loop should time out, not spin
+    for (int i = 0; i < count; i++)
+	hits[i] = 0;
+    l.runonce(10);
+    int total = 0;
+    for (int i = 0; i < count; i++)
+	if (i != 1)
+	    total += hits[i];
+    WVPASSEQ(total, 0);
+
+    for (int i = 0; i < count; i++)
+	delete far[i];
+}
+
+
+WVTEST_MAIN("poller backends")
+{
+    for (int i = 0; backends[i]; i++)
+    {
+	if (!WvPoller::use(backends[i]))
+	{
+	    printf("Backend '%s' not available, skipping.\n", backends[i]);
+	    continue;
+	}
+	WVPASSEQ(WvPoller::current()->name(), backends[i]);
+	check_backend(backends[i]);
+    }
+    WVPASS(WvPoller::use("select"));
+    WVFAIL(WvPoller::use("nonexistent"));
+    WVPASSEQ(WvPoller::current()->name(), "select");
+}
+
+
+// a closed-and-reused fd number must not inherit the old registration
+static void check_reuse(const char *backend)
+{
+    if (!WvPoller::use(backend))
+	return;
+
+    const int count = 10;
+    int socks[count][2];
+    WvIStreamList l;
+    WvFdStream *s[count];
+    for (int i = 0; i < count; i++)
+    {
+	WVPASS(!wvsocketpair(SOCK_STREAM, socks[i]));
+	s[i] = new WvFdStream(socks[i][0]);
+	l.append(s[i], false, "poller reuse");
+    }
+    l.runonce(0);
+
+    // close one stream and open a new one that gets the same fd number
+    int oldfd = s[0]->getrfd();
+    l.unlink(s[0]);
+    WVRELEASE(s[0]);
+    int newsocks[2];
+    WVPASS(!wvsocketpair(SOCK_STREAM, newsocks));
+    WVPASSEQ(newsocks[0], oldfd);
+    s[0] = new WvFdStream(newsocks[0]);
+    int hits = 0;
+    s[0]->setcallback(wv::bind(cb, &hits));
+    l.append(s[0], false, "poller reuse new");
+
+    ::write(newsocks[1], "x", 1);
+    for (int tries = 0; tries < 10 && !hits; tries++)
+	l.runonce(100);
+    WVPASSEQ(hits, 1);
+
+    for (int i = 0; i < count; i++)
+    {
+	l.unlink(s[i]);
+	WVRELEASE(s[i]);
+	::close(socks[i][1]);
+    }
+    ::close(newsocks[1]);
+    WVPASS(WvPoller::use("select"));
+}
+
+
+WVTEST_MAIN("poller fd reuse")
+{
+    check_reuse("epoll");
+    check_reuse("uring");
+}
+
+
+// a stream being watched by io_uring must really close when it's closed,
+// even though the kernel still had a poll armed on it
+WVTEST_MAIN("poller uring close")
+{
+    if (!WvPoller::use("uring"))
+	return;
+
+    const int count = 10;
+    WvIStreamList l;
+    WvFdStream *s[count];
+    int peers[count];
+    for (int i = 0; i < count; i++)
+    {
+	int socks[2];
+	WVPASS(!wvsocketpair(SOCK_STREAM, socks));
+	s[i] = new WvFdStream(socks[0]);
+	peers[i] = socks[1];
+	l.append(s[i], false, "poller close");
+    }
+    l.runonce(0);
+
+    l.unlink(s[0]);
+    WVRELEASE(s[0]);
+    char buf[1];
+    WVPASSEQ(recv(peers[0], buf, sizeof(buf), MSG_DONTWAIT), 0);
+
+    for (int i = 1; i < count; i++)
+    {
+	l.unlink(s[i]);
+	WVRELEASE(s[i]);
+    }
+    for (int i = 0; i < count; i++)
+	::close(peers[i]);
+    WVPASS(WvPoller::use("select"));
+}
+
+
+// an fd closed without forget(), while a dup of it is still open, must not
+// keep reporting events for whatever gets its number next
+WVTEST_MAIN("poller epoll stale fd")
+{
+    WvPoller *p = WvPoller::create("epoll");
+    if (!p)
+	return;
+
+    const int count = 10;
+    int socks[count][2];
+    for (int i = 0; i < count; i++)
+	WVPASS(!wvsocketpair(SOCK_STREAM, socks[i]));
+
+    IWvStream::SelectInfo si;
+    FD_ZERO(&si.read);
+    FD_ZERO(&si.write);
+    FD_ZERO(&si.except);
+    si.max_fd = -1;
+    for (int i = 0; i < count; i++)
+    {
+	FD_SET(socks[i][0], &si.read);
+	if (socks[i][0] > si.max_fd)
+	    si.max_fd = socks[i][0];
+    }
+    IWvStream::SelectInfo want = si;
+    si.msec_timeout = 0;
+    WVPASSEQ(p->poll(si), 0);
+
+    // close it behind the poller's back, and make the old socket readable
+    int oldfd = socks[0][0];
+    int dupfd = dup(oldfd);
+    ::close(oldfd);
+    ::write(socks[0][1], "x", 1);
+    int newsocks[2];
+    WVPASS(!wvsocketpair(SOCK_STREAM, newsocks));
+    WVPASSEQ(newsocks[0], oldfd);
+
+    // the poller only finds out when it has to change what it asks epoll
+    // for about that number, so ask for writable first, then readable.
+    si = want;
+    FD_CLR(oldfd, &si.read);
+    FD_SET(oldfd, &si.write);
+    si.msec_timeout = 0;
+    WVPASSEQ(p->poll(si), 1);
+    WVPASS(FD_ISSET(oldfd, &si.write));
+    si = want;
+    si.msec_timeout = 0;
+    WVPASSEQ(p->poll(si), 0);
+    WVFAIL(FD_ISSET(oldfd, &si.read));
+
+    // but the new socket still works
+    ::write(newsocks[1], "y", 1);
+    si = want;
+    si.msec_timeout = 1000;
+    WVPASSEQ(p->poll(si), 1);
+    WVPASS(FD_ISSET(oldfd, &si.read));
+
+    delete p;
+    ::close(dupfd);
+    ::close(newsocks[0]);
+    ::close(newsocks[1]);
+    ::close(socks[0][1]);
+    for (int i = 1; i < count; i++)
+    {
+	::close(socks[i][0]);
+	::close(socks[i][1]);
+    }
+}
+
+
+// same thing with io_uring, whose armed poll keeps the old file open and
+// would otherwise never notice that the number means something else now
+WVTEST_MAIN("poller uring stale fd")
+{
+    WvPoller *p = WvPoller::create("uring");
+    if (!p)
+	return;
+
+    const int count = 10;
+    int socks[count][2];
+    for (int i = 0; i < count; i++)
+	WVPASS(!wvsocketpair(SOCK_STREAM, socks[i]));
+
+    IWvStream::SelectInfo si;
+    FD_ZERO(&si.read);
+    FD_ZERO(&si.write);
+    FD_ZERO(&si.except);
+    si.max_fd = -1;
+    for (int i = 0; i < count; i++)
+    {
+	FD_SET(socks[i][0], &si.read);
+	if (socks[i][0] > si.max_fd)
+	    si.max_fd = socks[i][0];
+    }
+    IWvStream::SelectInfo want = si;
+    si.msec_timeout = 0;
+    WVPASSEQ(p->poll(si), 0);
+
+    // close it behind the poller's back and reuse the number, asking for
+    // exactly the same thing as before
+    int oldfd = socks[0][0];
+    ::close(oldfd);
+    int newsocks[2];
+    WVPASS(!wvsocketpair(SOCK_STREAM, newsocks));
+    WVPASSEQ(newsocks[0], oldfd);
+    ::write(newsocks[1], "y", 1);
+    si = want;
+    si.msec_timeout = 1000;
+    WVPASSEQ(p->poll(si), 1);
+    WVPASS(FD_ISSET(oldfd, &si.read));
+
+    // and the old socket isn't being kept open anymore
+    char buf[1];
+    WVPASSEQ(recv(socks[0][1], buf, sizeof(buf), MSG_DONTWAIT), 0);
+
+    delete p;
+    ::close(newsocks[0]);
+    ::close(newsocks[1]);
+    ::close(socks[0][1]);
+    for (int i = 1; i < count; i++)
+    {
+	::close(socks[i][0]);
+	::close(socks[i][1]);
+    }
+}
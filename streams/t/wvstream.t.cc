@@ -187,6 +187,44 @@ WVTEST_MAIN("getline")
 #endif 
 }
 
+WVTEST_MAIN("getline with trickling input")
+{
+    WvStream s;
+    WvDynBuf buf;
+    
+    // each getline() only looks at what's new, but still finds the line
+    s.inbuf_putstr("abc");
+    WVFAIL(s.getline());
+    s.inbuf_putstr("def");
+    WVFAIL(s.getline());
+    s.inbuf_putstr("g\nh");
+    WVPASSEQ(s.getline(), "abcdefg");
+    WVFAIL(s.getline());
+    s.inbuf_putstr("\n");
+    WVPASSEQ(s.getline(), "h");
+    
+    // a different separator means looking at everything again
+    s.inbuf_putstr("x;y");
+    WVFAIL(s.getline());
+    WVPASSEQ(s.getline(0, ';'), "x");
+    
+    // so does anything that changes the front of the buffer
+    WVFAIL(s.getline());
+    buf.putstr("u\n");
+    s.unread(buf, 2);
+    WVPASSEQ(s.getline(), "u");
+    char c;
+    WVPASSEQ(s.read(&c, 1), 1);
+    WVPASSEQ(c, 'y');
+    s.inbuf_putstr("pq");
+    WVFAIL(s.getline());
+    s.queuemin(0); // a failed getline() leaves it waiting for more
+    WVPASSEQ(s.read(&c, 1), 1);
+    s.inbuf_putstr("\n");
+    WVPASSEQ(s.getline(), "q");
+}
+
+
 // more noread/nowrite behaviour
 WVTEST_MAIN("more noread/nowrite")
 {
@@ -659,6 +697,53 @@ WVTEST_MAIN("alarm")
 }
 
 
+WVTEST_MAIN("next_alarm")
+{
+    const int count = 20;
+    WvStream *s[count];
+    
+    WVPASSEQ(WvStream::next_alarm(), -1);
+    for (int i = 0; i < count; i++)
+    {
+	s[i] = new WvStream;
+	s[i]->alarm(100000 + ((i * 7) % count) * 1000);
+    }
+    WVPASS(WvStream::next_alarm() > 99000);
+    WVPASS(WvStream::next_alarm() <= 100000);
+    
+    // re-arming and cancelling keep the earliest one at the front
+    s[4]->alarm(5000);
+    WVPASS(WvStream::next_alarm() > 4000);
+    WVPASS(WvStream::next_alarm() <= 5000);
+    s[9]->alarm(50000);
+    s[4]->alarm(-1);
+    WVPASS(WvStream::next_alarm() > 49000);
+    WVPASS(WvStream::next_alarm() <= 50000);
+    WVRELEASE(s[9]);
+    WVPASS(WvStream::next_alarm() > 99000);
+    
+    // alarms that have already gone off don't count
+    s[2]->alarm(0);
+    s[3]->alarm(0);
+    WVPASS(WvStream::next_alarm() > 99000);
+    WVPASS(WvStream::next_alarm() <= 100000);
+    
+    // time going backward doesn't make anyone wait longer
+    WvTime now = wvstime();
+    time_t before = s[0]->alarm_remaining();
+    wvstime_set(msecadd(now, -60000));
+    WVPASSEQ(s[0]->alarm_remaining(), before);
+    wvstime_set(now);
+    WVPASSEQ(s[0]->alarm_remaining(), before - 60000);
+    wvstime_sync();
+    
+    for (int i = 0; i < count; i++)
+	if (i != 9)
+	    WVRELEASE(s[i]);
+    WVPASSEQ(WvStream::next_alarm(), -1);
+}
+
+
 static int rn = 0;
 
 
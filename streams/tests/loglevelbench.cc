@@ -0,0 +1,36 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Measures how much a log message costs when no receiver wants its level,
+ * compared to one that actually gets written somewhere.
+ */
+#include "wvlogbuffer.h"
+#include "wvtimeutils.h"
+#include <stdio.h>
+
+static const int count = 5000000;
+
+
+static double nsec_per_call(WvLog &log, WvLog::LogLevel lvl,
+			    WvStringParm arg, int n)
+{
+    WvTime start = wvtime();
+    for (int i = 0; i < n; i++)
+	log(lvl, "message %s from %s\n", arg, "loglevelbench");
+    return msecdiff(wvtime(), start) * 1000000.0 / n;
+}
+
+
+int main()
+{
+    WvLogBuffer buf(10, WvLog::Info);
+    WvLog log("bench", WvLog::Info);
+    WvString arg("number one");
+
+    printf("disabled (Debug5): %8.1f ns/call\n",
+	   nsec_per_call(log, WvLog::Debug5, arg, count));
+    printf("enabled (Info):    %8.1f ns/call\n",
+	   nsec_per_call(log, WvLog::Info, arg, count / 50));
+    return 0;
+}
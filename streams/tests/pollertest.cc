@@ -0,0 +1,102 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * WvPoller benchmark.  Puts a growing number of idle streams into a
+ * WvIStreamList along with one busy one, and measures how long each trip
+ * around the main loop takes with each of the poller backends.
+ */
+#include "wvpoller.h"
+#include "wvfdstream.h"
+#include "wvistreamlist.h"
+#include "wvsocketpair.h"
+#include "wvtimeutils.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+static const char *backends[] = { "select", "poll", "epoll", "uring", NULL };
+static const int sizes[] = { 10, 100, 250, 500, 0 };
+static const int rounds = 2000;
+
+
+static void ping(WvFdStream *s, WvFdStream *peer, int *count)
+{
+    char buf[16];
+    s->read(buf, sizeof(buf));
+    (*count)++;
+    peer->write("x", 1);
+}
+
+
+static double run(const char *backend, int idle)
+{
+    WvIStreamList l;
+    WvFdStream **far = new WvFdStream*[idle];
+
+    for (int i = 0; i < idle; i++)
+    {
+	int socks[2];
+	if (wvsocketpair(SOCK_STREAM, socks))
+	{
+	    perror("socketpair");
+	    return -1;
+	}
+	l.append(new WvFdStream(socks[0]), true, "idle");
+	far[i] = new WvFdStream(socks[1]);
+    }
+
+    // one busy stream that bounces a byte back to itself every round
+    int socks[2];
+    wvsocketpair(SOCK_STREAM, socks);
+    WvFdStream *busy = new WvFdStream(socks[0]);
+    WvFdStream *peer = new WvFdStream(socks[1]);
+    int count = 0;
+    busy->setcallback(wv::bind(ping, busy, peer, &count));
+    l.append(busy, true, "busy");
+    peer->write("x", 1);
+
+    WvPoller::use(backend);
+    WvTime start = wvtime();
+    while (count < rounds)
+	l.runonce(1000);
+    time_t elapsed = msecdiff(wvtime(), start);
+
+    delete peer;
+    for (int i = 0; i < idle; i++)
+	delete far[i];
+    delete[] far;
+
+    return elapsed * 1000.0 / rounds;
+}
+
+
+int main()
+{
+    // each idle stream costs two fds
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    printf("%10s", "idle");
+    for (int b = 0; backends[b]; b++)
+	printf("%12s", backends[b]);
+    printf("   (usec per wakeup)\n");
+
+    for (int n = 0; sizes[n]; n++)
+    {
+	printf("%10d", sizes[n]);
+	for (int b = 0; backends[b]; b++)
+	{
+	    if (!WvPoller::use(backends[b]))
+		printf("%12s", "n/a");
+	    else
+		printf("%12.1f", run(backends[b], sizes[n]));
+	    fflush(stdout);
+	}
+	printf("\n");
+    }
+
+    return 0;
+}
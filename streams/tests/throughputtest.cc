@@ -0,0 +1,108 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Bulk throughput benchmark for the WvPoller backends.  Pushes data
+ * through a number of WvSocketPair connections at once, all driven from
+ * one WvIStreamList, and reports how fast it all got through.
+ */
+#include "wvpoller.h"
+#include "wvfdstream.h"
+#include "wvistreamlist.h"
+#include "wvsocketpair.h"
+#include "wvtimeutils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+static const char *backends[] = { "select", "poll", "epoll", "uring", NULL };
+static const int sizes[] = { 1, 8, 64, 256, 0 };
+static const size_t total = 512 * 1024 * 1024;
+static const size_t chunk = 16 * 1024;
+
+static char buf[chunk];
+
+
+static void sender(WvFdStream *s, size_t *left)
+{
+    if (!*left)
+    {
+	s->undo_force_select(false, true);
+	return;
+    }
+    size_t len = s->uwrite(buf, *left < chunk ? *left : chunk);
+    *left -= len;
+}
+
+
+static void receiver(WvFdStream *s, size_t *got)
+{
+    char in[chunk];
+    *got += s->uread(in, sizeof(in));
+}
+
+
+static double run(const char *backend, int pairs)
+{
+    WvIStreamList l;
+    size_t *left = new size_t[pairs];
+    size_t got = 0;
+
+    for (int i = 0; i < pairs; i++)
+    {
+	int socks[2];
+	if (wvsocketpair(SOCK_STREAM, socks))
+	{
+	    perror("socketpair");
+	    exit(1);
+	}
+	WvFdStream *out = new WvFdStream(socks[0]);
+	WvFdStream *in = new WvFdStream(socks[1]);
+	left[i] = total / pairs;
+	out->setcallback(wv::bind(sender, out, &left[i]));
+	out->force_select(false, true);
+	in->setcallback(wv::bind(receiver, in, &got));
+	l.append(out, true, "sender");
+	l.append(in, true, "receiver");
+    }
+
+    WvPoller::use(backend);
+    WvTime start = wvtime();
+    while (got < (total / pairs) * pairs)
+	l.runonce(1000);
+    time_t elapsed = msecdiff(wvtime(), start);
+
+    delete[] left;
+    return elapsed ? (got / 1048576.0) / (elapsed / 1000.0) : 0;
+}
+
+
+int main()
+{
+    // each pair costs two fds
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    printf("%10s", "pairs");
+    for (int b = 0; backends[b]; b++)
+	printf("%12s", backends[b]);
+    printf("   (MB/sec)\n");
+
+    for (int n = 0; sizes[n]; n++)
+    {
+	printf("%10d", sizes[n]);
+	for (int b = 0; backends[b]; b++)
+	{
+	    if (!WvPoller::use(backends[b]))
+		printf("%12s", "n/a");
+	    else
+		printf("%12.1f", run(backends[b], sizes[n]));
+	    fflush(stdout);
+	}
+	printf("\n");
+    }
+
+    return 0;
+}
@@ -6,10 +6,20 @@
  */
 #include "wvfdstream.h"
 #include "wvmoniker.h"
+#include "wvpoller.h"
+#include "wvautoconf.h"
 #include <fcntl.h>
 
+#ifdef HAVE_SPLICE
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
 #ifndef _WIN32
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 inline bool isselectable(int fd)
 {
@@ -55,6 +65,7 @@ WvFdStream::WvFdStream(int _rwfd)
     : rfd(_rwfd), wfd(_rwfd)
 {
     shutdown_read = shutdown_write = false;
+    splice_fds[0] = splice_fds[1] = -1;
 }
 
 
@@ -62,6 +73,7 @@ WvFdStream::WvFdStream(int _rfd, int _wfd)
     : rfd(_rfd), wfd(_wfd)
 {
     shutdown_read = shutdown_write = false;
+    splice_fds[0] = splice_fds[1] = -1;
 }
 
 
@@ -122,12 +134,24 @@ void WvFdStream::close()
 	WvStream::close();
 	//fprintf(stderr, "closing%d:%d/%d\n", (int)this, rfd, wfd);
 	if (rfd >= 0)
+	{
+	    WvPoller::forget_fd(rfd);
 	    ::close(rfd);
+	}
 	if (wfd >= 0 && wfd != rfd)
+	{
+	    WvPoller::forget_fd(wfd);
 	    ::close(wfd);
+	}
 	rfd = wfd = -1;
 	//fprintf(stderr, "closed!\n");
     }
+    if (splice_fds[0] >= 0)
+    {
+	::close(splice_fds[0]);
+	::close(splice_fds[1]);
+	splice_fds[0] = splice_fds[1] = -1;
+    }
 }
 
 
@@ -183,6 +207,140 @@ size_t WvFdStream::uwrite(const void *buf, size_t count)
 }
 
 
+// the most buffer chunks we'll hand to a single writev()
+#define MAX_WRITEV_CHUNKS 64
+
+size_t WvFdStream::uwritebuf(WvBuf &buf, size_t count)
+{
+#ifdef _WIN32
+    return WvStream::uwritebuf(buf, count);
+#else
+    if (!count || !isok()) return 0;
+    if (typeid(*this) != writev_type())
+	return WvStream::uwritebuf(buf, count); // uwrite() might be overridden
+    
+    // point at each chunk of buf in place, rather than copying them
+    struct iovec iov[MAX_WRITEV_CHUNKS];
+    int chunks = 0;
+    size_t total = 0;
+    while (total < count && chunks < MAX_WRITEV_CHUNKS)
+    {
+	size_t len = buf.optpeekable(total);
+	if (!len)
+	    break;
+	if (len > count - total)
+	    len = count - total;
+	iov[chunks].iov_base = (void *)buf.peek(total, len);
+	iov[chunks].iov_len = len;
+	chunks++;
+	total += len;
+    }
+    if (chunks <= 1)
+	return WvStream::uwritebuf(buf, count);
+    
+    int out = ::writev(wfd, iov, chunks);
+    
+    if (out <= 0)
+    {
+	int err = errno;
+	if (out < 0 && (err == ENOBUFS || err==EAGAIN))
+	    return 0; // kernel buffer full - data not written (yet!)
+    
+	seterr(out < 0 ? err : 0); // a more critical error
+	return 0;
+    }
+
+    buf.skip(out);
+    return out;
+#endif
+}
+
+
+int WvFdStream::uwrite_fd()
+{
+    // anything still in outbuf has to go out first
+    if (outbuf.used() || !isok())
+	return -1;
+    if (typeid(*this) != forward_type())
+	return -1; // uwrite() might be overridden
+    return wfd;
+}
+
+
+int WvFdStream::uforward(int out_fd, WvStream &out, size_t count)
+{
+#ifdef HAVE_SPLICE
+    if (inbuf.used() || rfd < 0 || !count || !isok())
+	return -1;
+    if (typeid(*this) != forward_type())
+	return -1; // uread() might be overridden
+    
+#ifdef HAVE_SYS_SENDFILE_H
+    // a regular file can go straight to the output with sendfile()
+    struct stat st;
+    if (fstat(rfd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+	int len = ::sendfile(out_fd, rfd, NULL, count);
+	if (len > 0)
+	    return len;
+	if (len < 0 && (errno == EAGAIN || errno == EINTR))
+	    return 0;
+	return -1; // let read() deal with the end of file, or the error
+    }
+#endif
+    
+    // anything else has to go through a pipe, since splice() needs a pipe
+    // at one end.  The pipe is always empty between calls.
+    if (splice_fds[0] < 0)
+    {
+	if (pipe(splice_fds))
+	{
+	    splice_fds[0] = splice_fds[1] = -1;
+	    return -1;
+	}
+	_cloexec(splice_fds[0], true);
+	_cloexec(splice_fds[1], true);
+    }
+    
+    int in = ::splice(rfd, NULL, splice_fds[1], NULL, count,
+		      SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (in <= 0)
+    {
+	if (in < 0 && (errno == EAGAIN || errno == EINTR))
+	    return 0;
+	return -1; // the end of file, or a kind of fd splice() can't do
+    }
+    
+    int done = 0;
+    while (done < in)
+    {
+	int len = ::splice(splice_fds[0], NULL, out_fd, NULL, in - done,
+			   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (len <= 0)
+	    break;
+	done += len;
+    }
+    
+    // the output is full (or broken), so whatever it didn't take goes
+    // through its outbuf instead
+    char buf[4096];
+    while (done < in)
+    {
+	int len = ::read(splice_fds[0], buf,
+			 in - done < (int)sizeof(buf) ? in - done : sizeof(buf));
+	if (len <= 0)
+	    break;
+	out.write(buf, len);
+	done += len;
+    }
+    
+    return in;
+#else
+    return -1;
+#endif
+}
+
+
 void WvFdStream::maybe_autoclose()
 {
     if (stop_write && !shutdown_write && !outbuf.used())
@@ -191,20 +349,28 @@ void WvFdStream::maybe_autoclose()
 	if (wfd < 0)
 	    return;
 	if (rfd != wfd)
+	{
+	    WvPoller::forget_fd(wfd);
 	    ::close(wfd);
+	}
 	else
 	    ::shutdown(wfd, SHUT_WR); // might be a socket        
 	wfd = -1;
+	select_changed();
     }
     
     if (stop_read && !shutdown_read && !inbuf.used())
     {
 	shutdown_read = true;
         if (rfd != wfd)
+        {
+            WvPoller::forget_fd(rfd);
             ::close(rfd);
+        }
         else
             ::shutdown(rfd, SHUT_RD); // might be a socket
         rfd = -1;
+	select_changed();
     }
     
     WvStream::maybe_autoclose();
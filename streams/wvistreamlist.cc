@@ -12,6 +12,8 @@
 
 #include "wvassert.h"
 #include "wvstrutils.h"
+#include <string.h>
+#include <stdint.h>
 
 #ifndef _WIN32
 #include "wvfork.h"
@@ -39,11 +41,26 @@
 WvIStreamList WvIStreamList::globallist;
 
 
+WvEmbeddedLink *WvIStreamListBase::streamlink(void *data)
+{
+    WvStream *s = dynamic_cast<WvStream *>((IWvStream *)data);
+    return (s && s->listlink.available()) ? &s->listlink : NULL;
+}
+
+
 WvIStreamList::WvIStreamList():
+    child_selects_si(NULL), child_selects_gen(0), nquiet_timed(0),
+    quiet_wants(false, false, false), awake_gen(0), awake_stale(true),
     in_select(false), dead_stream(false)
 {
     readcb = writecb = exceptcb = 0;
     auto_prune = true;
+#ifndef _WIN32
+    FD_ZERO(&quiet_read);
+    FD_ZERO(&quiet_write);
+    FD_ZERO(&quiet_except);
+    quiet_max_fd = -1;
+#endif
     if (this == &globallist)
     {
 	globalstream = this;
@@ -59,6 +76,10 @@ WvIStreamList::WvIStreamList():
 WvIStreamList::~WvIStreamList()
 {
     close();
+    
+    // nobody should be telling us about changes anymore
+    wake_all(false);
+    clear_pending();
 }
 
 
@@ -86,6 +107,379 @@ private:
 };
 
 
+#ifndef _WIN32
+// fd_sets are bitmaps made of words no bigger than 8 bytes, so the bits for
+// fds 64*n through 64*n+63 always live in bytes 8*n through 8*n+7.  That
+// lets us skip over big empty stretches without testing every fd.
+static inline uint64_t fd_chunk(const fd_set &set, int chunk)
+{
+    uint64_t w;
+    memcpy(&w, (const char *)&set + chunk * 8, sizeof(w));
+    return w;
+}
+
+
+static inline void fd_chunk_or(fd_set &set, int chunk, uint64_t bits)
+{
+    uint64_t w = fd_chunk(set, chunk) | bits;
+    memcpy((char *)&set + chunk * 8, &w, sizeof(w));
+}
+
+
+// Move one fd from a child's scratch SelectInfo into the real one.
+void WvIStreamList::move_fd(int fd, SelectInfo &si, SelectInfo &csi)
+{
+    unsigned char rwx = 0;
+    if (FD_ISSET(fd, &csi.read))
+    {
+	rwx |= READ_BIT;
+	FD_SET(fd, &si.read);
+	FD_CLR(fd, &csi.read);
+    }
+    if (FD_ISSET(fd, &csi.write))
+    {
+	rwx |= WRITE_BIT;
+	FD_SET(fd, &si.write);
+	FD_CLR(fd, &csi.write);
+    }
+    if (FD_ISSET(fd, &csi.except))
+    {
+	rwx |= EXCEPT_BIT;
+	FD_SET(fd, &si.except);
+	FD_CLR(fd, &csi.except);
+    }
+    if (rwx)
+    {
+	ChildFd f = { fd, rwx };
+	child_fds.push_back(f);
+    }
+}
+
+
+// Add the quiet children's fds to the real SelectInfo.
+void WvIStreamList::merge_quiet(SelectInfo &si)
+{
+    for (int chunk = 0; chunk * 64 <= quiet_max_fd; chunk++)
+    {
+	fd_chunk_or(si.read, chunk, fd_chunk(quiet_read, chunk));
+	fd_chunk_or(si.write, chunk, fd_chunk(quiet_write, chunk));
+	fd_chunk_or(si.except, chunk, fd_chunk(quiet_except, chunk));
+    }
+    if (si.max_fd < quiet_max_fd)
+	si.max_fd = quiet_max_fd;
+}
+
+
+// Wake up the quiet children whose fds came back ready.
+void WvIStreamList::wake_ready(const SelectInfo &si)
+{
+    std::vector<WvStream *> ready;
+    for (int chunk = 0; chunk * 64 <= quiet_max_fd; chunk++)
+    {
+	uint64_t w = (fd_chunk(si.read, chunk) & fd_chunk(quiet_read, chunk))
+	    | (fd_chunk(si.write, chunk) & fd_chunk(quiet_write, chunk))
+	    | (fd_chunk(si.except, chunk) & fd_chunk(quiet_except, chunk));
+	if (!w)
+	    continue;
+	for (int fd = chunk * 64; fd < chunk * 64 + 64 && fd <= quiet_max_fd;
+	     fd++)
+	{
+	    WvStream *s = quiet_owner[fd];
+	    if (s && ((FD_ISSET(fd, &si.read) && FD_ISSET(fd, &quiet_read))
+		      || (FD_ISSET(fd, &si.write) && FD_ISSET(fd, &quiet_write))
+		      || (FD_ISSET(fd, &si.except)
+			  && FD_ISSET(fd, &quiet_except))))
+		ready.push_back(s);
+	}
+    }
+    for (size_t k = 0; k < ready.size(); k++)
+	wake(ready[k], true);
+}
+#endif
+
+
+// Put the list's links back in 'awake', minus the quiet children, and
+// forget about quiet children that aren't in the list anymore.
+void WvIStreamList::rebuild_awake()
+{
+    std::vector<WvStream *> gone;
+    QuietMap::iterator q;
+    for (q = quiet.begin(); q != quiet.end(); ++q)
+	if (!child_is_member(q->first))
+	    gone.push_back(q->first);
+    for (size_t k = 0; k < gone.size(); k++)
+	wake(gone[k], false);
+    
+    awake.clear();
+    for (WvLink *link = head.next; link; link = link->next)
+    {
+	// in this list, an embedded link is always some WvStream's listlink
+	AwakeChild a = { link, link->is_embedded()
+		? static_cast<WvStream *>((IWvStream *)link->data) : NULL };
+	if (!a.ws || quiet.find(a.ws) == quiet.end())
+	    awake.push_back(a);
+    }
+    awake_gen = generation;
+    awake_stale = false;
+}
+
+
+// Run pre_select() for one child with an empty scratch SelectInfo, then
+// merge the result into the real one, remembering what the child wanted.
+void WvIStreamList::child_pre_select(size_t k, SelectInfo &si,
+				     SelectInfo &csi)
+{
+    // not a reference: if pre_select() wakes anyone, 'awake' grows
+    AwakeChild a = awake[k];
+    IWvStream &s(*(IWvStream *)a.link->data);
+    
+    csi.wants = si.wants;
+    csi.max_fd = -1;
+    csi.msec_timeout = -1;
+    csi.inherit_request = si.inherit_request;
+    csi.global_sure = si.global_sure;
+    
+    s.pre_select(csi);
+    
+    ChildSelect c;
+    c.s = &s;
+    c.ws = a.ws;
+    c.id = a.link->id;
+    c.awake_index = k;
+    c.msec_timeout = csi.msec_timeout;
+    c.firstfd = child_fds.size();
+#ifndef _WIN32
+    c.known_fds = csi.max_fd < FD_SETSIZE;
+    
+    // almost every stream only selects on its own fds, so check those
+    // first; then the scan below usually finds nothing left over.
+    int rfd = s.getrfd(), wfd = s.getwfd();
+    if (rfd >= 0 && rfd <= csi.max_fd)
+	move_fd(rfd, si, csi);
+    if (wfd >= 0 && wfd != rfd && wfd <= csi.max_fd)
+	move_fd(wfd, si, csi);
+    
+    for (int chunk = 0; chunk * 64 <= csi.max_fd && chunk * 64 < FD_SETSIZE;
+	 chunk++)
+    {
+	if (!fd_chunk(csi.read, chunk) && !fd_chunk(csi.write, chunk)
+	    && !fd_chunk(csi.except, chunk))
+	    continue;
+	for (int fd = chunk * 64; fd < chunk * 64 + 64 && fd <= csi.max_fd;
+	     fd++)
+	    move_fd(fd, si, csi);
+    }
+#else
+    // win32 fd_sets are lists, not bitmaps; just merge them and never skip.
+    c.known_fds = false;
+    for (u_int k = 0; k < csi.read.fd_count; k++)
+	FD_SET(csi.read.fd_array[k], &si.read);
+    for (u_int k = 0; k < csi.write.fd_count; k++)
+	FD_SET(csi.write.fd_array[k], &si.write);
+    for (u_int k = 0; k < csi.except.fd_count; k++)
+	FD_SET(csi.except.fd_array[k], &si.except);
+    FD_ZERO(&csi.read);
+    FD_ZERO(&csi.write);
+    FD_ZERO(&csi.except);
+#endif
+    c.nfds = child_fds.size() - c.firstfd;
+    
+    // if it turns out to be idle, it can go quiet; start listening for
+    // changes now, so we know if the fds we just got go stale.
+    c.candidate = a.ws && !a.ws->select_watcher && !si.inherit_request
+	&& csi.msec_timeout != 0 && c.known_fds && c.nfds <= 2
+	&& a.ws->select_is_cacheable();
+    if (c.candidate)
+    {
+	a.ws->select_watcher = this;
+	pending.push_back(a.ws);
+    }
+    child_selects.push_back(c);
+    
+    if (si.max_fd < csi.max_fd)
+	si.max_fd = csi.max_fd;
+    if (csi.msec_timeout >= 0
+      && (csi.msec_timeout < si.msec_timeout || si.msec_timeout < 0))
+	si.msec_timeout = csi.msec_timeout;
+}
+
+
+bool WvIStreamList::child_maybe_ready(const ChildSelect &c,
+				      const std::vector<ChildFd> &fds,
+				      const SelectInfo &si) const
+{
+    if (!c.known_fds)
+	return true;
+    if (c.msec_timeout >= 0)
+    {
+	// if the child's alarm was going to go off before any other timeout
+	// it wanted, we can find out whether it's due straight from the alarm.
+	if (!c.ws || !c.msec_timeout)
+	    return true;
+	time_t alarmleft = c.ws->alarm_remaining();
+	if (alarmleft <= 0 || alarmleft
+	    + msecdiff(wvstime(), child_selects_time) > c.msec_timeout)
+	    return true;
+    }
+    for (size_t k = c.firstfd; k < c.firstfd + c.nfds; k++)
+    {
+	int fd = fds[k].fd;
+	if (FD_ISSET(fd, &si.read) || FD_ISSET(fd, &si.write)
+	    || FD_ISSET(fd, &si.except))
+	    return true;
+    }
+    return false;
+}
+
+
+// An idle candidate goes quiet, if nothing has changed since its
+// pre_select() and it doesn't share an fd with another quiet child.
+bool WvIStreamList::go_quiet(const ChildSelect &c,
+			     const std::vector<ChildFd> &fds)
+{
+#ifndef _WIN32
+    WvStream *ws = c.ws;
+    if (ws->select_watcher != this || !ws->select_is_cacheable())
+	return false;
+    for (size_t k = c.firstfd; k < c.firstfd + c.nfds; k++)
+	if (fds[k].fd < (int)quiet_owner.size() && quiet_owner[fds[k].fd])
+	    return false;
+    
+    QuietChild q;
+    q.fds[0] = q.fds[1] = -1;
+    q.rwx[0] = q.rwx[1] = 0;
+    for (size_t k = 0; k < c.nfds; k++)
+    {
+	const ChildFd &f = fds[c.firstfd + k];
+	q.fds[k] = f.fd;
+	q.rwx[k] = f.rwx;
+	if (f.fd >= (int)quiet_owner.size())
+	    quiet_owner.resize(f.fd + 1);
+	quiet_owner[f.fd] = ws;
+	if (f.rwx & READ_BIT)
+	    FD_SET(f.fd, &quiet_read);
+	if (f.rwx & WRITE_BIT)
+	    FD_SET(f.fd, &quiet_write);
+	if (f.rwx & EXCEPT_BIT)
+	    FD_SET(f.fd, &quiet_except);
+	if (quiet_max_fd < f.fd)
+	    quiet_max_fd = f.fd;
+    }
+    q.timed = c.msec_timeout > 0;
+    if (q.timed)
+	nquiet_timed++;
+    quiet[ws] = q;
+    
+    if (!awake_stale && c.awake_index < awake.size()
+	&& awake[c.awake_index].ws == ws)
+	awake[c.awake_index].link = NULL; // compacted away in post_select()
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+// A quiet child goes back to being an ordinary one.  If 'requeue', and it's
+// still in the list, it goes into 'awake' and 'woken' too.
+void WvIStreamList::wake(WvStream *s, bool requeue)
+{
+    QuietMap::iterator q = quiet.find(s);
+    if (q == quiet.end())
+	return;
+#ifndef _WIN32
+    for (int k = 0; k < 2; k++)
+    {
+	int fd = q->second.fds[k];
+	if (fd < 0)
+	    continue;
+	FD_CLR(fd, &quiet_read);
+	FD_CLR(fd, &quiet_write);
+	FD_CLR(fd, &quiet_except);
+	quiet_owner[fd] = NULL;
+    }
+#endif
+    if (q->second.timed)
+	nquiet_timed--;
+    quiet.erase(q);
+    s->select_watcher = NULL;
+#ifndef _WIN32
+    if (quiet.empty())
+	quiet_max_fd = -1;
+#endif
+    
+    if (requeue && child_is_member(s))
+    {
+	AwakeChild a = { &s->listlink, s };
+	awake.push_back(a);
+	woken.push_back(s);
+    }
+}
+
+
+void WvIStreamList::wake_all(bool requeue)
+{
+    while (!quiet.empty())
+	wake(quiet.begin()->first, requeue);
+}
+
+
+void WvIStreamList::forget_pending(WvStream *s)
+{
+    for (size_t k = 0; k < pending.size(); k++)
+    {
+	if (pending[k] == s)
+	{
+	    pending[k] = pending.back();
+	    pending.pop_back();
+	    break;
+	}
+    }
+    s->select_watcher = NULL;
+}
+
+
+// Whoever didn't go quiet after all doesn't need watching.
+void WvIStreamList::clear_pending()
+{
+    for (size_t k = 0; k < pending.size(); k++)
+    {
+	WvStream *ws = pending[k];
+	if (ws->select_watcher == this && quiet.find(ws) == quiet.end())
+	    ws->select_watcher = NULL;
+    }
+    pending.clear();
+}
+
+
+void WvIStreamList::watched_select_changed(WvStream *s)
+{
+    if (quiet.find(s) != quiet.end())
+	wake(s, true);
+    else
+	forget_pending(s);
+}
+
+
+void WvIStreamList::watched_destroyed(WvStream *s)
+{
+    if (quiet.find(s) != quiet.end())
+	wake(s, false);
+    else
+	forget_pending(s);
+}
+
+
+bool WvIStreamList::add_sure(IWvStream *s, const char *id)
+{
+    if (!sure_set.insert(s).second)
+	return false; // don't add it twice!
+    s->addRef();
+    sure_thing.append(s, true, id);
+    return true;
+}
+
+
 void WvIStreamList::pre_select(SelectInfo &si)
 {
     //BoolGuard guard(in_select);
@@ -93,6 +487,44 @@ void WvIStreamList::pre_select(SelectInfo &si)
     SelectRequest oldwant = si.wants;
     
     sure_thing.zap();
+    sure_set.clear();
+    child_selects.clear();
+    child_fds.clear();
+    
+    // in case the last pre_select() never got its post_select()
+    clear_pending();
+    
+    // the quiet fds were for one particular request.  With
+    // inherit_request, children don't add their own wants, so any request
+    // that's no bigger is fine; otherwise it has to be the same one.
+    if (!quiet.empty()
+	&& ((oldwant.readable && !quiet_wants.readable)
+	    || (oldwant.writable && !quiet_wants.writable)
+	    || (oldwant.isexception && !quiet_wants.isexception)
+	    || (!si.inherit_request
+		&& (oldwant.readable != quiet_wants.readable
+		    || oldwant.writable != quiet_wants.writable
+		    || oldwant.isexception != quiet_wants.isexception))))
+	wake_all(true);
+    if (quiet.empty() && !si.inherit_request)
+	quiet_wants = oldwant;
+    
+    if (nquiet_timed)
+    {
+	// this also wakes up anyone whose alarm has gone off.  Like
+	// WvStream::pre_select(), leave a little slack so that it really
+	// has gone off by the time we look.
+	time_t next = WvStream::next_alarm();
+	if (next >= 0 && (next + 10 < si.msec_timeout || si.msec_timeout < 0))
+	    si.msec_timeout = next + 10;
+    }
+    
+    if (awake_stale || awake_gen != generation)
+	rebuild_awake();
+    woken.clear();
+    child_selects_si = &si;
+    child_selects_gen = generation;
+    child_selects_time = wvstime();
     
     time_t alarmleft = alarm_remaining();
     if (alarmleft == 0)
@@ -103,26 +535,48 @@ void WvIStreamList::pre_select(SelectInfo &si)
     WvCrashInfo::InStreamState old_in_stream_state = WvCrashInfo::in_stream_state;
     WvCrashInfo::in_stream_state = WvCrashInfo::PRE_SELECT;
 
-    Iter i(*this);
-    for (i.rewind(); i.next(); )
+    SelectInfo csi;
+    FD_ZERO(&csi.read);
+    FD_ZERO(&csi.write);
+    FD_ZERO(&csi.except);
+    
+    // children that wake up meanwhile get added to the end, so look at
+    // awake.size() every time.
+    for (size_t k = 0; k < awake.size(); k++)
     {
-	IWvStream &s(*i);
+	if (!awake[k].link)
+	    continue;
+	if (generation != child_selects_gen)
+	{
+	    // someone changed the list under us; post_select() will have to
+	    // look at everything, so don't make it wait.
+	    child_selects_si = NULL;
+	    awake_stale = true;
+	    si.msec_timeout = 0;
+	    break;
+	}
+	
+	IWvStream &s(*(IWvStream *)awake[k].link->data);
 #if I_ENJOY_FORMATTING_STRINGS
 	WvCrashWill will("doing pre_select for \"%s\" (%s)\n%s",
-			 i.link->id, ptr2str(&s), wvcrash_read_will());
+			 awake[k].link->id, ptr2str(&s), wvcrash_read_will());
 #else
 	WvCrashInfo::in_stream = &s;
-	WvCrashInfo::in_stream_id = i.link->id;
+	WvCrashInfo::in_stream_id = awake[k].link->id;
 #endif
 	si.wants = oldwant;
-	s.pre_select(si);
+	child_pre_select(k, si, csi);
 	
 	if (!s.isok())
 	    already_sure = true;
 
 	TRACE("after pre_select(%s): msec_timeout is %ld\n",
-	      i.link->id, (long)si.msec_timeout);
+	      child_selects.back().id, (long)si.msec_timeout);
     }
+    
+#ifndef _WIN32
+    merge_quiet(si);
+#endif
 
     WvCrashInfo::in_stream = old_in_stream;
     WvCrashInfo::in_stream_id = old_in_stream_id;
@@ -138,6 +592,69 @@ void WvIStreamList::pre_select(SelectInfo &si)
 }
 
 
+// post_select() one child, and add it to sure_thing if it's ready.
+// Returns false if the stream is dead.
+bool WvIStreamList::child_post_select(IWvStream &s, const char *id,
+				      SelectInfo &si,
+				      const SelectRequest &oldwant)
+{
+#if I_ENJOY_FORMATTING_STRINGS
+    WvCrashWill will("doing post_select for \"%s\" (%s)\n%s",
+		     id, ptr2str(&s), wvcrash_read_will());
+#else
+    WvCrashInfo::in_stream = &s;
+    WvCrashInfo::in_stream_id = id;
+#endif
+
+    si.wants = oldwant;
+    if (s.post_select(si))
+    {
+	TRACE("post_select(%s) was true\n", id);
+	add_sure(&s, id);
+    }
+    else
+    {
+	TRACE("post_select(%s) was false\n", id);
+	wvassert(sure_set.find(&s) == sure_set.end(),
+		 "stream \"%s\" (%s) was ready in "
+		 "pre_select, but not in post_select",
+		 id, ptr2str(&s));
+    }
+    return s.isok();
+}
+
+
+// The slow way: post_select() every child that isn't in 'done'.
+void WvIStreamList::full_post_select(SelectInfo &si,
+				     const SelectRequest &oldwant,
+				     const std::set<IWvStream *> &done,
+				     bool &already_sure)
+{
+    Iter i(*this);
+    for (i.rewind(); i.cur() && i.next(); )
+    {
+	IWvStream &s(*i);
+	if (done.find(&s) != done.end())
+	    continue;
+	if (!child_post_select(s, i.link->id, si, oldwant))
+	{
+	    already_sure = true;
+	    if (auto_prune)
+		i.xunlink();
+	}
+    }
+}
+
+
+// Remove a dead child from the list, the way full_post_select() does.
+void WvIStreamList::prune(IWvStream *s)
+{
+    Iter i(*this);
+    if (i.find(s))
+	i.xunlink();
+}
+
+
 bool WvIStreamList::post_select(SelectInfo &si)
 {
     //BoolGuard guard(in_select);
@@ -153,45 +670,115 @@ bool WvIStreamList::post_select(SelectInfo &si)
     WvCrashInfo::InStreamState old_in_stream_state = WvCrashInfo::in_stream_state;
     WvCrashInfo::in_stream_state = WvCrashInfo::POST_SELECT;
 
-    Iter i(*this);
-    for (i.rewind(); i.cur() && i.next(); )
-    {
-	IWvStream &s(*i);
-#if I_ENJOY_FORMATTING_STRINGS
-	WvCrashWill will("doing post_select for \"%s\" (%s)\n%s",
-			 i.link->id, ptr2str(&s), wvcrash_read_will());
-#else
-	WvCrashInfo::in_stream = &s;
-	WvCrashInfo::in_stream_id = i.link->id;
+    // take these, in case a child's post_select() ends up in our
+    // pre_select() again.
+    std::vector<ChildSelect> cs;
+    std::vector<ChildFd> cfds;
+    cs.swap(child_selects);
+    cfds.swap(child_fds);
+    
+    // only trust what pre_select() recorded if it was for this same select,
+    // and only for as long as the list hasn't changed underneath us.
+    unsigned gen = generation;
+    bool fallback = (child_selects_si != &si || child_selects_gen != gen);
+    child_selects_si = NULL;
+    
+#ifndef _WIN32
+    if (!fallback)
+	wake_ready(si);
 #endif
-
-	si.wants = oldwant;
-	if (s.post_select(si))
+    
+    size_t ncs, nwoken = 0;
+    for (ncs = 0; !fallback && ncs < cs.size(); ncs++)
+    {
+	if (generation != gen)
 	{
-	    TRACE("post_select(%s) was true\n", i.link->id);
-	    sure_thing.unlink(&s); // don't add it twice!
-	    s.addRef();
-	    sure_thing.append(&s, true, i.link->id);
+	    fallback = true;
+	    break;
 	}
-	else
+	
+	const ChildSelect &c = cs[ncs];
+	if (!child_maybe_ready(c, cfds, si))
 	{
-	    TRACE("post_select(%s) was false\n", i.link->id);
-	    WvIStreamListBase::Iter j(sure_thing);
-	    WvLink* link = j.find(&s);
-	    
-	    wvassert(!link, "stream \"%s\" (%s) was ready in "
-		     "pre_select, but not in post_select",
-		     link->id, ptr2str(link->data));
+	    // idle: nothing could have happened to it
+	    if (c.candidate)
+		go_quiet(c, cfds);
+	    continue;
 	}
 	
-	if (!s.isok())
+	if (!child_post_select(*c.s, c.id, si, oldwant))
 	{
 	    already_sure = true;
 	    if (auto_prune)
-		i.xunlink();
+	    {
+		prune(c.s);
+		awake_stale = true;
+		gen = generation;
+	    }
 	}
     }
     
+    // now the quiet children that woke up: because their fds came back
+    // ready, because their alarms went off, or because of something
+    // another child did in its post_select().
+    if (!fallback && nquiet_timed)
+	WvStream::next_alarm();
+    for (nwoken = 0; !fallback && nwoken < woken.size(); nwoken++)
+    {
+	if (generation != gen)
+	{
+	    fallback = true;
+	    break;
+	}
+	
+	WvStream *ws = woken[nwoken];
+	if (!child_is_member(ws))
+	    continue;
+	if (!child_post_select(*ws, ws->listlink.id, si, oldwant))
+	{
+	    already_sure = true;
+	    if (auto_prune)
+	    {
+		prune(ws);
+		awake_stale = true;
+		gen = generation;
+	    }
+	}
+    }
+    
+    if (fallback)
+    {
+	std::set<IWvStream *> done;
+	for (size_t k = 0; k < ncs && k < cs.size(); k++)
+	    done.insert(cs[k].s);
+	for (size_t k = 0; k < nwoken; k++)
+	    done.insert(woken[k]);
+	wake_all(false);
+	awake_stale = true;
+	full_post_select(si, oldwant, done, already_sure);
+    }
+    woken.clear();
+    
+    clear_pending();
+    
+    if (!awake_stale)
+    {
+	size_t n = 0;
+	for (size_t k = 0; k < awake.size(); k++)
+	    if (awake[k].link)
+		awake[n++] = awake[k];
+	awake.resize(n);
+    }
+    
+    if (child_selects.empty())
+    {
+	// hang on to the memory for next time
+	cs.clear();
+	cfds.clear();
+	child_selects.swap(cs);
+	child_fds.swap(cfds);
+    }
+    
     WvCrashInfo::in_stream = old_in_stream;
     WvCrashInfo::in_stream_id = old_in_stream_id;
     WvCrashInfo::in_stream_state = old_in_stream_state;
@@ -233,6 +820,7 @@ void WvIStreamList::execute()
 
 	TRACE("[%p:%s]", &s, id);
 	
+	sure_set.erase(&s);
 	i.xunlink();
 	
 #if DEBUG
@@ -263,6 +851,7 @@ void WvIStreamList::execute()
     WvCrashInfo::in_stream_state = old_in_stream_state;
 
     sure_thing.zap();
+    sure_set.clear();
 
     level--;
     TRACE("[DONE %p]\n", this);
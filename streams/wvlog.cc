@@ -20,6 +20,7 @@
 WvLogRcvBaseList *WvLog::receivers;
 int WvLog::num_receivers = 0, WvLog::num_logs = 0;
 WvLogRcvBase *WvLog::default_receiver = NULL;
+int WvLog::max_wanted = WvLog::NUM_LOGLEVELS;
 
 const char *WvLogRcv::loglevels[WvLog::NUM_LOGLEVELS] = {
     "Crit",
@@ -98,8 +99,33 @@ bool WvLog::post_select(SelectInfo &si)
 }
 
 
+void WvLog::update_max_wanted()
+{
+    // with no receivers, everything goes to the default one on stderr
+    if (num_receivers <= 0 || !receivers)
+    {
+	max_wanted = NUM_LOGLEVELS;
+	return;
+    }
+    
+    max_wanted = -1;
+    WvLogRcvBaseList::Iter i(*receivers);
+    for (i.rewind(); i.next(); )
+    {
+	if (i.ptr() == default_receiver)
+	    continue;
+	int lvl = i->max_loglevel();
+	if (lvl > max_wanted)
+	    max_wanted = lvl;
+    }
+}
+
+
 size_t WvLog::uwrite(const void *_buf, size_t len)
 {
+    if (!wanted())
+	return len;
+    
     // Writing the log message to a stream might cause it to emit its own log
     // messages, causing recursion.  Don't let it get out of hand.
     static const int recursion_max = 8;
@@ -167,6 +193,7 @@ WvLogRcvBase::WvLogRcvBase()
         WvLog::receivers = new WvLogRcvBaseList;
     WvLog::receivers->append(this, false);
     WvLog::num_receivers++;
+    levels_changed();
 }
 
 
@@ -180,6 +207,19 @@ WvLogRcvBase::~WvLogRcvBase()
         WvLog::receivers = NULL;
     }
     WvLog::num_receivers--;
+    levels_changed();
+}
+
+
+int WvLogRcvBase::max_loglevel()
+{
+    return WvLog::NUM_LOGLEVELS;
+}
+
+
+void WvLogRcvBase::levels_changed()
+{
+    WvLog::update_max_wanted();
 }
 
 
@@ -214,6 +254,7 @@ void WvLogRcvBase::cleanup_on_fork(pid_t p)
     delete WvLog::default_receiver;
     WvLog::default_receiver = NULL;
     WvLog::num_receivers = 0;
+    levels_changed();
 }
 
 
@@ -229,6 +270,25 @@ WvLogRcv::WvLogRcv(WvLog::LogLevel _max_level) : custom_levels(5)
     last_time = 0;
     max_level = _max_level;
     at_newline = true;
+    levels_changed();
+}
+
+
+int WvLogRcv::max_loglevel()
+{
+    int lvl = max_level;
+    Src_LvlDict::Iter i(custom_levels);
+    for (i.rewind(); i.next(); )
+	if (i->lvl > lvl)
+	    lvl = i->lvl;
+    return lvl;
+}
+
+
+void WvLogRcv::level(WvLog::LogLevel lvl)
+{
+    max_level = lvl;
+    levels_changed();
 }
 
 
@@ -379,6 +439,7 @@ void WvLogRcv::log(WvStringParm source, int _loglevel,
 bool WvLogRcv::set_custom_levels(WvString descr)
 {
     custom_levels.zap();
+    levels_changed();
 
     // Parse the filter line into individual rules
     WvStringList lst;
@@ -395,6 +456,7 @@ bool WvLogRcv::set_custom_levels(WvString descr)
             if (atoi(*i) > 0 && atoi(*i) <= WvLog::NUM_LOGLEVELS)
             {
                 custom_levels.add(new Src_Lvl(src, atoi(*i)), true);
+                levels_changed();
                 src = "";
             }
             else
@@ -14,6 +14,8 @@
 #include <sys/types.h>
 #ifndef _WIN32
 #include <sys/wait.h>
+#include <sys/uio.h>
+#include <pthread.h>
 #endif
 
 #define MAX_LOGFILE_SZ	1024*1024*100	// 100 Megs
@@ -31,6 +33,282 @@ static time_t gmtoffset()
 }
 
 
+//----------------------------------- WvLogWriter --------------------
+
+#ifndef _WIN32
+
+// Goes up in the child after every fork().  Only the thread that called
+// fork() comes along, so a WvLogWriter made before then has no thread here.
+static unsigned long forks = 0;
+
+static void count_fork()
+{
+    forks++;
+}
+
+static void setup_count_fork()
+{
+    pthread_atfork(NULL, NULL, count_fork);
+}
+
+
+/**
+ * The background half of WvLogFileBase's async mode.  Log lines go into a
+ * ring buffer with one producer (the thread running WvLog) and one
+ * consumer (our thread), so the producer never takes a lock: it copies
+ * the line in and publishes the new head.  The lock and condition
+ * variables are only for going to sleep and waking up again.
+ */
+class WvLogWriter
+{
+public:
+    WvLogWriter(size_t _size, int _fd, int _fsync_every, int _fsync_msec);
+    ~WvLogWriter();
+    
+    bool start();
+    
+    /** Queue a complete line; returns false if there's no room for it. */
+    bool put(const void *data, size_t len);
+    
+    /** Wait until everything queued has been written. */
+    void drain();
+    
+    /** Drain, then write to 'newfd' from now on. */
+    void setfd(int newfd);
+    
+    /**
+     * True in a child process forked after we were made.  Our thread
+     * isn't running here, and its lock might be stuck, so the only thing
+     * to do is delete us; the parent writes out whatever we had queued.
+     */
+    bool orphaned() const
+        { return born != forks; }
+    
+    int fd; // only changed by the producer, with the lock held
+    
+private:
+    char *ring;
+    size_t size;       // always a power of two
+    size_t head, tail; // free-running; use __atomic to read and write them
+    unsigned long lines;
+    
+    unsigned long born; // 'forks' when we were made
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake, idle;
+    bool running, sleeping, stopping;
+    int fsync_every, fsync_msec;
+    
+    static void *_run(void *userdata);
+    void run();
+    void write_ring(int wfd, size_t from, size_t to);
+};
+
+
+WvLogWriter::WvLogWriter(size_t _size, int _fd,
+			 int _fsync_every, int _fsync_msec)
+{
+    size = 4096;
+    while (size < _size)
+	size <<= 1;
+    ring = new char[size];
+    head = tail = 0;
+    lines = 0;
+    fd = _fd;
+    fsync_every = _fsync_every;
+    fsync_msec = _fsync_msec;
+    running = sleeping = stopping = false;
+    born = forks;
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&wake, NULL);
+    pthread_cond_init(&idle, NULL);
+}
+
+
+WvLogWriter::~WvLogWriter()
+{
+    if (orphaned())
+    {
+	delete[] ring; // nothing else here is safe to touch
+	return;
+    }
+    if (running)
+    {
+	pthread_mutex_lock(&lock);
+	stopping = true;
+	pthread_cond_signal(&wake);
+	pthread_mutex_unlock(&lock);
+	pthread_join(thread, NULL);
+    }
+    pthread_cond_destroy(&idle);
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&lock);
+    delete[] ring;
+}
+
+
+bool WvLogWriter::start()
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, setup_count_fork);
+    running = !pthread_create(&thread, NULL, _run, this);
+    return running;
+}
+
+
+bool WvLogWriter::put(const void *data, size_t len)
+{
+    size_t h = head;
+    if (len > size - (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE)))
+	return false;
+    
+    size_t off = h & (size - 1);
+    size_t first = len < size - off ? len : size - off;
+    memcpy(ring + off, data, first);
+    memcpy(ring, (const char *)data + first, len - first);
+    __atomic_add_fetch(&lines, 1, __ATOMIC_RELAXED);
+    
+    // This and the writer's check of 'sleeping' then 'head' must not be
+    // reordered, or it could go to sleep with our line still in the ring.
+    __atomic_store_n(&head, h + len, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sleeping, __ATOMIC_SEQ_CST))
+    {
+	pthread_mutex_lock(&lock);
+	pthread_cond_signal(&wake);
+	pthread_mutex_unlock(&lock);
+    }
+    return true;
+}
+
+
+void WvLogWriter::drain()
+{
+    pthread_mutex_lock(&lock);
+    while (__atomic_load_n(&tail, __ATOMIC_ACQUIRE) != head)
+    {
+	pthread_cond_signal(&wake);
+	pthread_cond_wait(&idle, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+
+void WvLogWriter::setfd(int newfd)
+{
+    drain();
+    pthread_mutex_lock(&lock);
+    fd = newfd;
+    pthread_mutex_unlock(&lock);
+}
+
+
+void *WvLogWriter::_run(void *userdata)
+{
+    ((WvLogWriter *)userdata)->run();
+    return NULL;
+}
+
+
+void WvLogWriter::write_ring(int wfd, size_t from, size_t to)
+{
+    while (wfd >= 0 && from != to)
+    {
+	struct iovec iov[2];
+	size_t off = from & (size - 1);
+	size_t len = to - from;
+	int iovcnt = 1;
+	iov[0].iov_base = ring + off;
+	iov[0].iov_len = len < size - off ? len : size - off;
+	if (iov[0].iov_len < len)
+	{
+	    iov[1].iov_base = ring;
+	    iov[1].iov_len = len - iov[0].iov_len;
+	    iovcnt = 2;
+	}
+	
+	ssize_t wrote = ::writev(wfd, iov, iovcnt);
+	if (wrote < 0 && errno == EINTR)
+	    continue;
+	if (wrote <= 0)
+	    break; // nowhere to report it; the lines are lost
+	from += wrote;
+    }
+}
+
+
+void WvLogWriter::run()
+{
+    unsigned long synced_lines = 0;
+    bool dirty = false;
+    struct timespec sync_at;
+    
+    pthread_mutex_lock(&lock);
+    for (;;)
+    {
+	size_t h = __atomic_load_n(&head, __ATOMIC_SEQ_CST);
+	if (h == tail)
+	{
+	    pthread_cond_broadcast(&idle);
+	    if (stopping)
+		break;
+	    
+	    __atomic_store_n(&sleeping, true, __ATOMIC_SEQ_CST);
+	    if (__atomic_load_n(&head, __ATOMIC_SEQ_CST) == tail)
+	    {
+		if (dirty && fsync_msec)
+		{
+		    if (pthread_cond_timedwait(&wake, &lock, &sync_at)
+			    == ETIMEDOUT && fd >= 0)
+		    {
+			fsync(fd);
+			synced_lines = __atomic_load_n(&lines,
+						       __ATOMIC_RELAXED);
+			dirty = false;
+		    }
+		}
+		else
+		    pthread_cond_wait(&wake, &lock);
+	    }
+	    __atomic_store_n(&sleeping, false, __ATOMIC_SEQ_CST);
+	    continue;
+	}
+	
+	// everything queued so far goes out in one batch
+	int wfd = fd;
+	pthread_mutex_unlock(&lock);
+	write_ring(wfd, tail, h);
+	unsigned long done = __atomic_load_n(&lines, __ATOMIC_RELAXED);
+	__atomic_store_n(&tail, h, __ATOMIC_RELEASE);
+	
+	if (fsync_every && wfd >= 0 && done - synced_lines >= (unsigned)fsync_every)
+	{
+	    fsync(wfd);
+	    synced_lines = done;
+	    dirty = false;
+	}
+	else if (fsync_msec && !dirty)
+	{
+	    dirty = true;
+	    clock_gettime(CLOCK_REALTIME, &sync_at);
+	    sync_at.tv_sec += fsync_msec / 1000;
+	    sync_at.tv_nsec += (fsync_msec % 1000) * 1000000L;
+	    if (sync_at.tv_nsec >= 1000000000L)
+	    {
+		sync_at.tv_sec++;
+		sync_at.tv_nsec -= 1000000000L;
+	    }
+	}
+	pthread_mutex_lock(&lock);
+    }
+    pthread_mutex_unlock(&lock);
+    
+    if (dirty && fd >= 0)
+	fsync(fd);
+}
+
+#endif // !_WIN32
+
+
 //----------------------------------- WvLogFileBase ------------------
 
 WvLogFileBase::WvLogFileBase(WvStringParm _filename, WvLog::LogLevel _max_level)
@@ -38,6 +316,9 @@ WvLogFileBase::WvLogFileBase(WvStringParm _filename, WvLog::LogLevel _max_level)
       WvFile(_filename, O_WRONLY|O_APPEND|O_CREAT|O_LARGEFILE, 0644)
 {
     fsync_every = fsync_count = 0;
+    fsync_msec = 0;
+    writer = NULL;
+    num_dropped = 0;
 }
 
 
@@ -45,17 +326,130 @@ WvLogFileBase::WvLogFileBase(WvLog::LogLevel _max_level)
     : WvLogRcv(_max_level) 
 { 
     fsync_every = fsync_count = 0;
+    fsync_msec = 0;
+    writer = NULL;
+    num_dropped = 0;
+}
+
+
+WvLogFileBase::~WvLogFileBase()
+{
+    stop_async();
+}
+
+
+bool WvLogFileBase::start_async(size_t ringsize)
+{
+#ifndef _WIN32
+    check_fork();
+    if (writer)
+	return true;
+    
+    // anything already buffered has to get there before the queued lines
+    WvFile::flush(-1);
+    writer = new WvLogWriter(ringsize, getwfd(), fsync_every, fsync_msec);
+    if (!writer->start())
+    {
+	delete writer;
+	writer = NULL;
+    }
+#endif
+    return writer != NULL;
+}
+
+
+void WvLogFileBase::stop_async()
+{
+#ifndef _WIN32
+    check_fork();
+    if (!writer)
+	return;
+    
+    // a partial line would otherwise be lost
+    if (linebuf.used())
+	queue_line();
+    delete writer;
+    writer = NULL;
+#endif
+}
+
+
+void WvLogFileBase::flush_async()
+{
+#ifndef _WIN32
+    check_fork();
+    if (writer)
+	writer->drain();
+#endif
+}
+
+
+bool WvLogFileBase::is_async()
+{
+    check_fork();
+    return writer != NULL;
+}
+
+
+void WvLogFileBase::check_fork()
+{
+#ifndef _WIN32
+    if (writer && writer->orphaned())
+    {
+	// we're a forked child, so write directly from now on.  The parent
+	// will write what was queued, and finish any half-done line too.
+	delete writer;
+	writer = NULL;
+	linebuf.zap();
+    }
+#endif
+}
+
+
+void WvLogFileBase::close()
+{
+#ifndef _WIN32
+    check_fork();
+    if (writer)
+	writer->setfd(-1);
+#endif
+    WvFile::close();
+}
+
+
+void WvLogFileBase::queue_line()
+{
+#ifndef _WIN32
+    // WvLogFile may have reopened the file since the last line
+    if (writer->fd != getwfd())
+	writer->setfd(getwfd());
+    
+    size_t len = linebuf.used();
+    if (!writer->put(linebuf.get(len), len))
+	num_dropped++;
+#endif
 }
 
 
 void WvLogFileBase::_mid_line(const char *str, size_t len)
 {
-    WvFile::write(str, len);
+    check_fork();
+    if (writer)
+	linebuf.put(str, len);
+    else
+	WvFile::write(str, len);
 }
 
 
 void WvLogFileBase::_end_line()
 {
+    check_fork();
+    if (writer)
+    {
+	queue_line();
+	return;
+    }
+    
     if (fsync_every)
     {
         fsync_count--;
@@ -137,7 +531,7 @@ static void trim_old_logs(WvStringParm filename, WvStringParm base,
 
 WvString WvLogFile::start_log()
 {
-    WvFile::close();
+    WvLogFileBase::close();
 
     int num = 0;
     struct stat statbuf;
@@ -0,0 +1,819 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Pluggable backends for the wait at the bottom of WvStream::select().
+ * See wvpoller.h.
+ */
+#include "wvpoller.h"
+#include "wvautoconf.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <vector>
+
+#ifndef _WIN32
+#include "wvfork.h"
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#include "streams.h"
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#endif
+
+// enable this to add some poller trace messages (this can be VERY verbose)
+#if 0
+# define TRACE(x, y...) fprintf(stderr, x, ## y)
+#else
+#ifndef _MSC_VER
+# define TRACE(x, y...)
+#else
+# define TRACE
+#endif
+#endif
+
+
+WvPoller *WvPoller::cur = NULL;
+
+
+WvPoller::~WvPoller()
+{
+}
+
+
+/***** WvSelectPoller *****/
+
+class WvSelectPoller : public WvPoller
+{
+public:
+    virtual const char *name() const
+        { return "select"; }
+
+    virtual int poll(IWvStream::SelectInfo &si)
+    {
+	timeval tv;
+	tv.tv_sec = si.msec_timeout / 1000;
+	tv.tv_usec = (si.msec_timeout % 1000) * 1000;
+
+	int sel = 0;
+#ifdef _WIN32
+	// selecting on an empty set of sockets doesn't cause a delay in win32.
+	if (si.max_fd < 0)
+	    Sleep(si.msec_timeout >= 0 ? si.msec_timeout : 1000000000);
+	else
+#endif
+	sel = ::select(si.max_fd+1, &si.read, &si.write, &si.except,
+		       si.msec_timeout >= 0 ? &tv : (timeval*)NULL);
+#ifdef _WIN32
+	// On Windows, if all 3 fd_sets are empty, select returns SOCKET_ERROR.
+	// WSAEINVAL tells us this was the case.
+	// http://msdn.microsoft.com/en-us/library/ms740141(VS.85).aspx
+	if (sel == SOCKET_ERROR && WSAGetLastError() == WSAEINVAL)
+	    sel = 0;
+#endif
+	return sel;
+    }
+};
+
+
+#ifdef HAVE_POLL_H
+
+static int clamp_timeout(time_t msec_timeout)
+{
+    if (msec_timeout < 0)
+	return -1;
+    if (msec_timeout > 0x7fffffff)
+	return 0x7fffffff;
+    return (int)msec_timeout;
+}
+
+
+/***** WvPollPoller *****/
+
+class WvPollPoller : public WvPoller
+{
+public:
+    virtual const char *name() const
+        { return "poll"; }
+
+    virtual int poll(IWvStream::SelectInfo &si)
+    {
+	pfds.clear();
+	for (int fd = 0; fd <= si.max_fd; fd++)
+	{
+	    short events = 0;
+	    if (FD_ISSET(fd, &si.read))
+		events |= POLLIN;
+	    if (FD_ISSET(fd, &si.write))
+		events |= POLLOUT;
+	    if (FD_ISSET(fd, &si.except))
+		events |= POLLPRI;
+	    if (events)
+	    {
+		pollfd p;
+		p.fd = fd;
+		p.events = events;
+		p.revents = 0;
+		pfds.push_back(p);
+	    }
+	}
+
+	int n = ::poll(pfds.empty() ? NULL : &pfds[0], pfds.size(),
+		       clamp_timeout(si.msec_timeout));
+	if (n < 0)
+	    return n;
+
+	FD_ZERO(&si.read);
+	FD_ZERO(&si.write);
+	FD_ZERO(&si.except);
+
+	int count = 0;
+	for (size_t i = 0; n > 0 && i < pfds.size(); i++)
+	{
+	    const pollfd &p = pfds[i];
+	    if (!p.revents)
+		continue;
+	    n--;
+
+	    // ::select() fails the whole call on a bad fd, so we do too.
+	    if (p.revents & POLLNVAL)
+	    {
+		errno = EBADF;
+		return -1;
+	    }
+
+	    // like select(), report errors and hangups as readable and
+	    // writable so that the stream notices when it tries.
+	    if ((p.events & POLLIN) && (p.revents & (POLLIN|POLLHUP|POLLERR)))
+		{ FD_SET(p.fd, &si.read); count++; }
+	    if ((p.events & POLLOUT) && (p.revents & (POLLOUT|POLLHUP|POLLERR)))
+		{ FD_SET(p.fd, &si.write); count++; }
+	    if ((p.events & POLLPRI) && (p.revents & POLLPRI))
+		{ FD_SET(p.fd, &si.except); count++; }
+	}
+
+	return count;
+    }
+
+private:
+    std::vector<pollfd> pfds;
+};
+
+#endif // HAVE_POLL_H
+
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_POLL_H)
+
+/***** WvEpollPoller *****/
+
+// selects involving fewer fds than this go through poll() instead, so the
+// isreadable()/iswritable() calls done from inside callbacks don't throw
+// away the main loop's registrations.
+#define EPOLL_MIN_FDS 8
+
+class WvEpollPoller : public WvPoller
+{
+public:
+    WvEpollPoller()
+    {
+	epfd = -1;
+	reset();
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+    }
+
+    virtual ~WvEpollPoller()
+    {
+	if (epfd >= 0)
+	    ::close(epfd);
+    }
+
+    bool isok() const
+        { return epfd >= 0; }
+
+    virtual const char *name() const
+        { return "epoll"; }
+
+    /**
+     * Throw away all registrations; a fresh epoll instance gets created
+     * by the next poll().  Needed after fork(), since the child would
+     * otherwise share (and mess up) the parent's interest list.
+     */
+    void reset()
+    {
+	if (epfd >= 0)
+	    ::close(epfd);
+	epfd = -1;
+	maxreg = -1;
+	stale = false;
+	FD_ZERO(&reg_read);
+	FD_ZERO(&reg_write);
+	FD_ZERO(&reg_except);
+	FD_ZERO(&unpollable);
+    }
+
+    virtual void forget(int fd)
+    {
+	if (fd < 0 || fd > maxreg)
+	    return;
+	if (FD_ISSET(fd, &reg_read) || FD_ISSET(fd, &reg_write)
+	    || FD_ISSET(fd, &reg_except))
+	{
+	    if (!FD_ISSET(fd, &unpollable))
+		epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+	    FD_CLR(fd, &reg_read);
+	    FD_CLR(fd, &reg_write);
+	    FD_CLR(fd, &reg_except);
+	}
+	FD_CLR(fd, &unpollable);
+    }
+
+    virtual int poll(IWvStream::SelectInfo &si)
+    {
+	int nfds = 0;
+	for (int fd = 0; fd <= si.max_fd && nfds < EPOLL_MIN_FDS; fd++)
+	    if (FD_ISSET(fd, &si.read) || FD_ISSET(fd, &si.write)
+		|| FD_ISSET(fd, &si.except))
+		nfds++;
+	if (epfd < 0)
+	    epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (nfds < EPOLL_MIN_FDS || epfd < 0)
+	    return small.poll(si);
+
+	bool any_unpollable = sync(si);
+	if (stale)
+	{
+	    // some fd got closed without forget(), and epoll may still be
+	    // watching whatever it used to point at.  We can't take that out
+	    // by number anymore, so start over with a fresh interest list.
+	    reset();
+	    epfd = epoll_create1(EPOLL_CLOEXEC);
+	    if (epfd < 0)
+		return small.poll(si);
+	    any_unpollable = sync(si);
+	}
+
+	int timeout = any_unpollable ? 0 : clamp_timeout(si.msec_timeout);
+	if (events.size() < (size_t)(maxreg + 1))
+	    events.resize(maxreg + 1);
+	int n = epoll_wait(epfd, &events[0], events.size(), timeout);
+	TRACE("epoll_wait(%d) returned %d\n", timeout, n);
+	if (n < 0)
+	    return n;
+
+	FD_ZERO(&si.read);
+	FD_ZERO(&si.write);
+	FD_ZERO(&si.except);
+
+	int count = 0;
+	for (int i = 0; i < n; i++)
+	{
+	    int fd = events[i].data.fd;
+	    uint32_t ev = events[i].events;
+	    if (FD_ISSET(fd, &reg_read) && (ev & (EPOLLIN|EPOLLHUP|EPOLLERR)))
+		{ FD_SET(fd, &si.read); count++; }
+	    if (FD_ISSET(fd, &reg_write) && (ev & (EPOLLOUT|EPOLLHUP|EPOLLERR)))
+		{ FD_SET(fd, &si.write); count++; }
+	    if (FD_ISSET(fd, &reg_except) && (ev & EPOLLPRI))
+		{ FD_SET(fd, &si.except); count++; }
+	}
+
+	// fds that epoll refuses (like regular files) are always ready, which
+	// is also what select() and poll() say about them.
+	if (any_unpollable)
+	{
+	    for (int fd = 0; fd <= maxreg; fd++)
+	    {
+		if (!FD_ISSET(fd, &unpollable))
+		    continue;
+		if (FD_ISSET(fd, &reg_read) && !FD_ISSET(fd, &si.read))
+		    { FD_SET(fd, &si.read); count++; }
+		if (FD_ISSET(fd, &reg_write) && !FD_ISSET(fd, &si.write))
+		    { FD_SET(fd, &si.write); count++; }
+	    }
+	}
+
+	return count;
+    }
+
+private:
+    int epfd, maxreg;
+    bool stale;
+    fd_set reg_read, reg_write, reg_except, unpollable;
+    std::vector<epoll_event> events;
+    WvPollPoller small;
+
+    // brings the kernel's interest list in line with this select; returns
+    // true if some of the fds can't be watched by epoll
+    bool sync(const IWvStream::SelectInfo &si)
+    {
+	int top = si.max_fd > maxreg ? si.max_fd : maxreg;
+	int newmax = -1;
+	bool any_unpollable = false;
+	for (int fd = 0; fd <= top; fd++)
+	{
+	    bool r = fd <= si.max_fd && FD_ISSET(fd, &si.read);
+	    bool w = fd <= si.max_fd && FD_ISSET(fd, &si.write);
+	    bool x = fd <= si.max_fd && FD_ISSET(fd, &si.except);
+	    if (r || w || x)
+		newmax = fd;
+
+	    bool oldr = FD_ISSET(fd, &reg_read);
+	    bool oldw = FD_ISSET(fd, &reg_write);
+	    bool oldx = FD_ISSET(fd, &reg_except);
+	    if (r == oldr && w == oldw && x == oldx)
+	    {
+		if ((r || w || x) && FD_ISSET(fd, &unpollable))
+		    any_unpollable = true;
+		continue;
+	    }
+
+	    if (!update(fd, r, w, x, oldr || oldw || oldx))
+		any_unpollable = true;
+	}
+	maxreg = newmax;
+	return any_unpollable;
+    }
+
+    // returns false if the fd can't be watched by epoll at all
+    bool update(int fd, bool r, bool w, bool x, bool was_registered)
+    {
+	if (r) FD_SET(fd, &reg_read); else FD_CLR(fd, &reg_read);
+	if (w) FD_SET(fd, &reg_write); else FD_CLR(fd, &reg_write);
+	if (x) FD_SET(fd, &reg_except); else FD_CLR(fd, &reg_except);
+
+	if (FD_ISSET(fd, &unpollable))
+	{
+	    if (!r && !w && !x)
+		FD_CLR(fd, &unpollable);
+	    return false;
+	}
+
+	if (!r && !w && !x)
+	{
+	    // EBADF: it was closed behind our back, maybe with a dup still
+	    // open somewhere that epoll goes on watching
+	    if (epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL) < 0 && errno == EBADF)
+		stale = true;
+	    return true;
+	}
+
+	epoll_event ev;
+	ev.events = (r ? (uint32_t)EPOLLIN : 0u)
+	    | (w ? (uint32_t)EPOLLOUT : 0u) | (x ? (uint32_t)EPOLLPRI : 0u);
+	ev.data.u64 = 0;
+	ev.data.fd = fd;
+
+	int op = was_registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+	int ret = epoll_ctl(epfd, op, fd, &ev);
+	if (ret < 0 && errno == ENOENT)
+	{
+	    // we had it registered, but that fd got closed (which dropped
+	    // the registration) and the number was reused.
+	    if (was_registered)
+		stale = true;
+	    ret = epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+	}
+	else if (ret < 0 && errno == EEXIST)
+	    ret = epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+
+	// EBADF: someone's asking about an fd that isn't open.  Report it
+	// ready, like poll() does, so its stream finds out when it reads.
+	if (ret < 0 && (errno == EPERM || errno == EBADF))
+	{
+	    FD_SET(fd, &unpollable);
+	    return false;
+	}
+	return true;
+    }
+};
+
+#endif // HAVE_SYS_EPOLL_H && HAVE_POLL_H
+
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_POLL_H)
+
+/***** WvUringPoller *****/
+
+#define URING_SQ_ENTRIES 256
+#define URING_CQ_ENTRIES 4096
+
+// user_data for requests whose completions we never look at
+#define URING_IGNORE (~(uint64_t)0)
+
+/**
+ * Waits with one-shot IORING_OP_POLL_ADD requests on an io_uring.
+ * 
+ * A poll request stays armed in the kernel until its fd becomes ready, so
+ * an idle fd costs only an fstat() after its first select; only fds that
+ * fired last time (or whose interest changed, or that now refer to a
+ * different file) need a new request.  All of those
+ * requests and the wait itself go to the kernel in a single
+ * io_uring_enter().  A one-shot poll completes at once if the fd is
+ * already ready when it is armed, which gives the same level-triggered
+ * results as select().
+ * 
+ * Each armed request holds a reference to its file, so forget() has to
+ * cancel it right away, or closing the fd wouldn't really close it.  An
+ * fd closed without forget() is caught by the fstat(), which no longer
+ * matches the file the poll was armed on.
+ */
+class WvUringPoller : public WvPoller
+{
+public:
+    WvUringPoller()
+    {
+	ringfd = -1;
+	setup();
+    }
+
+    virtual ~WvUringPoller()
+    {
+	reset();
+    }
+
+    bool isok() const
+        { return ringfd >= 0; }
+
+    virtual const char *name() const
+        { return "uring"; }
+
+    /**
+     * Throw away the ring and everything armed on it; a fresh one gets
+     * created by the next poll().  Needed after fork(), since the child
+     * would otherwise share the parent's ring.
+     */
+    void reset()
+    {
+	if (ringfd >= 0)
+	{
+	    munmap(sqmap, sqmap_len);
+	    if (cqmap != sqmap)
+		munmap(cqmap, cqmap_len);
+	    munmap(sqes, sqes_len);
+	    ::close(ringfd);
+	}
+	ringfd = -1;
+	pending = 0;
+	fds.clear();
+    }
+
+    virtual void forget(int fd)
+    {
+	if (fd < 0 || fd >= (int)fds.size() || !fds[fd].armed)
+	    return;
+	cancel(fd);
+	submit(0, NULL);
+    }
+
+    virtual int poll(IWvStream::SelectInfo &si)
+    {
+	int nfds = 0;
+	for (int fd = 0; fd <= si.max_fd && nfds < EPOLL_MIN_FDS; fd++)
+	    if (FD_ISSET(fd, &si.read) || FD_ISSET(fd, &si.write)
+		|| FD_ISSET(fd, &si.except))
+		nfds++;
+	if (ringfd < 0)
+	    setup();
+	if (nfds < EPOLL_MIN_FDS || ringfd < 0)
+	    return small.poll(si);
+
+	if (fds.size() < (size_t)(si.max_fd + 1))
+	    fds.resize(si.max_fd + 1);
+
+	// arm a poll for every wanted fd that doesn't have a suitable one
+	for (int fd = 0; fd <= si.max_fd; fd++)
+	{
+	    short mask = (FD_ISSET(fd, &si.read) ? POLLIN : 0)
+		| (FD_ISSET(fd, &si.write) ? POLLOUT : 0)
+		| (FD_ISSET(fd, &si.except) ? POLLPRI : 0);
+	    FdState &st = fds[fd];
+	    
+	    // a poll for an fd nobody wants right now can just stay armed
+	    if (!mask)
+		continue;
+	    
+	    // if the fd got closed without forget(), our poll is still on
+	    // the old file (and keeping it open); if the number got reused,
+	    // the new file would never be armed at all.
+	    struct stat sb;
+	    if (fstat(fd, &sb) < 0)
+		memset(&sb, 0, sizeof(sb));
+	    bool same = sb.st_dev == st.dev && sb.st_ino == st.ino;
+	    if (st.armed && st.mask == mask && same)
+		continue;
+	    if (st.armed)
+		cancel(fd);
+	    
+	    io_uring_sqe *sqe = get_sqe();
+	    sqe->opcode = IORING_OP_POLL_ADD;
+	    sqe->fd = fd;
+	    sqe->poll_events = mask;
+	    sqe->user_data = ((uint64_t)fd << 32) | st.gen;
+	    st.armed = true;
+	    st.mask = mask;
+	    st.dev = sb.st_dev;
+	    st.ino = sb.st_ino;
+	}
+
+	// submit and wait in one go, unless something is already waiting
+	bool have_cqes = *cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+	struct __kernel_timespec ts;
+	struct __kernel_timespec *tsp = NULL;
+	if (si.msec_timeout >= 0)
+	{
+	    ts.tv_sec = si.msec_timeout / 1000;
+	    ts.tv_nsec = (si.msec_timeout % 1000) * 1000000;
+	    tsp = &ts;
+	}
+	int ret = submit(have_cqes || si.msec_timeout == 0 ? 0 : 1, tsp);
+	TRACE("io_uring_enter returned %d\n", ret);
+	if (ret < 0 && errno != ETIME)
+	    return ret;
+
+	fd_set rd = si.read, wr = si.write, ex = si.except;
+	FD_ZERO(&si.read);
+	FD_ZERO(&si.write);
+	FD_ZERO(&si.except);
+
+	int count = 0;
+	unsigned head = *cq_head;
+	unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++)
+	{
+	    io_uring_cqe *cqe = &cqes[head & *cq_mask];
+	    if (cqe->user_data == URING_IGNORE)
+		continue;
+	    
+	    int fd = cqe->user_data >> 32;
+	    uint32_t gen = cqe->user_data & 0xffffffff;
+	    if (fd >= (int)fds.size() || !fds[fd].armed || fds[fd].gen != gen)
+		continue; // cancelled, or for an fd we forgot about
+	    fds[fd].armed = false;
+	    fds[fd].gen++;
+	    if (fd > si.max_fd)
+		continue; // not part of this select
+	    
+	    // errors count as ready, so the stream can find out what happened
+	    int ev = cqe->res < 0 ? POLLERR : cqe->res;
+	    if ((ev & (POLLIN|POLLHUP|POLLERR)) && FD_ISSET(fd, &rd))
+		{ FD_SET(fd, &si.read); count++; }
+	    if ((ev & (POLLOUT|POLLHUP|POLLERR)) && FD_ISSET(fd, &wr))
+		{ FD_SET(fd, &si.write); count++; }
+	    if ((ev & POLLPRI) && FD_ISSET(fd, &ex))
+		{ FD_SET(fd, &si.except); count++; }
+	}
+	__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+	return count;
+    }
+
+private:
+    struct FdState
+    {
+	bool armed;
+	short mask;
+	uint32_t gen;
+	dev_t dev;   // which file it was when we armed it
+	ino_t ino;
+	FdState() : armed(false), mask(0), gen(0), dev(0), ino(0) { }
+    };
+    std::vector<FdState> fds;
+
+    int ringfd;
+    void *sqmap, *cqmap;
+    size_t sqmap_len, cqmap_len, sqes_len;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    io_uring_sqe *sqes;
+    io_uring_cqe *cqes;
+    unsigned pending; // sqes filled in but not submitted yet
+    WvPollPoller small;
+
+    void setup()
+    {
+	io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = URING_CQ_ENTRIES;
+	int fd = syscall(__NR_io_uring_setup, URING_SQ_ENTRIES, &p);
+	if (fd < 0)
+	    return;
+	
+	// we need the timeout argument to io_uring_enter(), and we count on
+	// the kernel never dropping completions if the queue fills up
+	if (!(p.features & IORING_FEAT_EXT_ARG)
+	    || !(p.features & IORING_FEAT_NODROP))
+	{
+	    ::close(fd);
+	    return;
+	}
+	
+	sqmap_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cqmap_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+	    if (cqmap_len > sqmap_len)
+		sqmap_len = cqmap_len;
+	    cqmap_len = sqmap_len;
+	}
+	sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+	
+	sqmap = mmap(NULL, sqmap_len, PROT_READ|PROT_WRITE,
+		     MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sqmap == MAP_FAILED)
+	{
+	    ::close(fd);
+	    return;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	    cqmap = sqmap;
+	else
+	{
+	    cqmap = mmap(NULL, cqmap_len, PROT_READ|PROT_WRITE,
+			 MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	    if (cqmap == MAP_FAILED)
+	    {
+		munmap(sqmap, sqmap_len);
+		::close(fd);
+		return;
+	    }
+	}
+	void *s = mmap(NULL, sqes_len, PROT_READ|PROT_WRITE,
+		       MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (s == MAP_FAILED)
+	{
+	    munmap(sqmap, sqmap_len);
+	    if (cqmap != sqmap)
+		munmap(cqmap, cqmap_len);
+	    ::close(fd);
+	    return;
+	}
+	sqes = (io_uring_sqe *)s;
+	
+	char *sq = (char *)sqmap, *cq = (char *)cqmap;
+	sq_head = (unsigned *)(sq + p.sq_off.head);
+	sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	sq_array = (unsigned *)(sq + p.sq_off.array);
+	cq_head = (unsigned *)(cq + p.cq_off.head);
+	cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	cqes = (io_uring_cqe *)(cq + p.cq_off.cqes);
+	
+	ringfd = fd;
+	pending = 0;
+	fds.clear();
+    }
+
+    // Returns a cleared sqe at the tail of the submission queue, making
+    // room first if the queue is full.
+    io_uring_sqe *get_sqe()
+    {
+	unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+	unsigned tail = *sq_tail;
+	if (tail - head > *sq_mask)
+	{
+	    submit(0, NULL);
+	    tail = *sq_tail;
+	}
+	unsigned idx = tail & *sq_mask;
+	io_uring_sqe *sqe = &sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sq_array[idx] = idx;
+	__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+	pending++;
+	return sqe;
+    }
+
+    // Cancel the armed poll on 'fd'; its completion, if it still comes,
+    // will have the wrong generation and be ignored.
+    void cancel(int fd)
+    {
+	FdState &st = fds[fd];
+	io_uring_sqe *sqe = get_sqe();
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = ((uint64_t)fd << 32) | st.gen;
+	sqe->user_data = URING_IGNORE;
+	st.armed = false;
+	st.gen++;
+    }
+
+    // Submit everything pending, and wait for up to 'tsp' until at least
+    // 'min_complete' completions are there.
+    int submit(unsigned min_complete, struct __kernel_timespec *tsp)
+    {
+	io_uring_getevents_arg arg;
+	memset(&arg, 0, sizeof(arg));
+	arg.ts = (uint64_t)(uintptr_t)tsp;
+	
+	unsigned flags = IORING_ENTER_EXT_ARG
+	    | (min_complete ? IORING_ENTER_GETEVENTS : 0);
+	int ret = syscall(__NR_io_uring_enter, ringfd, pending, min_complete,
+			  flags, &arg, sizeof(arg));
+	if (ret >= 0)
+	    pending -= ret < (int)pending ? ret : pending;
+	return ret;
+    }
+};
+
+#endif // HAVE_LINUX_IO_URING_H && HAVE_POLL_H
+
+
+/***** WvPoller *****/
+
+WvPoller *WvPoller::create(WvStringParm backend)
+{
+    if (!backend || backend == "select")
+	return new WvSelectPoller;
+#ifdef HAVE_POLL_H
+    if (backend == "poll")
+	return new WvPollPoller;
+#endif
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_POLL_H)
+    if (backend == "epoll")
+    {
+	WvEpollPoller *p = new WvEpollPoller;
+	if (p->isok())
+	    return p;
+	delete p;
+    }
+#endif
+#if defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_POLL_H)
+    if (backend == "uring")
+    {
+	WvUringPoller *p = new WvUringPoller;
+	if (p->isok())
+	    return p;
+	delete p;
+    }
+#endif
+    return NULL;
+}
+
+
+WvPoller *WvPoller::current()
+{
+    if (!cur)
+    {
+	cur = create(getenv("WVSTREAMS_POLLER"));
+	if (!cur)
+	    cur = new WvSelectPoller;
+#ifndef _WIN32
+	add_wvfork_callback(WvPoller::onfork);
+#endif
+    }
+    return cur;
+}
+
+
+bool WvPoller::use(WvStringParm backend)
+{
+    WvPoller *p = create(backend);
+    if (!p)
+	return false;
+    current(); // make sure the fork callback is registered
+    delete cur;
+    cur = p;
+    return true;
+}
+
+
+void WvPoller::forget_fd(int fd)
+{
+    if (cur)
+	cur->forget(fd);
+}
+
+
+#ifndef _WIN32
+void WvPoller::onfork(pid_t p)
+{
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_POLL_H)
+    // the child must not share the parent's epoll interest list
+    if (p == 0 && cur && !strcmp(cur->name(), "epoll"))
+	static_cast<WvEpollPoller *>(cur)->reset();
+#endif
+#if defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_POLL_H)
+    // ...nor its io_uring
+    if (p == 0 && cur && !strcmp(cur->name(), "uring"))
+	static_cast<WvUringPoller *>(cur)->reset();
+#endif
+}
+#endif
@@ -21,6 +21,7 @@
 #include "wvlinkerhack.h"
 #include "wvmoniker.h"
 #include "wvneeds-sockets.h"
+#include "wvpoller.h"
 
 #ifdef _WIN32
 #undef ENOBUFS
@@ -36,9 +37,11 @@
 #endif
 
 #include <map>
+#include <vector>
 
 using std::make_pair;
 using std::map;
+using std::vector;
 
 
 // enable this to add some read/write trace messages (this can be VERY
@@ -68,6 +71,9 @@ UUID_MAP_BEGIN(WvStream)
 static map<WSID, WvStream*> *wsid_map;
 static WSID next_wsid_to_try;
 
+static vector<WvStream*> *alarm_heap;
+static WvTime last_alarm_check(0, 0);
+
 
 WV_LINK(WvStream);
 
@@ -257,6 +263,7 @@ WvStream::WvStream():
     stop_read(false),
     stop_write(false),
     closed(false),
+    select_watcher(NULL),
     readcb(wv::bind(&WvStream::legacy_callback, this)),
     max_outbuf_size(0),
     outbuf_delayed_flush(false),
@@ -264,9 +271,11 @@ WvStream::WvStream():
     want_to_flush(true),
     is_flushing(false),
     queue_min(0),
+    getline_scanned(0),
+    getline_sep(-1),
     autoclose_time(0),
     alarm_time(wvtime_zero),
-    last_alarm_check(wvtime_zero)
+    alarm_slot(-1)
 {
     TRACE("Creating wvstream %p\n", this);
     
@@ -314,6 +323,8 @@ WvStream::~WvStream()
 {
     TRACE("destroying %p\n", this);
     close();
+    if (select_watcher)
+	select_watcher->watched_destroyed(this);
     
     // if this assertion fails, then uses_continue_select is true, but you
     // didn't call terminate_continue_select() or close() before destroying
@@ -321,6 +332,8 @@ WvStream::~WvStream()
     assert(!uses_continue_select || !call_ctx);
     
     call_ctx = 0; // finish running the suspended callback, if any
+    
+    alarm_dequeue();
 
     assert(wsid_map);
     wsid_map->erase(my_wsid);
@@ -347,6 +360,7 @@ void WvStream::close()
     TRACE("(flushed)\n");
 
     closed = true;
+    select_changed();
     
     if (!!closecb)
     {
@@ -377,11 +391,26 @@ void WvStream::noautoforward()
 
 void WvStream::autoforward_callback(WvStream &input, WvStream &output)
 {
+    input.forward(output, 65536);
+}
+
+
+size_t WvStream::forward(WvStream &out, size_t count)
+{
+    int wfd = out.uwrite_fd();
+    if (wfd >= 0 && out.isok() && !out.stop_write && isok() && !stop_read)
+    {
+	int len = uforward(wfd, out, count);
+	if (len >= 0)
+	    return len;
+    }
+    
     char buf[1024];
     size_t len;
     
-    len = input.read(buf, sizeof(buf));
-    output.write(buf, len);
+    len = read(buf, count < sizeof(buf) ? count : sizeof(buf));
+    out.write(buf, len);
+    return len;
 }
 
 
@@ -407,7 +436,7 @@ void WvStream::callback()
     // if the alarm has gone off and we're calling callback... good!
     if (alarm_remaining() == 0)
     {
-	alarm_time = wvtime_zero;
+	alarm(-1);
 	alarm_was_ticking = true;
     }
     else
@@ -478,14 +507,68 @@ size_t WvStream::read(WvBuf &outbuf, size_t count)
 
 size_t WvStream::write(WvBuf &inbuf, size_t count)
 {
-    // for now, just wrap the older write function
     size_t avail = inbuf.used();
     if (count > avail)
         count = avail;
-    const unsigned char *buf = inbuf.get(count);
-    size_t len = write(buf, count);
-    inbuf.unget(count - len);
-    return len;
+    if (!isok() || !count || stop_write) return 0;
+    
+    // same as write(const void *, size_t), but the chunks of inbuf go to
+    // uwritebuf() or get moved into outbuf without being copied
+    size_t wrote = 0;
+    if (!outbuf_delayed_flush && !outbuf.used())
+    {
+	wrote = uwritebuf(inbuf, count);
+	count -= wrote;
+
+	// if uwritebuf() closed the stream, it might have thrown away
+	// more than it says it wrote
+	if (count > inbuf.used())
+	    count = inbuf.used();
+    }
+    if (max_outbuf_size != 0)
+    {
+        size_t canbuffer = max_outbuf_size - outbuf.used();
+        if (count > canbuffer)
+            count = canbuffer; // can't write the whole amount
+    }
+    if (count != 0)
+    {
+	outbuf.merge(inbuf, count);
+	wrote += count;
+	select_changed();
+    }
+    
+    if (should_flush())
+    {
+        if (is_auto_flush)
+            flush(0);
+        else 
+            flush_outbuf(0);
+    }
+
+    return wrote;
+}
+
+
+size_t WvStream::uwritebuf(WvBuf &buf, size_t count)
+{
+    size_t attempt = buf.optgettable();
+    if (attempt > count)
+	attempt = count;
+    if (!attempt)
+	return 0;
+    size_t real = uwrite(buf.get(attempt), attempt);
+    
+    // WARNING: uwrite() may have messed up our outbuf!
+    // This probably only happens if uwrite() closed the stream because
+    // of an error, so we'll check isok().
+    if (isok() && real < attempt)
+    {
+	TRACE("uwritebuf: unget %d-%d\n", attempt, real);
+	assert(buf.ungettable() >= attempt - real);
+	buf.unget(attempt - real);
+    }
+    return real;
 }
 
 
@@ -510,6 +593,7 @@ size_t WvStream::read(void *buf, size_t count)
     if (bufu < queue_min)
     {
 	maybe_autoclose();
+	select_changed();
 	return 0;
     }
         
@@ -523,10 +607,12 @@ size_t WvStream::read(void *buf, size_t count)
 	    bufu = count;
     
 	memcpy(buf, inbuf.get(bufu), bufu);
+	getline_scanned = 0;
     }
     
     TRACE("read  obj 0x%08x, bytes %d/%d\n", (unsigned int)this, bufu, count);
     maybe_autoclose();
+    select_changed();
     return bufu;
 }
 
@@ -554,6 +640,7 @@ size_t WvStream::write(const void *buf, size_t count)
     {
         outbuf.put(buf, count);
         wrote += count;
+	select_changed();
     }
 
     if (should_flush())
@@ -572,6 +659,7 @@ void WvStream::noread()
 {
     stop_read = true;
     maybe_autoclose();
+    select_changed();
 }
 
 
@@ -579,6 +667,7 @@ void WvStream::nowrite()
 {
     stop_write = true;
     maybe_autoclose();
+    select_changed();
 }
 
 
@@ -615,6 +704,14 @@ char *WvStream::blocking_getline(time_t wait_msec, int separator,
     
     maybe_autoclose();
 
+    // only look at data that arrived since we last looked for this
+    // separator, or long lines that trickle in get slow to read
+    if (separator != getline_sep)
+    {
+	getline_sep = separator;
+	getline_scanned = 0;
+    }
+
     // if we get here, we either want to wait a bit or there is data
     // available.
     while (isok())
@@ -623,9 +720,10 @@ char *WvStream::blocking_getline(time_t wait_msec, int separator,
         queuemin(0);
     
         // if there is a newline already, we have enough data.
-        if (inbuf.strchr(separator) > 0)
+        if (inbuf.strchr(separator, getline_scanned) > 0)
 	    break;
-	else if (!isok() || stop_read)    // uh oh, stream is in trouble.
+	getline_scanned = inbuf.used();
+	if (!isok() || stop_read)    // uh oh, stream is in trouble.
 	    break;
 
         // make select not return true until more data is available
@@ -666,14 +764,19 @@ char *WvStream::blocking_getline(time_t wait_msec, int separator,
 	    break;
 	
         if (!hasdata && wait_msec == 0)
+	{
+	    select_changed();
 	    return NULL; // handle timeout
+	}
     }
+    select_changed();
     if (!inbuf.used())
 	return NULL;
 
     // return the appropriate data
     size_t i = 0;
-    i = inbuf.strchr(separator);
+    i = inbuf.strchr(separator, getline_scanned);
+    getline_scanned = 0;
     if (i > 0) {
 	char *eol = (char *)inbuf.mutablepeek(i - 1, 1);
 	assert(eol && *eol == separator);
@@ -751,18 +854,7 @@ bool WvStream::flush_outbuf(time_t msec_timeout)
 //	fprintf(stderr, "%p: fd:%d/%d, used:%d\n", 
 //		this, getrfd(), getwfd(), outbuf.used());
 	
-	size_t attempt = outbuf.optgettable();
-	size_t real = uwrite(outbuf.get(attempt), attempt);
-	
-	// WARNING: uwrite() may have messed up our outbuf!
-	// This probably only happens if uwrite() closed the stream because
-	// of an error, so we'll check isok().
-	if (isok() && real < attempt)
-	{
-	    TRACE("flush_outbuf: unget %d-%d\n", attempt, real);
-	    assert(outbuf.ungettable() >= attempt - real);
-	    outbuf.unget(attempt - real);
-	}
+	uwritebuf(outbuf, outbuf.used());
 	
 	// since post_select() can call us, and select() calls post_select(),
 	// we need to be careful not to call select() if we don't need to!
@@ -830,6 +922,7 @@ void WvStream::flush_then_close(int msec_timeout)
 {
     time_t now = time(NULL);
     autoclose_time = now + (msec_timeout + 999) / 1000;
+    select_changed();
     
     TRACE("Autoclose SETUP for 0x%p - buf %d bytes, timeout %ld sec\n", 
 	    this, outbuf.used(), autoclose_time - now);
@@ -940,28 +1033,8 @@ void WvStream::_build_selectinfo(SelectInfo &si, time_t msec_timeout,
 
 int WvStream::_do_select(SelectInfo &si)
 {
-    // prepare timeout
-    timeval tv;
-    tv.tv_sec = si.msec_timeout / 1000;
-    tv.tv_usec = (si.msec_timeout % 1000) * 1000;
-    
     // block
-    int sel = 0;
-#ifdef _WIN32
-    // selecting on an empty set of sockets doesn't cause a delay in win32.
-    if (si.max_fd < 0)
-	Sleep(si.msec_timeout >= 0 ? si.msec_timeout : 1000000000);
-    else
-#endif
-    sel = ::select(si.max_fd+1, &si.read, &si.write, &si.except,
-		   si.msec_timeout >= 0 ? &tv : (timeval*)NULL);
-#ifdef _WIN32
-    // On Windows, if all 3 fd_sets are empty, select returns SOCKET_ERROR.
-    // WSAEINVAL tells us this was the case.
-    // http://msdn.microsoft.com/en-us/library/ms740141(VS.85).aspx
-    if (sel == SOCKET_ERROR && WSAGetLastError() == WSAEINVAL)
-	sel = 0;
-#endif
+    int sel = WvPoller::current()->poll(si);
 
     // handle errors.
     //   EAGAIN and EINTR don't matter because they're totally normal.
@@ -1039,6 +1112,7 @@ void WvStream::force_select(bool readable, bool writable, bool isexception)
 	writecb = wv::bind(&WvStream::legacy_callback, this);
     if (isexception)
 	exceptcb = wv::bind(&WvStream::legacy_callback, this);
+    select_changed();
 }
 
 
@@ -1050,46 +1124,176 @@ void WvStream::undo_force_select(bool readable, bool writable, bool isexception)
 	writecb = 0;
     if (isexception)
 	exceptcb = 0;
+    select_changed();
 }
 
 
 void WvStream::alarm(time_t msec_timeout)
 {
     if (msec_timeout >= 0)
+    {
+	alarm_skew_check();
         alarm_time = msecadd(wvstime(), msec_timeout);
+	if (alarm_slot < 0)
+	{
+	    if (!alarm_heap)
+		alarm_heap = new vector<WvStream*>;
+	    alarm_slot = alarm_heap->size();
+	    alarm_heap->push_back(this);
+	}
+	alarm_fixup();
+    }
     else
+    {
+	alarm_dequeue();
 	alarm_time = wvtime_zero;
+    }
+    select_changed();
 }
 
 
 time_t WvStream::alarm_remaining()
 {
-    if (alarm_time.tv_sec)
+    if (alarm_slot >= 0)
     {
-	WvTime now = wvstime();
+	alarm_skew_check();
+	
+        time_t remaining = msecdiff(alarm_time, wvstime());
+        if (remaining < 0)
+            remaining = 0;
+        return remaining;
+    }
+    return -1;
+}
 
-	// Time is going backward!
-	if (now < last_alarm_check)
+
+time_t WvStream::next_alarm()
+{
+    if (!alarm_heap)
+	return -1;
+    alarm_skew_check();
+    
+    // the alarms that have gone off form a subtree at the top of the heap,
+    // and the earliest one that hasn't is just below it somewhere.
+    WvTime now = wvstime();
+    vector<WvStream*> &heap = *alarm_heap;
+    vector<WvStream*> rang;
+    time_t next = -1;
+    vector<int> todo(1, 0);
+    while (!todo.empty())
+    {
+	int slot = todo.back();
+	todo.pop_back();
+	WvStream *s = heap[slot];
+	if (s->alarm_time <= now)
 	{
-#if 0 // okay, I give up.  Time just plain goes backwards on some systems.
-	    // warn only if it's a "big" difference (sigh...)
-	    if (msecdiff(last_alarm_check, now) > 200)
-		fprintf(stderr, " ************* TIME WENT BACKWARDS! "
-			"(%ld:%ld %ld:%ld)\n",
-			last_alarm_check.tv_sec, last_alarm_check.tv_usec,
-			now.tv_sec, now.tv_usec);
-#endif
-	    alarm_time = tvdiff(alarm_time, tvdiff(last_alarm_check, now));
+	    if (s->select_watcher)
+		rang.push_back(s);
+	    for (int child = slot * 2 + 1; child <= slot * 2 + 2; child++)
+		if (child < (int)heap.size())
+		    todo.push_back(child);
+	}
+	else
+	{
+	    time_t left = msecdiff(s->alarm_time, now);
+	    if (next < 0 || left < next)
+		next = left;
 	}
+    }
+    
+    // do this last: telling the watchers doesn't touch the heap, but it's
+    // not our business what else they get up to
+    for (size_t i = 0; i < rang.size(); i++)
+	rang[i]->select_changed();
+    return next;
+}
 
-	last_alarm_check = now;
 
-        time_t remaining = msecdiff(alarm_time, now);
-        if (remaining < 0)
-            remaining = 0;
-        return remaining;
+void WvStream::alarm_swap(int a, int b)
+{
+    vector<WvStream*> &heap = *alarm_heap;
+    WvStream *tmp = heap[a];
+    heap[a] = heap[b];
+    heap[a]->alarm_slot = a;
+    heap[b] = tmp;
+    heap[b]->alarm_slot = b;
+}
+
+
+// Move this stream up or down the alarm heap after alarm_time changed.
+void WvStream::alarm_fixup()
+{
+    vector<WvStream*> &heap = *alarm_heap;
+    while (alarm_slot > 0)
+    {
+	int parent = (alarm_slot - 1) / 2;
+	if (heap[parent]->alarm_time <= alarm_time)
+	    break;
+	alarm_swap(alarm_slot, parent);
     }
-    return -1;
+    
+    int size = heap.size();
+    while (alarm_slot * 2 + 1 < size)
+    {
+	int child = alarm_slot * 2 + 1;
+	if (child + 1 < size
+	    && heap[child + 1]->alarm_time < heap[child]->alarm_time)
+	    child++;
+	if (alarm_time <= heap[child]->alarm_time)
+	    break;
+	alarm_swap(alarm_slot, child);
+    }
+}
+
+
+void WvStream::alarm_dequeue()
+{
+    if (alarm_slot < 0)
+	return;
+    
+    int slot = alarm_slot, last = alarm_heap->size() - 1;
+    if (slot != last)
+    {
+	alarm_swap(slot, last);
+	alarm_heap->pop_back();
+	(*alarm_heap)[slot]->alarm_fixup();
+    }
+    else
+	alarm_heap->pop_back();
+    alarm_slot = -1;
+    
+    if (alarm_heap->empty())
+    {
+	delete alarm_heap;
+	alarm_heap = NULL;
+    }
+}
+
+
+void WvStream::alarm_skew_check()
+{
+    WvTime now = wvstime();
+
+    // Time is going backward!
+    if (now < last_alarm_check && alarm_heap)
+    {
+#if 0 // okay, I give up.  Time just plain goes backwards on some systems.
+	// warn only if it's a "big" difference (sigh...)
+	if (msecdiff(last_alarm_check, now) > 200)
+	    fprintf(stderr, " ************* TIME WENT BACKWARDS! "
+		    "(%ld:%ld %ld:%ld)\n",
+		    last_alarm_check.tv_sec, last_alarm_check.tv_usec,
+		    now.tv_sec, now.tv_usec);
+#endif
+	// Move every alarm back by the same amount, so each one still goes
+	// off after the time it asked for.  That doesn't change their order.
+	WvTime skew = tvdiff(last_alarm_check, now);
+	vector<WvStream*>::iterator i;
+	for (i = alarm_heap->begin(); i != alarm_heap->end(); ++i)
+	    (*i)->alarm_time = tvdiff((*i)->alarm_time, skew);
+    }
+
+    last_alarm_check = now;
 }
 
 
@@ -1153,6 +1357,7 @@ IWvStreamCallback WvStream::setreadcallback(IWvStreamCallback _callback)
     IWvStreamCallback tmp = readcb;
 
     readcb = _callback;
+    select_changed();
 
     return tmp;
 }
@@ -1163,6 +1368,7 @@ IWvStreamCallback WvStream::setwritecallback(IWvStreamCallback _callback)
     IWvStreamCallback tmp = writecb;
 
     writecb = _callback;
+    select_changed();
 
     return tmp;
 }
@@ -1173,6 +1379,7 @@ IWvStreamCallback WvStream::setexceptcallback(IWvStreamCallback _callback)
     IWvStreamCallback tmp = exceptcb;
 
     exceptcb = _callback;
+    select_changed();
 
     return tmp;
 }
@@ -1201,6 +1408,8 @@ void WvStream::unread(WvBuf &unreadbuf, size_t count)
     tmp.merge(inbuf);
     inbuf.zap();
     inbuf.merge(tmp);
+    getline_scanned = 0;
+    select_changed();
 }
 
 
@@ -42,6 +42,7 @@ static WvMoniker<IWvStream> objreg2("", objcreator);
 
 WvStreamClone::WvStreamClone(IWvStream *_cloned) 
     : cloned(NULL),
+      watched(NULL),
       my_type("WvStreamClone:(none)")
 {
     setclone(_cloned);
@@ -133,6 +134,36 @@ size_t WvStreamClone::uwrite(const void *buf, size_t size)
 }
 
 
+size_t WvStreamClone::uwritebuf(WvBuf &buf, size_t count)
+{
+    // pass the whole buffer along, so the clone can send it all at once
+    if (cloned)
+	return cloned->write(buf, count);
+    else
+	return 0;
+}
+
+
+int WvStreamClone::uforward(int wfd, WvStream &out, size_t count)
+{
+    // if we've got nothing buffered, reading from us is just reading from
+    // the clone
+    WvStream *s = dynamic_cast<WvStream *>(cloned);
+    if (!s || inbuf.used())
+	return -1;
+    return s->uforward(wfd, out, count);
+}
+
+
+int WvStreamClone::uwrite_fd()
+{
+    WvStream *s = dynamic_cast<WvStream *>(cloned);
+    if (!s || outbuf.used())
+	return -1;
+    return s->uwrite_fd();
+}
+
+
 bool WvStreamClone::isok() const
 {
     if (geterr())
@@ -180,6 +211,9 @@ void WvStreamClone::close_callback()
 
 void WvStreamClone::setclone(IWvStream *newclone)
 {
+    if (watched && watched->select_watcher == this)
+	watched->select_watcher = NULL;
+    watched = NULL;
     if (cloned)
 	cloned->setclosecallback(0);
     WVRELEASE(cloned);
@@ -189,6 +223,16 @@ void WvStreamClone::setclone(IWvStream *newclone)
 	cloned->setclosecallback(wv::bind(&WvStreamClone::close_callback,
 					  this));
     
+    // our select state includes the clone's, so we can only be cached if
+    // we hear about its changes
+    WvStream *s = dynamic_cast<WvStream *>(cloned);
+    if (s && !s->select_watcher)
+    {
+	s->select_watcher = this;
+	watched = s;
+    }
+    select_changed();
+    
     if (newclone != NULL)
         my_type = WvString("WvStreamClone:%s", newclone->wstype());
     else
@@ -261,6 +305,14 @@ bool WvStreamClone::post_select(SelectInfo &si)
 }
 
 
+bool WvStreamClone::select_state_cacheable() const
+{
+    return WvStream::select_state_cacheable()
+	&& watched && watched == cloned && watched->select_watcher == this
+	&& watched->select_is_cacheable();
+}
+
+
 const WvAddr *WvStreamClone::src() const
 {
     if (cloned)
@@ -46,10 +46,13 @@ void WvStreamsDaemon::do_run()
 
 void WvStreamsDaemon::do_stop()
 {
-    WvIStreamList::Iter stream(streams);
-    for (stream.rewind(); stream.next(); )
-        WvIStreamList::globallist.unlink(stream.ptr());
-    streams.zap();
+    // take each stream out of our list before globallist can destroy it
+    while (!streams.isempty())
+    {
+        IWvStream *s = streams.first();
+        streams.unlink_first();
+        WvIStreamList::globallist.unlink(s);
+    }
     if (do_full_close || want_to_die())
         WvIStreamList::globallist.zap();
     
@@ -10,16 +10,112 @@
 #include "wvstrutils.h"
 
 
+/***** UniConfSubtreeCursor *****/
+
+/**
+ * Walks the keys under a UniConf, for do_subtree(), in the same order as
+ * UniConf::RecursiveIter (or UniConf::Iter, if not recursive).
+ *
+ * Unlike those, it keeps no iterators open into the generators, just the
+ * names of the keys it hasn't visited yet, and it looks up each value as
+ * it gets there.  So it stays valid while we continue_select() and other
+ * connections change (or unmount) bits of the tree underneath it: keys
+ * that went away are skipped, and keys that showed up in a directory we
+ * had already listed are missed.
+ */
+class UniConfSubtreeCursor
+{
+    struct Dir
+    {
+	UniConfKey key; // relative to top
+	UniConfKeyList names;
+	
+	Dir(const UniConfKey &_key) : key(_key) { }
+    };
+    DeclareWvList(Dir);
+    
+    UniConf top;
+    bool recursive, sub_next;
+    DirList dirs;
+    UniConfKey curkey;
+    WvString curvalue;
+    
+    void enter(const UniConfKey &key)
+    {
+	Dir *dir = new Dir(key);
+	UniConf::Iter i(top[key]);
+	for (i.rewind(); i.next(); )
+	    dir->names.append(new UniConfKey(i->key()), true);
+	dirs.prepend(dir, true);
+    }
+    
+public:
+    UniConfSubtreeCursor(const UniConf &_top, bool _recursive)
+	: top(_top), recursive(_recursive), sub_next(false)
+	{ }
+    
+    void rewind()
+    {
+	dirs.zap();
+	sub_next = false;
+	enter(UniConfKey::EMPTY);
+    }
+    
+    bool next()
+    {
+	if (sub_next)
+	{
+	    sub_next = false;
+	    enter(curkey);
+	}
+	
+	while (!dirs.isempty())
+	{
+	    Dir *dir = dirs.first();
+	    if (dir->names.isempty())
+	    {
+		dirs.unlink_first();
+		continue;
+	    }
+	    
+	    curkey = UniConfKey(dir->key, *dir->names.first());
+	    dir->names.unlink_first();
+	    curvalue = top[curkey].getme();
+	    if (curvalue.isnull())
+		continue; // removed since we listed its directory
+	    
+	    sub_next = recursive;
+	    return true;
+	}
+	
+	return false;
+    }
+    
+    const UniConfKey &key() const
+	{ return curkey; }
+    
+    const WvString &value() const
+	{ return curvalue; }
+};
+
+
 /***** UniConfDaemonConn *****/
 
 UniConfDaemonConn::UniConfDaemonConn(WvStream *_s, const UniConf &_root)
-    : UniClientConn(_s), root(_root)
+    : UniClientConn(_s), outbuf_timeout(OUTBUF_TIMEOUT), root(_root)
 {
     uses_continue_select = true;
+    
+    // anything the socket won't take right away piles up in the clone
+    // only until it's this big; past that it stays in our own outbuf,
+    // where do_subtree() can see it and back off.
+    if (cloned)
+	cloned->outbuf_limit(OUTBUF_HIGH_WATER);
     addcallback();
     writecmd(EVENT_HELLO,
-	     spacecat(wvtcl_escape("UniConf Server ready."),
-		      wvtcl_escape(UNICONF_PROTOCOL_VERSION)));
+	     spacecat(spacecat(wvtcl_escape("UniConf Server ready."),
+			       wvtcl_escape(UNICONF_PROTOCOL_VERSION)),
+		      BINARY_FEATURE));
 }
 
 
@@ -57,6 +153,23 @@ void UniConfDaemonConn::execute()
     WvString command_string;
     UniClientConn::Command command = readcmd(command_string);
     
+    if (command == UniClientConn::REQ_TAG)
+    {
+	// just like the command after the tag, except that its replies
+	// get tagged too
+	reply_tag = readarg();
+	command_string = readarg();
+	if (reply_tag.isnull() || command_string.isnull())
+	{
+	    reply_tag = WvString::null;
+	    do_malformed(command);
+	    return;
+	}
+	command = findcmd(command_string);
+	if (command == UniClientConn::REQ_TAG)
+	    command = UniClientConn::INVALID;
+    }
+    
     if (command != UniClientConn::NONE)
     {
         // parse and execute command
@@ -82,6 +195,22 @@ void UniConfDaemonConn::execute()
 		do_get(arg1);
 	    break;
             
+	case UniClientConn::REQ_GETV:
+	case UniClientConn::REQ_EXISTSV:
+	    {
+		// every argument is another key
+		UniConfPairList pairs;
+		WvString key;
+		if (!arg1.isnull())
+		    pairs.append(new UniConfPair(arg1, WvString::null), true);
+		if (!arg2.isnull())
+		    pairs.append(new UniConfPair(arg2, WvString::null), true);
+		while (!(key = readarg()).isnull())
+		    pairs.append(new UniConfPair(key, WvString::null), true);
+		do_getv(pairs, command == UniClientConn::REQ_EXISTSV);
+	    }
+	    break;
+            
 	case UniClientConn::REQ_SET:
 	    if (arg1.isnull() || arg2.isnull())
 		do_malformed(command);
@@ -126,11 +255,17 @@ void UniConfDaemonConn::execute()
 	    do_help();
 	    break;
 	    
+	case UniClientConn::REQ_BINARY:
+	    do_binary();
+	    break;
+	    
 	default:
 	    do_invalid(command_string);
 	    break;
         }
     }
+    
+    reply_tag = WvString::null;
 }
 
 
@@ -170,6 +305,24 @@ void UniConfDaemonConn::do_get(const UniConfKey &key)
 }
 
 
+void UniConfDaemonConn::do_getv(UniConfPairList &pairs, bool exists)
+{
+    if (exists)
+	root.existsv(pairs);
+    else
+	root.getv(pairs);
+
+    // keys without a value are simply left out
+    UniConfPairList::Iter i(pairs);
+    for (i.rewind(); i.next(); )
+    {
+	if (!i->value().isnull())
+	    writevalue(i->key(), i->value());
+    }
+    writeok();
+}
+
+
 void UniConfDaemonConn::do_set(const UniConfKey &key, WvStringParm value)
 {
     root[key].setme(value);
@@ -231,54 +384,73 @@ void UniConfDaemonConn::do_remove(const UniConfKey &_key)
 
 void UniConfDaemonConn::do_subtree(const UniConfKey &key, bool recursive)
 {
-    static int niceness = 0;
-    
     UniConf cfg(root[key]);
     if (cfg.exists())
     {
-	if (recursive)
+	// the entries are tiny, so let them pile up in the outbuf and go
+	// out a bunch at a time instead of making a write() for each
+	delay_output(true);
+	
+	int niceness = 0;
+	UniConfSubtreeCursor it(cfg, recursive);
+	for (it.rewind(); it.next(); )
 	{
-	    UniConf::RecursiveIter it(cfg);
-	    for (it.rewind(); it.next(); )
+	    writevalue(it.key(), it.value());
+	    
+	    // the output might be totally gigantic.  Don't hog the entire
+	    // daemon while fulfilling it: give up our timeslice every so
+	    // often, and if the client isn't keeping up, stop generating
+	    // entries until it's read what we've got.
+	    if (!isok()) break;
+	    if (++niceness > CONTINUE_SELECT_AT || !recursive)
 	    {
-		writevalue(it->fullkey(cfg), it._value());
-		
-		// the output might be totally gigantic.  Don't hog the
-		// entire daemon while fulfilling it; give up our timeslice
-		// after each entry.
-		if (!isok()) break;
-		if (++niceness > CONTINUE_SELECT_AT)
-		{
-		    niceness = 0;
+		niceness = 0;
+		flush(0);
+		if (outbuf.used())
+		    wait_for_outbuf();
+		else
 		    continue_select(0);
-		}
-	    }
-	}
-	else
-	{
-	    UniConf::Iter it(cfg);
-	    for (it.rewind(); it.next(); )
-	    {
-		writevalue(it->fullkey(cfg), it._value());
-		
-		// the output might be totally gigantic.  Don't hog the
-		// entire daemon while fulfilling it; give up our timeslice
-		// after each entry.
 		if (!isok()) break;
-		continue_select(0);
 	    }
 	}
 	writeok();
+	delay_output(false);
+	flush(0);
     }
     else
         writefail();
 }
 
+
+void UniConfDaemonConn::wait_for_outbuf()
+{
+    // Whatever's in our outbuf is stuff the clone refused to take, so the
+    // socket is backed up.  Sleep until it's all gone.  We don't want to
+    // wake up for more requests meanwhile (we wouldn't read them anyway),
+    // so stop asking for readable until then.  A client that never reads
+    // would keep us here forever, though, so don't wait too long.
+    IWvStreamCallback oldreadcb = setreadcallback(IWvStreamCallback());
+    force_select(false, true, false);
+    WvTime deadline = msecadd(wvstime(), outbuf_timeout);
+    while (isok() && outbuf.used())
+    {
+	time_t left = msecdiff(deadline, wvstime());
+	if (left <= 0)
+	{
+	    log(WvLog::Warning, "Client isn't reading; closing.\n");
+	    close();
+	    break;
+	}
+	continue_select(left);
+    }
+    undo_force_select(false, true, false);
+    setreadcallback(oldreadcb);
+}
+
 void UniConfDaemonConn::do_haschildren(const UniConfKey &key)
 {
     bool haschild = root[key].haschildren();
-    writecmd(REPLY_CHILD,
-	     spacecat(wvtcl_escape(key), haschild ? "TRUE" : "FALSE"));
+    writeargs(REPLY_CHILD, key, haschild ? "TRUE" : "FALSE");
 }
 
 
@@ -313,22 +485,24 @@ void UniConfDaemonConn::do_help()
 }
 
 
+void UniConfDaemonConn::do_binary()
+{
+    if (!!reply_tag)
+	writefail("can't switch to binary in a tagged request");
+    else
+	accept_binary();
+}
+
+
 void UniConfDaemonConn::deltacallback(const UniConf &cfg, const UniConfKey &key)
 {
     // for now, we just send notifications for *any* key that changes.
     // Eventually we probably want to do something about having each
     // connection specify exactly which keys it cares about.
     WvString value(cfg[key].getme());
-    WvString msg;
 
     UniConfKey fullkey(cfg.fullkey(cfg));
     fullkey.append(key);
 
-    if (value.isnull())
-        msg = wvtcl_escape(fullkey);
-    else
-        msg = spacecat(wvtcl_escape(fullkey),
-		       wvtcl_escape(cfg[key].getme()));
-		       
-    writecmd(UniClientConn::EVENT_NOTICE, msg);
+    writeargs(UniClientConn::EVENT_NOTICE, fullkey, value);
 }
@@ -82,3 +82,34 @@ WVTEST_MAIN("cache basics")
     // should have incurred any slow operations at all.
     WVPASSEQ(slow->how_slow(), 0);
 }
+
+
+WVTEST_MAIN("cache batched gets")
+{
+    UniTempGen *t = new UniTempGen;
+    UniSlowGen *slow = new UniSlowGen(t);
+    UniConfRoot cacheroot;
+    cacheroot.mountgen(new UniCacheGen(slow), true);
+    t->set("cfg/a", "1");
+    t->set("cfg/b/c", "2");
+    slow->reset_slow();
+
+    // keys are relative to cfg, and the answers all come from the cache
+    UniConfPairList pairs;
+    pairs.append(new UniConfPair("a", WvString::null), true);
+    pairs.append(new UniConfPair("b/c", WvString::null), true);
+    pairs.append(new UniConfPair("b/x", "old"), true);
+    cacheroot["cfg"].getv(pairs);
+    UniConfPairList::Iter i(pairs);
+    i.rewind();
+    i.next(); WVPASSEQ(i->value(), "1");
+    i.next(); WVPASSEQ(i->value(), "2");
+    i.next(); WVPASSEQ(i->value(), WvString::null);
+
+    cacheroot["cfg"].existsv(pairs);
+    i.rewind();
+    i.next(); WVPASSEQ(i->value(), "");
+    i.next(); WVPASSEQ(i->value(), "");
+    i.next(); WVPASSEQ(i->value(), WvString::null);
+    WVPASSEQ(slow->how_slow(), 0);
+}
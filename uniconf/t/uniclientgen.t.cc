@@ -7,6 +7,8 @@
 #include "uniclientgen.h"
 #include "uniinigen.h"
 #include "wvunixsocket.h"
+#include "wvsocketpair.h"
+#include "wvfdstream.h"
 #include "wvfileutils.h"
 #include "wvfile.h"
 #include "uniwatch.h"
@@ -329,3 +331,354 @@ WVTEST_MAIN("timeout")
 
     kill(daemon.get_pid(), SIGCONT);
 }
+
+
+static void got_value(WvStringList *values, const UniConfKey &key,
+		      WvStringParm value)
+{
+    values->append(WvString("%s=%s", key, value));
+}
+
+
+static void got_iter(int *count, UniConfGen::Iter *it)
+{
+    *count = -1;
+    if (it)
+    {
+	*count = 0;
+	for (it->rewind(); it->next(); )
+	    (*count)++;
+	delete it;
+    }
+}
+
+
+static void set_done(bool *done, bool success)
+{
+    *done = success;
+}
+
+
+WVTEST_MAIN("pipelined requests")
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    WvString sockname = wvtmpfilename("uniclientgen.t-sock");
+    unlink(sockname);
+
+    UniConfTestDaemon daemon(sockname, "temp:");
+    UniClientGen *gen = create_client_conn("pipelined", sockname);
+
+    const int count = 50;
+    for (int i = 0; i < count; i++)
+	gen->set(WvString("dir/%s", i), i * 2);
+
+    // lots of requests at once, and they come back in order
+    WvStringList values;
+    for (int i = 0; i < count; i++)
+	gen->get_async(WvString("dir/%s", i), wv::bind(got_value, &values,
+						       _1, _2));
+    gen->get_async("nonexistent", wv::bind(got_value, &values, _1, _2));
+    WVPASSEQ(gen->pending(), count + 1);
+    int entries = -2;
+    gen->iterator_async("dir", false, wv::bind(got_iter, &entries, _1));
+
+    // a blocking call in the middle doesn't lose anything
+    WVPASSEQ(gen->get("dir/7"), "14");
+    WVPASS(gen->wait());
+    WVPASSEQ(gen->pending(), 0);
+
+    WVPASSEQ(values.count(), count + 1);
+    WVPASSEQ(values.popstr(), "dir/0=0");
+    WVPASSEQ(values.popstr(), "dir/1=2");
+    for (int i = 2; i < count; i++)
+	values.popstr();
+    WVPASSEQ(values.popstr(), "nonexistent=(nil)");
+    WVPASSEQ(entries, count);
+
+    WVRELEASE(gen);
+}
+
+
+WVTEST_MAIN("pipelining with an old server")
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    int socks[2];
+    WVPASS(!wvsocketpair(SOCK_STREAM, socks));
+    WvFdStream *server = new WvFdStream(socks[0]);
+    UniClientGen *gen = new UniClientGen(new WvFdStream(socks[1]), "old");
+    server->print("HELLO {UniConf Server ready.} 19\n");
+
+    WvStringList values;
+    gen->get_async("a", wv::bind(got_value, &values, _1, _2));
+    gen->get_async("b", wv::bind(got_value, &values, _1, _2));
+    gen->get_async("c", wv::bind(got_value, &values, _1, _2));
+
+    // without tags, requests have to go out one at a time
+    for (int i = 0; i < 3; i++)
+    {
+	WvString line;
+	for (int tries = 0; tries < 100 && !line; tries++)
+	{
+	    WvIStreamList::globallist.runonce(10);
+	    line = server->getline(0);
+	}
+	WVPASSEQ(line, WvString("get %c", 'a' + i));
+	WVPASSEQ(gen->pending(), 3 - i);
+	WVFAIL(server->select(0));
+	server->print("ONEVAL %c %s\n", 'a' + i, i);
+    }
+    for (int tries = 0; tries < 100 && gen->pending(); tries++)
+	WvIStreamList::globallist.runonce(10);
+    WVPASSEQ(values.popstr(), "a=0");
+    WVPASSEQ(values.popstr(), "b=1");
+    WVPASSEQ(values.popstr(), "c=2");
+
+    // and anything still waiting fails when the server goes away
+    gen->get_async("d", wv::bind(got_value, &values, _1, _2));
+    WVRELEASE(server);
+    WVFAIL(gen->wait());
+    WVPASSEQ(values.popstr(), "d=(nil)");
+
+    WVRELEASE(gen);
+}
+
+
+WVTEST_MAIN("batched gets")
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    WvString sockname = wvtmpfilename("uniclientgen.t-sock");
+    unlink(sockname);
+
+    UniConfTestDaemon daemon(sockname, "temp:");
+    UniClientGen *gen = create_client_conn("batched", sockname);
+
+    const int count = 200;
+    for (int i = 0; i < count; i += 2)
+	gen->set(WvString("svc/%s", i), i);
+    gen->set("svc/sub/key", "deep");
+
+    UniConfPairList pairs;
+    for (int i = 0; i < count; i++)
+	pairs.append(new UniConfPair(WvString("svc/%s", i), "stale"), true);
+    pairs.append(new UniConfPair("svc/sub", WvString::null), true);
+
+    // the whole list is one request
+    bool done = false;
+    gen->getv_async(pairs, wv::bind(set_done, &done, _1));
+    WVPASSEQ(gen->pending(), 1);
+    WVPASS(gen->wait());
+    WVPASS(done);
+
+    int i = 0;
+    bool all_ok = true;
+    UniConfPairList::Iter pair(pairs);
+    for (pair.rewind(); pair.next() && i < count; i++)
+    {
+	if (pair->value() != (i % 2 ? WvString::null : WvString(i)))
+	    all_ok = false;
+    }
+    WVPASS(all_ok);
+    WVPASSEQ(pair->value(), "");
+
+    gen->existsv(pairs);
+    all_ok = true;
+    i = 0;
+    for (pair.rewind(); pair.next() && i < count; i++)
+    {
+	if (pair->value() != (i % 2 ? WvString::null : WvString("")))
+	    all_ok = false;
+    }
+    WVPASS(all_ok);
+    WVPASSEQ(pair->value(), "");
+
+    WVRELEASE(gen);
+}
+
+
+WVTEST_MAIN("batched gets with an old server")
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    int socks[2];
+    WVPASS(!wvsocketpair(SOCK_STREAM, socks));
+    WvFdStream *server = new WvFdStream(socks[0]);
+    UniClientGen *gen = new UniClientGen(new WvFdStream(socks[1]), "old");
+
+    // this goes out before we know what the server can do...
+    UniConfPairList pairs;
+    pairs.append(new UniConfPair("a", WvString::null), true);
+    pairs.append(new UniConfPair("b", WvString::null), true);
+    bool done = false;
+    gen->getv_async(pairs, wv::bind(set_done, &done, _1));
+    server->print("HELLO {UniConf Server ready.} 19\n");
+
+    const char *expect[] = { "getv a b", "get a", "get b", NULL };
+    const char *reply[] = { "FAIL {unknown command: getv}", "ONEVAL a 1",
+			    "FAIL", NULL };
+    for (int i = 0; expect[i]; i++)
+    {
+	WvString line;
+	for (int tries = 0; tries < 100 && !line; tries++)
+	{
+	    WvIStreamList::globallist.runonce(10);
+	    line = server->getline(0);
+	}
+	WVPASSEQ(line, expect[i]);
+	server->print("%s\n", reply[i]);
+    }
+    // ...so it gets split up into one get per key
+    for (int tries = 0; tries < 100 && !done; tries++)
+	WvIStreamList::globallist.runonce(10);
+    WVPASS(done);
+    UniConfPairList::Iter pair(pairs);
+    pair.rewind();
+    pair.next(); WVPASSEQ(pair->value(), "1");
+    pair.next(); WVPASSEQ(pair->value(), WvString::null);
+
+    WVRELEASE(server);
+    WVRELEASE(gen);
+}
+
+
+WVTEST_MAIN("binary framing")
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    WvString sockname = wvtmpfilename("uniclientgen.t-sock");
+    unlink(sockname);
+
+    UniConfTestDaemon daemon(sockname, "temp:");
+    UniClientGen *gen = create_client_conn("binary", sockname);
+    UniClientGen *text = create_client_conn("text", sockname);
+    text->set_binary(false);
+
+    // the kinds of values that need the most escaping in text mode
+    const char *nasty[] = { "two words", "new\nline", "{brace", "}{",
+			    "back\\slash", "", " ", "\x01\x7f\xff", NULL };
+    for (int i = 0; nasty[i]; i++)
+	gen->set(WvString("nasty/%s", i), nasty[i]);
+    gen->set("key with spaces/{and} braces", "x");
+    gen->commit();
+
+    for (int i = 0; nasty[i]; i++)
+    {
+	WvString key("nasty/%s", i);
+	WVPASSEQ(gen->get(key), nasty[i]);
+	WVPASSEQ(text->get(key), nasty[i]);
+    }
+    WVPASSEQ(gen->get("key with spaces/{and} braces"), "x");
+    WVPASSEQ(text->get("key with spaces/{and} braces"), "x");
+    WVPASS(gen->isbinary());
+    WVFAIL(text->isbinary());
+
+    // a subtree big enough to take several reads
+    const int count = 2000;
+    for (int i = 0; i < count; i++)
+	text->set(WvString("big/%s", i), WvString("value %s", i));
+    text->commit();
+
+    int found[2] = { 0, 0 };
+    UniClientGen *gens[2] = { gen, text };
+    for (int g = 0; g < 2; g++)
+    {
+	UniConfGen::Iter *it = gens[g]->recursiveiterator("big");
+	for (it->rewind(); it->next(); )
+	{
+	    if (it->value() == WvString("value %s", it->key().printable()))
+		found[g]++;
+	}
+	delete it;
+    }
+    WVPASSEQ(found[0], count);
+    WVPASSEQ(found[1], count);
+    WVPASS(gen->haschildren("big"));
+    WVFAIL(gen->haschildren("big/1"));
+
+    WVRELEASE(text);
+    WVRELEASE(gen);
+}
+
+
+static void putvarint(WvBuf &buf, size_t n)
+{
+    for (; n >= 0x80; n >>= 7)
+	buf.putch((n & 0x7f) | 0x80);
+    buf.putch(n);
+}
+
+
+// feeds 'frame' to a UniClientConn that's switched to binary, and returns
+// the first command it makes out of it
+static UniClientConn::Command read_frame(UniClientConn *conn,
+					 WvFdStream *server, WvBuf &frame)
+{
+    conn->request_binary();
+    server->print("BINARYOK\n");
+    server->write(frame);
+    UniClientConn::Command cmd = UniClientConn::NONE;
+    bool switched = false;
+    for (int tries = 0; tries < 100 && conn->isok(); tries++)
+    {
+	server->flush(0);
+	conn->select(10);
+	cmd = conn->readcmd();
+	if (cmd == UniClientConn::REPLY_BINARY)
+	    switched = true;
+	else if (cmd != UniClientConn::NONE)
+	    break;
+    }
+    WVPASS(switched);
+    return cmd;
+}
+
+
+WVTEST_MAIN("binary framing limits")
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int test = 0; test < 3; test++)
+    {
+	int socks[2];
+	WVPASS(!wvsocketpair(SOCK_STREAM, socks));
+	WvFdStream *server = new WvFdStream(socks[0]);
+	UniClientConn *conn = new UniClientConn(new WvFdStream(socks[1]));
+
+	WvDynBuf frame;
+	putvarint(frame, UniClientConn::REPLY_ONEVAL);
+	if (test == 0)
+	{
+	    // a big message, which takes lots of reads, is fine...
+	    WvString value;
+	    value.setsize(100001);
+	    memset(value.edit(), 'v', 100000);
+	    value.edit()[100000] = 0;
+	    putvarint(frame, 2 + 3 + 100000);
+	    putvarint(frame, 1);
+	    frame.putstr("k");
+	    putvarint(frame, 100000);
+	    frame.putstr(value);
+	    WVPASSEQ(read_frame(conn, server, frame),
+		     UniClientConn::REPLY_ONEVAL);
+	    WVPASSEQ(conn->readarg(), "k");
+	    WVPASS(conn->readarg() == value);
+	    WVPASS(conn->isok());
+	}
+	else
+	{
+	    // ...but one that claims to be huge, or whose header is garbage,
+	    // gets the connection closed without waiting for the rest
+	    if (test == 1)
+		putvarint(frame, 0xffffffffU);
+	    else
+		frame.put("\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff", 10);
+	    WVPASSEQ(read_frame(conn, server, frame), UniClientConn::NONE);
+	    WVFAIL(conn->isok());
+	}
+
+	WVRELEASE(conn);
+	WVRELEASE(server);
+    }
+}
@@ -1,6 +1,8 @@
+#define __WVSTREAM_UNIT_TEST 1 // for outbuf_used()
 #include "wvtest.h"
 #include "uniclientconn.h"
 #include "uniconfdaemon.h"
+#include "uniconfdaemonconn.h"
 #include "uniconfroot.h"
 #include "unitempgen.h"
 #include "wvstringlist.h"
@@ -14,6 +16,8 @@
 #include "wvpipe.h"
 #include "wvstringlist.h"
 #include "wvfileutils.h"
+#include "wvsocketpair.h"
+#include "wvfdstream.h"
 #include <signal.h>
 
 /**** Generic daemon testing helpers ****/
@@ -195,7 +199,7 @@ WVTEST_MAIN("daemon multimount")
     commands.append("subt / 1");
     WvStringListList expected_responses;
     WvStringList hello_response;
-    hello_response.append(WvString("HELLO {UniConf Server ready.} %s",
+    hello_response.append(WvString("HELLO {UniConf Server ready.} %s binary",
 				   UNICONF_PROTOCOL_VERSION));
     expected_responses.add(&hello_response, false);
     WvStringList expected_quit_response;
@@ -230,6 +234,165 @@ WVTEST_MAIN("daemon multimount")
 }
 
 
+/**** Daemon subtree flow control test ****/
+
+// spin the daemon until the client has a whole line for us (skipping
+// notifications), or give up
+static WvString daemon_getline(WvStream *sock, int tries = 1000)
+{
+    while (sock->isok() && tries > 0)
+    {
+	char *line = sock->getline(0);
+	if (!line)
+	{
+	    WvIStreamList::globallist.runonce(10);
+	    tries--;
+	}
+	else if (strncmp(line, "NOTICE ", 7))
+	    return line;
+    }
+    return WvString::null;
+}
+
+
+// read a subtree dump, returning how many values were in it, or -1 if it
+// didn't end in OK
+static int daemon_countvals(WvStream *sock)
+{
+    int count = 0;
+    WvString line;
+    while (!!(line = daemon_getline(sock)))
+    {
+	if (!strncmp(line, "VAL ", 4))
+	    count++;
+	else
+	    return strncmp(line, "OK", 2) ? -1 : count;
+    }
+    return -1;
+}
+
+
+// a client that asks for a huge subtree and doesn't read it shouldn't
+// stop the daemon from answering anyone else, or make it buffer the
+// whole thing
+WVTEST_MAIN("daemon subtree flow control")
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    const int nkeys = 20000;
+    WvString filler;
+    filler.setsize(513);
+    memset(filler.edit(), 'x', 512);
+    filler.edit()[512] = 0;
+
+    UniConfRoot cfg("temp:");
+    for (int i = 0; i < nkeys; i++)
+	cfg["big"][i].setme(filler);
+    UniConfDaemon daemon(cfg, false, NULL);
+
+    WvString pipename = wvtmpfilename("uniconfd.t-pipe");
+    daemon.listen(WvString("unix:%s", pipename));
+    WvIStreamList::globallist.append(&daemon, false, "daemon");
+    
+    // we want to see how much the hog's connection is holding onto, so
+    // we make that one ourselves
+    int socks[2];
+    WVPASS(!wvsocketpair(SOCK_STREAM, socks));
+    WvFdStream *hogsock = new WvFdStream(socks[0]);
+    hogsock->set_nonblock(true);
+    UniConfDaemonConn *hogconn = new UniConfDaemonConn(hogsock, cfg);
+    WvIStreamList::globallist.append(hogconn, false, "hogconn");
+    WvFdStream hog(socks[1]);
+    
+    WvUnixAddr addr(pipename);
+    WvUnixConn other(addr);
+    WVPASS(!strncmp(daemon_getline(&hog), "HELLO ", 6));
+    WVPASS(!strncmp(daemon_getline(&other), "HELLO ", 6));
+    
+    // a client that keeps up gets everything
+    hog.print("subt big 1\n");
+    WVPASSEQ(daemon_countvals(&hog), nkeys);
+    
+    // one that doesn't is left behind, without the daemon piling up much
+    // more than OUTBUF_HIGH_WATER for it, and everyone else carries on
+    hog.print("subt big 1\n");
+    size_t most = 0;
+    for (int i = 0; i < 100; i++)
+    {
+	WvIStreamList::globallist.runonce(10);
+	size_t used = hogconn->outbuf_used() + hogsock->outbuf_used();
+	if (used > most)
+	    most = used;
+    }
+    WVPASS(most >= OUTBUF_HIGH_WATER);
+    WVPASS(most < 2 * OUTBUF_HIGH_WATER);
+    other.print("get big/1\n");
+    WvString reply(daemon_getline(&other));
+    WVPASSEQ(reply, WvString("ONEVAL big/1 %s", filler));
+    
+    // one that never gets around to reading is eventually dropped
+    int lazysocks[2];
+    WVPASS(!wvsocketpair(SOCK_STREAM, lazysocks));
+    WvFdStream *lazysock = new WvFdStream(lazysocks[0]);
+    lazysock->set_nonblock(true);
+    UniConfDaemonConn *lazyconn = new UniConfDaemonConn(lazysock, cfg);
+    lazyconn->outbuf_timeout = 200;
+    WvIStreamList::globallist.append(lazyconn, false, "lazyconn");
+    WvFdStream lazy(lazysocks[1]);
+    lazy.print("subt big 1\n");
+    for (int i = 0; i < 100 && lazyconn->isok(); i++)
+	WvIStreamList::globallist.runonce(10);
+    WVFAIL(lazyconn->isok());
+    WVPASS(hogconn->isok());
+    
+    // and the rest of the hog's dump notices what changed in the meantime
+    cfg["big"].remove();
+    int count = daemon_countvals(&hog);
+    WVPASS(count > 0);
+    WVPASS(count < nkeys);
+    
+    WVPASS(daemon.isok());
+    WvIStreamList::globallist.zap();
+    WVRELEASE(lazyconn);
+    WVRELEASE(hogconn);
+}
+
+
+/**** Tagged request test ****/
+
+// tags come back exactly as they were sent, even ones that need quoting
+WVTEST_MAIN("daemon tagged replies")
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    UniConfRoot cfg("temp:");
+    cfg["a"].setme("1");
+    UniConfDaemon daemon(cfg, false, NULL);
+
+    WvString pipename = wvtmpfilename("uniconfd.t-pipe");
+    daemon.listen(WvString("unix:%s", pipename));
+    WvIStreamList::globallist.append(&daemon, false, "daemon");
+    
+    WvUnixAddr addr(pipename);
+    WvUnixConn sock(addr);
+    WVPASS(!strncmp(daemon_getline(&sock), "HELLO ", 6));
+    
+    WvString tag("my {odd} tag");
+    sock.print("tag %s get a\n", wvtcl_escape(tag));
+    WvStringList words;
+    wvtcl_decode(words, daemon_getline(&sock));
+    WVPASSEQ(words.count(), 5);
+    WVPASSEQ(words.popstr(), "TAGGED");
+    WVPASSEQ(words.popstr(), tag);
+    WVPASSEQ(words.popstr(), "ONEVAL");
+    WVPASSEQ(words.popstr(), "a");
+    WVPASSEQ(words.popstr(), "1");
+    
+    WVPASS(daemon.isok());
+    WvIStreamList::globallist.zap();
+}
+
+
 /**** Daemon quit test ****/
 
 // sort of useless: this functionality already exists in
@@ -251,7 +414,7 @@ WVTEST_MAIN("daemon quit")
     commands.append("quit");
     WvStringListList expected_responses;
     WvStringList hello_response;
-    hello_response.append(WvString("HELLO {UniConf Server ready.} %s",
+    hello_response.append(WvString("HELLO {UniConf Server ready.} %s binary",
 				   UNICONF_PROTOCOL_VERSION));
     expected_responses.add(&hello_response, false);
     WvStringList expected_quit_response;
@@ -395,7 +558,7 @@ static void daemon_proxy_test(bool implicit_root)
     commands.append("subt /");
     WvStringListList expected_responses;
     WvStringList hello_response;
-    hello_response.append(WvString("HELLO {UniConf Server ready.} %s",
+    hello_response.append(WvString("HELLO {UniConf Server ready.} %s binary",
 				   UNICONF_PROTOCOL_VERSION));
     expected_responses.add(&hello_response, false);
     WvStringList expected_get_response;
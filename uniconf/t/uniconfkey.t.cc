@@ -159,3 +159,23 @@ WVTEST_MAIN("range")
     WVPASSEQ(UniConfKey("fred/barney/betty").range(1,3).printable(), "barney/betty");
     WVPASSEQ(UniConfKey("fred/barney/betty").range(2,3).printable(), "betty");
 }
+
+
+WVTEST_MAIN("assignment")
+{
+    UniConfKey a("fred/barney");
+    a = a;
+    WVPASSEQ(a.printable(), "fred/barney");
+    UniConfKey b;
+    b = a;
+    WVPASSEQ(b.printable(), "fred/barney");
+    
+#if __cplusplus >= 201103L
+    UniConfKey c(std::move(a));
+    WVPASSEQ(c.printable(), "fred/barney");
+    WVPASS(a.isempty());
+    c = UniConfKey("wilma");
+    WVPASSEQ(c.printable(), "wilma");
+    WVPASSEQ(b.printable(), "fred/barney");
+#endif
+}
@@ -211,3 +211,151 @@ WVTEST_MAIN("multiple generators - iterating with gaps")
     delete i;
 }
 
+
+
+// counts how many batches it gets asked for
+class CountingTempGen : public UniTempGen
+{
+public:
+    int batches;
+    CountingTempGen() : batches(0) { }
+    virtual void getv(UniConfPairList &pairs)
+        { batches++; UniTempGen::getv(pairs); }
+    virtual void existsv(UniConfPairList &pairs)
+        { batches++; UniTempGen::existsv(pairs); }
+};
+
+
+WVTEST_MAIN("batched gets")
+{
+    UniMountGen g;
+    CountingTempGen *t1 = new CountingTempGen, *t2 = new CountingTempGen;
+    g.mountgen("/foo", t1, false);
+    g.mountgen("/foo/deep/er", t2, false);
+    g.set("/foo/a", "1");
+    g.set("/foo/b", "2");
+    g.set("/foo/deep/er/c", "3");
+
+    const char *keys[] = {
+	"foo/a", "foo/deep/er/c", "foo/nope", "foo/b", "foo/deep",
+	"foo/a", "elsewhere", "", NULL
+    };
+    UniConfPairList pairs;
+    for (int i = 0; keys[i]; i++)
+	pairs.append(new UniConfPair(keys[i], "stale"), true);
+
+    // the same answers as get() and exists(), but one batch per generator
+    g.getv(pairs);
+    WVPASSEQ(t1->batches, 1);
+    WVPASSEQ(t2->batches, 1);
+    UniConfPairList::Iter i(pairs);
+    for (i.rewind(); i.next(); )
+	WVPASSEQ(i->value(), g.get(i->key()));
+
+    g.existsv(pairs);
+    WVPASSEQ(t1->batches, 2);
+    WVPASSEQ(t2->batches, 2);
+    for (i.rewind(); i.next(); )
+    {
+	WVPASSEQ(!i->value().isnull(), g.exists(i->key()));
+	WVPASS(i->value().isnull() || i->value() == "");
+    }
+}
+
+
+// which mount owns the key, by walking through all of them, newest first,
+// like UniMountGen used to
+static IUniConfGen *slowwhichmount(IUniConfGen **gens, UniConfKey *keys,
+				   int n, const UniConfKey &key)
+{
+    for (int i = n - 1; i >= 0; i--)
+	if (gens[i] && keys[i].suborsame(key))
+	    return gens[i];
+    return NULL;
+}
+
+
+WVTEST_MAIN("mount index")
+{
+    UniMountGen g;
+    const char *points[] = {
+	"a", "a/b", "a/b/c", "a/x", "b/c/d", "b/c/e", "A/B", "", "b",
+	"a/b/c", "q/r/s/t", NULL
+    };
+    const int n = sizeof(points) / sizeof(points[0]) - 1;
+    const char *probes[] = {
+	"", "a", "a/b", "a/B/c/d", "a/x/y", "a/y", "b", "b/c", "b/c/d/e",
+	"b/c/f", "q", "q/r/s", "q/r/s/t/u", "zz", NULL
+    };
+    IUniConfGen *gens[n];
+    UniConfKey keys[n];
+
+    for (int i = 0; i < n; i++)
+    {
+	keys[i] = points[i];
+	gens[i] = g.mount(keys[i], "temp:", false);
+	gens[i]->set(WvString("gen%s", i), "here");
+
+	for (int j = 0; probes[j]; j++)
+	    WVPASS(g.whichmount(probes[j], NULL)
+		   == slowwhichmount(gens, keys, i + 1, probes[j]));
+    }
+
+    WVPASS(g.ismountpoint("a/b/c"));
+    WVPASS(g.ismountpoint("a/B/C"));
+    WVFAIL(g.ismountpoint("a/b/c/d"));
+    WVFAIL(g.ismountpoint("q/r/s"));
+    WVPASS(g.exists("q/r/s"));
+    WVPASS(g.haschildren("q/r"));
+    
+    // the second "a/b/c" is the one that counts
+    UniConfKey topkey;
+    WVPASS(g.whichmount("a/b/c/d", &topkey) == gens[9]);
+    WVPASSEQ(topkey.printable(), "a/b/c");
+    WVPASSEQ(g.get("a/b/c/gen9"), "here");
+    WVFAIL(g.get("a/b/c/gen2"));
+
+    // take them away again, in a different order than they came
+    for (int i = 0; i < n; i++)
+    {
+	int which = (i * 7) % n;
+	g.unmount(gens[which], false);
+	gens[which] = NULL;
+
+	for (int j = 0; probes[j]; j++)
+	    WVPASS(g.whichmount(probes[j], NULL)
+		   == slowwhichmount(gens, keys, n, probes[j]));
+    }
+    
+    WVFAIL(g.ismountpoint("a"));
+    WVFAIL(g.haschildren(""));
+    WVFAIL(g.exists("q/r/s"));
+}
+
+
+WVTEST_MAIN("mount index - iterating over mountpoints")
+{
+    UniMountGen g;
+    g.mount("x/one", "temp:", false);
+    g.mount("x/two/deep", "temp:", false);
+    IUniConfGen *three = g.mount("x/three", "temp:", false);
+    IUniConfGen *nested = g.mount("x/three/nested", "temp:", false);
+
+    // "x" isn't in any generator, so its children are just the ways to
+    // get to the mounts underneath
+    UniConfGen::Iter *it = g.iterator("x");
+    WvString names;
+    for (it->rewind(); it->next(); )
+	names.append("%s ", it->key());
+    delete it;
+    WVPASSEQ(names, "one three two ");
+
+    g.unmount(three, false);
+    g.unmount(nested, false);
+    it = g.iterator("x");
+    names = "";
+    for (it->rewind(); it->next(); )
+	names.append("%s ", it->key());
+    delete it;
+    WVPASSEQ(names, "one two ");
+}
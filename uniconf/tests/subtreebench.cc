@@ -0,0 +1,46 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Times the work UniConfDaemonConn::do_subtree() does for each entry:
+ * walking a tree with a RecursiveIter and writing every key and value
+ * to the client.  The client here is /dev/null, so this measures the
+ * string and key juggling, not the network.
+ */
+#include "uniconfroot.h"
+#include "uniclientconn.h"
+#include "wvfile.h"
+#include "wvtimeutils.h"
+#include <stdio.h>
+#include <fcntl.h>
+
+static const int nkeys = 10000;
+static const int rounds = 20;
+
+
+int main()
+{
+    UniConfRoot root("temp:");
+    for (int i = 0; i < nkeys; i++)
+	root[WvString("cfg/net/if%s/addr/%s", i % 16, i)].setme(i);
+    
+    UniClientConn conn(new WvFile("/dev/null", O_WRONLY));
+    UniConf cfg(root["cfg"]);
+    
+    WvTime start = wvtime();
+    size_t n = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+	UniConf::RecursiveIter it(cfg);
+	for (it.rewind(); it.next(); n++)
+	{
+	    conn.writevalue(it->fullkey(cfg), it._value());
+	    conn.flush(0);
+	}
+    }
+    time_t msec = msecdiff(wvtime(), start);
+    printf("subtree entries: %8.1f ns/entry (%ld entries)\n",
+	   msec * 1000000.0 / (n ? n : 1), (long)n);
+    
+    return 0;
+}
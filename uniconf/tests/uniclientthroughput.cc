@@ -0,0 +1,103 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Subtree throughput benchmark for the UniConf protocol.  Forks a daemon
+ * with a big temp: tree on a unix socket, then fetches the whole tree
+ * with UniClientGen::recursiveiterator(), once with the text protocol
+ * and once with binary framing, and reports how many keys per second
+ * came through.
+ */
+#include "uniclientgen.h"
+#include "uniconfdaemon.h"
+#include "uniconfroot.h"
+#include "wvistreamlist.h"
+#include "wvtimeutils.h"
+#include "wvunixsocket.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static const int nkeys = 100000;
+static const int rounds = 5;
+
+
+static void server(WvStringParm sockname)
+{
+    UniConfRoot root("temp:");
+    for (int i = 0; i < nkeys; i++)
+	root[WvString("cfg/net/if%s/addr/%s", i % 16, i)]
+	    .setme(WvString("10.0.%s.%s", i / 256 % 256, i % 256));
+
+    UniConfDaemon daemon(root, false, NULL);
+    daemon.listen(WvString("unix:%s", sockname));
+    WvIStreamList::globallist.append(&daemon, false, "uniconfd");
+    while (daemon.isok())
+	WvIStreamList::globallist.runonce();
+    _exit(0);
+}
+
+
+static double run(WvStringParm sockname, bool binary)
+{
+    UniClientGen *gen = NULL;
+    for (int tries = 0; tries < 100; tries++)
+    {
+	gen = new UniClientGen(new WvUnixConn(sockname));
+	gen->set_binary(binary);
+	if (gen->isok())
+	    break;
+	WVRELEASE(gen);
+	usleep(100 * 1000); // the daemon's still building its tree
+    }
+    if (!gen)
+    {
+	fprintf(stderr, "can't connect to %s\n", sockname.cstr());
+	exit(1);
+    }
+    gen->set_timeout(10 * 60 * 1000);
+    gen->haschildren("cfg"); // get the greeting out of the way
+
+    WvTime start = wvtime();
+    size_t n = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+	UniConfGen::Iter *it = gen->recursiveiterator("cfg");
+	for (it->rewind(); it->next(); )
+	    n++;
+	delete it;
+    }
+    time_t msec = msecdiff(wvtime(), start);
+
+    WVRELEASE(gen);
+    return msec ? n / (msec / 1000.0) : 0;
+}
+
+
+int main()
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    WvString sockname("/tmp/uniclientthroughput.%s", getpid());
+    unlink(sockname);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+	perror("fork");
+	return 1;
+    }
+    if (!pid)
+	server(sockname);
+
+    printf("%10s%14s   (keys/sec, %d keys)\n", "framing", "subtree", nkeys);
+    printf("%10s%14.0f\n", "text", run(sockname, false));
+    fflush(stdout);
+    printf("%10s%14.0f\n", "binary", run(sockname, true));
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    unlink(sockname);
+    return 0;
+}
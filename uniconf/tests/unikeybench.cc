@@ -0,0 +1,52 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Times the things that make lots of short strings: building UniConfKeys
+ * out of paths, and looking keys up in a UniTempGen.
+ */
+#include "uniconfkey.h"
+#include "unitempgen.h"
+#include "wvtimeutils.h"
+#include <stdio.h>
+
+static const int nkeys = 1000;
+static const int rounds = 1000;
+
+
+int main()
+{
+    WvString paths[nkeys];
+    for (int i = 0; i < nkeys; i++)
+	paths[i] = WvString("cfg/net/if%s/addr/%s", i % 16, i);
+    
+    printf("WvString is %d bytes.\n", (int)sizeof(WvString));
+    
+    WvTime start = wvtime();
+    size_t segs = 0;
+    for (int r = 0; r < rounds; r++)
+	for (int i = 0; i < nkeys; i++)
+	{
+	    UniConfKey key(paths[i]);
+	    segs += key.numsegments();
+	}
+    time_t msec = msecdiff(wvtime(), start);
+    printf("UniConfKey construction: %8.1f ns/key (%ld segments)\n",
+	   msec * 1000000.0 / (rounds * nkeys), (long)segs);
+    
+    UniTempGen gen;
+    for (int i = 0; i < nkeys; i++)
+	gen.set(paths[i], i);
+    
+    start = wvtime();
+    size_t found = 0;
+    for (int r = 0; r < rounds; r++)
+	for (int i = 0; i < nkeys; i++)
+	    if (!gen.get(paths[i]).isnull())
+		found++;
+    msec = msecdiff(wvtime(), start);
+    printf("UniTempGen lookup:       %8.1f ns/get (%ld found)\n",
+	   msec * 1000000.0 / (rounds * nkeys), (long)found);
+    
+    return 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Times UniMountGen::get() with more and more generators mounted, the way
+ * a uniconfd with one ini file per service ends up: a temp: at the root
+ * and one more temp: under "svc" for each service.  Finding the right
+ * generator shouldn't get slower as the number of mounts goes up.
+ */
+#include "unimountgen.h"
+#include "wvtimeutils.h"
+#include <stdio.h>
+
+static const int gets = 1000000;
+
+
+static double run(int nmounts)
+{
+    UniMountGen g;
+    g.mount("/", "temp:", false);
+    for (int i = 0; i < nmounts; i++)
+    {
+	IUniConfGen *gen = g.mount(WvString("svc/%s", i), "temp:", false);
+	gen->set("config/enabled", "1");
+    }
+
+    // build the keys first, so we only time the lookups
+    UniConfKey keys[64];
+    for (int i = 0; i < 64; i++)
+	keys[i] = WvString("svc/%s/config/enabled", i * 7919 % nmounts);
+
+    WvTime start = wvtime();
+    int found = 0;
+    for (int i = 0; i < gets; i++)
+	found += !!g.get(keys[i % 64]);
+    time_t msec = msecdiff(wvtime(), start);
+
+    if (found != gets)
+	fprintf(stderr, "only found %d of %d keys!\n", found, gets);
+    return msec ? gets / (msec / 1000.0) : 0;
+}
+
+
+int main()
+{
+    printf("%10s%14s\n", "mounts", "gets/sec");
+    int counts[] = { 10, 100, 1000 };
+    for (int i = 0; i < 3; i++)
+    {
+	printf("%10d%14.0f\n", counts[i], run(counts[i]));
+	fflush(stdout);
+    }
+    return 0;
+}
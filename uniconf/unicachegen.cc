@@ -104,3 +104,21 @@ WvString UniCacheGen::get(const UniConfKey &key)
     inner->flush_buffers(); // update all pending notifications
     return UniTempGen::get(key);
 }
+
+void UniCacheGen::getv(UniConfPairList &pairs)
+{
+    // only catch up on notifications once for the whole list
+    inner->flush_buffers();
+    UniConfPairList::Iter pair(pairs);
+    for (pair.rewind(); pair.next(); )
+	pair->setvalue(UniTempGen::get(pair->key()));
+}
+
+void UniCacheGen::existsv(UniConfPairList &pairs)
+{
+    inner->flush_buffers();
+    UniConfPairList::Iter pair(pairs);
+    for (pair.rewind(); pair.next(); )
+	pair->setvalue(UniTempGen::get(pair->key()).isnull()
+		       ? WvString::null : WvString(""));
+}
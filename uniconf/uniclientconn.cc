@@ -49,14 +49,73 @@ const UniClientConn::CommandInfo UniClientConn::cmdinfos[
     // events
     { "HELLO", "HELLO <version> <message>: sent by server on connection" },
     { "NOTICE", "NOTICE <key> <oldval> <newval>: forget key and its children" },
+
+    // tagged requests
+    { "tag", "tag <id> <command> ...: run a command, tagging its replies" },
+    { "TAGGED", "TAGGED <id> <reply> ...: a reply to a tagged command" },
+
+    // batches
+    { "getv", "getv <key> ...: get the values of several keys" },
+    { "existsv", "existsv <key> ...: check whether several keys exist" },
+
+    // binary framing
+    { "binary", "binary: switch to binary framing from here on" },
+    { "BINARYOK", "BINARYOK: everything after this is binary" },
 };
 
+const char UniClientConn::BINARY_FEATURE[] = "binary";
+
+
+// Binary framing uses varints for the command code and all the lengths.
+static void putvarint(WvBuf &buf, size_t n)
+{
+    while (n >= 0x80)
+    {
+	buf.putch((n & 0x7f) | 0x80);
+	n >>= 7;
+    }
+    buf.putch(n);
+}
+
+
+// Decodes a varint from the first 'avail' bytes at 'p', and returns its
+// length in bytes, or 0 if it isn't all there (or is ridiculously long).
+static size_t getvarint(const unsigned char *p, size_t avail, size_t &n)
+{
+    n = 0;
+    for (size_t i = 0; i < avail && i < 5; i++)
+    {
+	n |= size_t(p[i] & 0x7f) << (7 * i);
+	if (!(p[i] & 0x80))
+	    return i + 1;
+    }
+    return 0;
+}
+
+
+static size_t varintlen(size_t n)
+{
+    size_t len = 1;
+    for (; n >= 0x80; n >>= 7)
+	len++;
+    return len;
+}
+
+
+static void putarg(WvBuf &buf, WvStringParm arg)
+{
+    size_t len = arg.len();
+    putvarint(buf, len);
+    buf.put(arg.cstr(), len);
+}
+
 
 UniClientConn::UniClientConn(IWvStream *_s, WvStringParm dst) :
     WvStreamClone(_s),
     log(WvString("UniConf to %s", dst.isnull() && _s->src() ? *_s->src() : WvString(dst)),
     WvLog::Debug5), closed(false), version(-1), payloadbuf("")
 {
+    binread = binwrite = false;
     log("Opened\n");
 }
 
@@ -125,6 +184,9 @@ UniClientConn::Command UniClientConn::readcmd()
 
 UniClientConn::Command UniClientConn::readcmd(WvString &command)
 {
+    if (binread)
+	return readframe(command);
+
     WvString msg(readmsg());
     if (msg.isnull())
 	return NONE;
@@ -136,8 +198,76 @@ UniClientConn::Command UniClientConn::readcmd(WvString &command)
     if (command.isnull())
 	return NONE;
 
+    Command cmd = findcmd(command);
+    if (cmd == REPLY_BINARY && binwrite)
+    {
+	// the daemon's caught up with our request_binary()
+	binread = true;
+	msgbuf.zap();
+    }
+    return cmd;
+}
+
+
+UniClientConn::Command UniClientConn::readframe(WvString &command)
+{
+    size_t code = 0, len = 0, hdr = 0;
+    for (;;)
+    {
+	// the header is two varints, so at most 10 bytes
+	size_t avail = inbuf.used() < 10 ? inbuf.used() : 10;
+	const unsigned char *p = avail ? inbuf.peek(0, avail) : NULL;
+	size_t n1 = getvarint(p, avail, code);
+	size_t n2 = n1 ? getvarint(p + n1, avail - n1, len) : 0;
+	hdr = n2 ? n1 + n2 : 0;
+	if ((!hdr && avail >= 10) || (hdr && len > MAX_FRAME))
+	{
+	    // don't sit around buffering whatever that claims comes next
+	    log(WvLog::Warning, "Invalid binary message; closing.\n");
+	    close();
+	    return NONE;
+	}
+	if (hdr && inbuf.used() >= hdr + len)
+	    break;
+
+	// not enough yet, so read whatever's arrived, a chunk at a time so
+	// that inbuf only grows as fast as the data really shows up
+	unsigned char *buf = inbuf.alloc(20480);
+	size_t got = uread(buf, 20480);
+	inbuf.unalloc(20480 - got);
+	if (!got)
+	    break;
+	select_changed();
+    }
+
+    if (!hdr || inbuf.used() < hdr + len)
+    {
+	// make select not return true until the rest of it is here
+	queuemin(hdr ? hdr + len : inbuf.used() + 1);
+	return NONE;
+    }
+    queuemin(0);
+    getline_scanned = 0;
+
+    inbuf.skip(hdr);
+    argbuf.zap();
+    if (len)
+	argbuf.put(inbuf.get(len), len);
+
+    if (code >= (size_t)NUM_COMMANDS)
+    {
+	command = WvString("#%s", code);
+	return INVALID;
+    }
+    command = cmdinfos[code].name;
+    return Command(code);
+}
+
+
+UniClientConn::Command UniClientConn::findcmd(WvStringParm name)
+{
     for (int i = 0; i < NUM_COMMANDS; ++i)
-	if (strcasecmp(cmdinfos[i].name, command.cstr()) == 0)
+	if (strcasecmp(cmdinfos[i].name, name.cstr()) == 0)
 	    return Command(i);
     return INVALID;
 }
@@ -145,19 +275,135 @@ UniClientConn::Command UniClientConn::readcmd(WvString &command)
 
 WvString UniClientConn::readarg()
 {
-    return wvtcl_getword(payloadbuf);
+    if (!binread)
+	return wvtcl_getword(payloadbuf);
+
+    size_t avail = argbuf.used() < 5 ? argbuf.used() : 5, len;
+    size_t hdr = avail ? getvarint(argbuf.peek(0, avail), avail, len) : 0;
+    if (!hdr || argbuf.used() < hdr + len)
+    {
+	argbuf.zap();
+	return WvString::null;
+    }
+    argbuf.skip(hdr);
+
+    WvString arg;
+    arg.setsize(len + 1);
+    char *data = arg.edit();
+    memcpy(data, argbuf.get(len), len);
+    data[len] = 0;
+    return arg;
+}
+
+
+void UniClientConn::request_binary()
+{
+    writecmd(REQ_BINARY);
+    binwrite = true;
+}
+
+
+void UniClientConn::accept_binary()
+{
+    writecmd(REPLY_BINARY);
+    binread = binwrite = true;
+    msgbuf.zap();
+}
+
+
+void UniClientConn::writeframe(Command cmd, WvBuf &args)
+{
+    if (!!reply_tag && cmd >= REPLY_OK && cmd <= PART_TEXT)
+    {
+	// just like writecmd(), but the extra arguments go in front
+	WvString name(cmdinfos[cmd].name);
+	putvarint(framebuf, REPLY_TAGGED);
+	putvarint(framebuf, varintlen(reply_tag.len()) + reply_tag.len()
+		  + varintlen(name.len()) + name.len() + args.used());
+	putarg(framebuf, reply_tag);
+	putarg(framebuf, name);
+    }
+    else
+    {
+	putvarint(framebuf, cmd);
+	putvarint(framebuf, args.used());
+    }
+    framebuf.merge(args);
+    write(framebuf);
+    framebuf.zap(); // in case the outbuf was full, just like write(WvString)
+}
+
+
+void UniClientConn::writeargs(Command cmd, WvStringParm arg1,
+			      WvStringParm arg2)
+{
+    if (!binwrite)
+    {
+	if (arg2.isnull())
+	    writecmd(cmd, wvtcl_escape(arg1));
+	else
+	    writecmd(cmd, spacecat(wvtcl_escape(arg1), wvtcl_escape(arg2)));
+	return;
+    }
+
+    WvDynBuf args;
+    if (!arg1.isnull())
+	putarg(args, arg1);
+    if (!arg2.isnull())
+	putarg(args, arg2);
+    writeframe(cmd, args);
 }
 
 
 void UniClientConn::writecmd(UniClientConn::Command cmd, WvStringParm msg)
 {
-    if (msg)
+    if (binwrite)
+    {
+	// the payload's already TCL-encoded, so it has to be split up again
+	WvStringList words;
+	WvDynBuf args;
+	wvtcl_decode(words, msg);
+	WvStringList::Iter i(words);
+	for (i.rewind(); i.next(); )
+	    putarg(args, *i);
+	writeframe(cmd, args);
+    }
+    else if (!!reply_tag && cmd >= REPLY_OK && cmd <= PART_TEXT)
+    {
+	if (msg)
+	    write(WvString("%s %s %s %s\n", cmdinfos[REPLY_TAGGED].name,
+			   wvtcl_escape(reply_tag), cmdinfos[cmd].name, msg));
+	else
+	    write(WvString("%s %s %s\n", cmdinfos[REPLY_TAGGED].name,
+			   wvtcl_escape(reply_tag), cmdinfos[cmd].name));
+    }
+    else if (msg)
         write(WvString("%s %s\n", cmdinfos[cmd].name, msg));
     else
         write(WvString("%s\n", cmdinfos[cmd].name));
 }
 
 
+void UniClientConn::writetagged(unsigned id, UniClientConn::Command cmd,
+				WvStringParm msg)
+{
+    if (binwrite)
+    {
+	if (msg)
+	    writecmd(REQ_TAG, WvString("%s %s %s", id, cmdinfos[cmd].name,
+				       msg));
+	else
+	    writecmd(REQ_TAG, WvString("%s %s", id, cmdinfos[cmd].name));
+    }
+    else if (msg)
+	write(WvString("%s %s %s %s\n", cmdinfos[REQ_TAG].name, id,
+		       cmdinfos[cmd].name, msg));
+    else
+	write(WvString("%s %s %s\n", cmdinfos[REQ_TAG].name, id,
+		       cmdinfos[cmd].name));
+}
+
+
 void UniClientConn::writeok(WvStringParm payload)
 {
     writecmd(REPLY_OK, payload);
@@ -172,22 +418,19 @@ void UniClientConn::writefail(WvStringParm payload)
 
 void UniClientConn::writevalue(const UniConfKey &key, WvStringParm value)
 {
-    if (value == WvString::null)
-        writecmd(PART_VALUE, wvtcl_escape(key));
-    else
-        writecmd(PART_VALUE, spacecat(wvtcl_escape(key), wvtcl_escape(value)));
+    writeargs(PART_VALUE, key, value);
 }
 
 
 void UniClientConn::writeonevalue(const UniConfKey &key, WvStringParm value)
 {
-    writecmd(REPLY_ONEVAL, spacecat(wvtcl_escape(key), wvtcl_escape(value)));
+    writeargs(REPLY_ONEVAL, key, value);
 }
 
 
 void UniClientConn::writetext(WvStringParm text)
 {
-    writecmd(PART_TEXT, wvtcl_escape(text));
+    writeargs(PART_TEXT, text);
 }
 
 
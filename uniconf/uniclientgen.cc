@@ -103,15 +103,24 @@ static WvMoniker<IUniConfGen> wvstreamreg2("wv", wvstreamcreator);
 
 /***** UniClientGen *****/
 
+UniClientGen::Request::~Request()
+{
+    delete list;
+    delete cur;
+}
+
+
 UniClientGen::UniClientGen(IWvStream *stream, WvStringParm dst) 
     : log(WvString("UniClientGen to %s",
 		   dst.isnull() && stream->src() 
 		   ? *stream->src() : WvString(dst))),
       timeout(60*1000),
-      version(0)
+      version(0),
+      binary(true)
 {
-    cmdinprogress = cmdsuccess = false;
-    result_list = NULL;
+    next_id = 1;
+    unsent = 0;
+    untagged = false;
 
     conn = new UniClientConn(stream, dst);
     conn->setcallback(wv::bind(&UniClientGen::conncallback, this));
@@ -123,6 +132,7 @@ UniClientGen::~UniClientGen()
 {
     if (isok())
 	conn->writecmd(UniClientConn::REQ_QUIT, "");
+    fail_requests();
     WvIStreamList::globallist.unlink(conn);
     WVRELEASE(conn);
 }
@@ -144,10 +154,44 @@ bool UniClientGen::isok()
 }
 
 
+// These receive the answers for the blocking functions, which are just
+// the _async() ones plus a wait.
+static void set_value(bool *done, WvString *result,
+		      const UniConfKey &, WvStringParm value)
+{
+    *result = value;
+    *done = true;
+}
+
+
+static void set_bool(bool *done, bool *result, bool value)
+{
+    *result = value;
+    *done = true;
+}
+
+
+static void set_children(bool *done, bool *result,
+			 const UniConfKey &, bool value)
+{
+    set_bool(done, result, value);
+}
+
+
+static void set_iter(bool *done, UniConfGen::Iter **result,
+		     UniConfGen::Iter *it)
+{
+    *result = it;
+    *done = true;
+}
+
+
 bool UniClientGen::refresh()
 {
-    conn->writecmd(UniClientConn::REQ_REFRESH);
-    return do_select();
+    bool done = false, success = false;
+    refresh_async(wv::bind(set_bool, &done, &success, _1));
+    do_select(&done);
+    return success;
 }
 
 void UniClientGen::flush_buffers()
@@ -159,26 +203,37 @@ void UniClientGen::flush_buffers()
 
 void UniClientGen::commit()
 {
-    conn->writecmd(UniClientConn::REQ_COMMIT);
-    do_select();
+    bool done = false, success = false;
+    commit_async(wv::bind(set_bool, &done, &success, _1));
+    do_select(&done);
 }
 
 WvString UniClientGen::get(const UniConfKey &key)
 {
+    bool done = false;
     WvString value;
-    conn->writecmd(UniClientConn::REQ_GET, wvtcl_escape(key));
-
-    if (do_select())
-    {
-        if (result_key == key)
-            value = result;
-//        else
-//            seterror("Error: server sent wrong key pair.");
-    }
+    get_async(key, wv::bind(set_value, &done, &value, _1, _2));
+    do_select(&done);
     return value;
 }
 
 
+void UniClientGen::getv(UniConfPairList &pairs)
+{
+    bool done = false, success = false;
+    getv_async(pairs, wv::bind(set_bool, &done, &success, _1));
+    do_select(&done);
+}
+
+
+void UniClientGen::existsv(UniConfPairList &pairs)
+{
+    bool done = false, success = false;
+    existsv_async(pairs, wv::bind(set_bool, &done, &success, _1));
+    do_select(&done);
+}
+
+
 void UniClientGen::set(const UniConfKey &key, WvStringParm newvalue)
 {
     //set_queue.append(new WvString(key), true);
@@ -227,119 +282,414 @@ void UniClientGen::setv(const UniConfPairList &pairs)
 
 bool UniClientGen::haschildren(const UniConfKey &key)
 {
-    conn->writecmd(UniClientConn::REQ_HASCHILDREN, wvtcl_escape(key));
+    bool done = false, result = false;
+    haschildren_async(key, wv::bind(set_children, &done, &result, _1, _2));
+    do_select(&done);
+    return result;
+}
+
+
+UniClientGen::Iter *UniClientGen::do_iterator(const UniConfKey &key,
+					      bool recursive)
+{
+    bool done = false;
+    Iter *it = NULL;
+    iterator_async(key, recursive, wv::bind(set_iter, &done, &it, _1));
+    do_select(&done);
+    return it;
+}
+
+
+UniClientGen::Iter *UniClientGen::iterator(const UniConfKey &key)
+{
+    return do_iterator(key, false);
+}
+    
+
+UniClientGen::Iter *UniClientGen::recursiveiterator(const UniConfKey &key)
+{
+    return do_iterator(key, true);
+}
+
 
-    if (do_select())
+void UniClientGen::got_value(GetCallback cb, Request &r)
+{
+    cb(r.key, r.success ? r.result : WvString::null);
+}
+
+
+void UniClientGen::got_children(HasChildrenCallback cb, Request &r)
+{
+    cb(r.key, r.success && r.result == "TRUE");
+}
+
+
+void UniClientGen::got_done(DoneCallback cb, Request &r)
+{
+    if (cb)
+	cb(r.success);
+}
+
+
+void UniClientGen::got_iter(IterCallback cb, Request &r)
+{
+    Iter *it = NULL;
+    if (r.success)
     {
-        if (result_key == key && result == "TRUE")
-            return true;
+	it = r.list;
+	r.list = NULL;
     }
+    cb(it);
+}
+
 
-    return false;
+void UniClientGen::get_async(const UniConfKey &key, const GetCallback &cb)
+{
+    start(UniClientConn::REQ_GET, key, wvtcl_escape(key),
+	  wv::bind(&UniClientGen::got_value, cb, _1));
 }
 
 
-UniClientGen::Iter *UniClientGen::do_iterator(const UniConfKey &key,
-					      bool recursive)
+void UniClientGen::haschildren_async(const UniConfKey &key,
+				     const HasChildrenCallback &cb)
 {
-    assert(!result_list);
-    result_list = new UniListIter(this);
-    conn->writecmd(UniClientConn::REQ_SUBTREE,
-		   WvString("%s %s", wvtcl_escape(key), WvString(recursive)));
+    start(UniClientConn::REQ_HASCHILDREN, key, wvtcl_escape(key),
+	  wv::bind(&UniClientGen::got_children, cb, _1));
+}
+
 
-    if (do_select())
+void UniClientGen::iterator_async(const UniConfKey &key, bool recursive,
+				  const IterCallback &cb)
+{
+    start(UniClientConn::REQ_SUBTREE, key,
+	  WvString("%s %s", wvtcl_escape(key), WvString(recursive)),
+	  wv::bind(&UniClientGen::got_iter, cb, _1), true);
+}
+
+
+void UniClientGen::commit_async(const DoneCallback &cb)
+{
+    start(UniClientConn::REQ_COMMIT, UniConfKey::EMPTY, WvString::null,
+	  wv::bind(&UniClientGen::got_done, cb, _1));
+}
+
+
+// The payload of a REQ_GETV or REQ_EXISTSV: all the keys, in order.
+static WvString batch_payload(UniConfPairList &pairs)
+{
+    WvDynBuf buf;
+    UniConfPairList::Iter i(pairs);
+    for (i.rewind(); i.next(); )
     {
-	ListIter *it = result_list;
-	result_list = NULL;
-	return it;
+	// the answers replace the values, and missing keys don't get one
+	i->setvalue(WvString::null);
+	if (buf.used())
+	    buf.put(' ');
+	buf.putstr(wvtcl_escape(i->key()));
+    }
+    return buf.getstr();
+}
+
+
+void UniClientGen::getv_async(UniConfPairList &pairs, const DoneCallback &cb)
+{
+    WvString payload(batch_payload(pairs));
+    if (pairs.isempty())
+    {
+	if (cb)
+	    cb(true); // nothing to ask
     }
     else
+	start(UniClientConn::REQ_GETV, UniConfKey::EMPTY, payload,
+	      wv::bind(&UniClientGen::got_done, cb, _1), false, &pairs);
+}
+
+
+void UniClientGen::existsv_async(UniConfPairList &pairs,
+				 const DoneCallback &cb)
+{
+    WvString payload(batch_payload(pairs));
+    if (pairs.isempty())
     {
-	delete result_list;
-	result_list = NULL;
-	return NULL;
+	if (cb)
+	    cb(true); // nothing to ask
     }
+    else
+	start(UniClientConn::REQ_EXISTSV, UniConfKey::EMPTY, payload,
+	      wv::bind(&UniClientGen::got_done, cb, _1), false, &pairs);
 }
 
 
-UniClientGen::Iter *UniClientGen::iterator(const UniConfKey &key)
+void UniClientGen::refresh_async(const DoneCallback &cb)
 {
-    return do_iterator(key, false);
+    start(UniClientConn::REQ_REFRESH, UniConfKey::EMPTY, WvString::null,
+	  wv::bind(&UniClientGen::got_done, cb, _1));
 }
-    
 
-UniClientGen::Iter *UniClientGen::recursiveiterator(const UniConfKey &key)
+
+bool UniClientGen::wait()
 {
-    return do_iterator(key, true);
+    return do_select();
 }
 
 
-void UniClientGen::conncallback()
+void UniClientGen::start(UniClientConn::Command cmd, const UniConfKey &key,
+			 WvStringParm payload,
+			 const wv::function<void(Request &)> &cb, bool subtree,
+			 UniConfPairList *pairs)
 {
-    UniClientConn::Command command = conn->readcmd();
-    static const WvStringMask nasty_space(' ');
-    switch (command)
+    Request *r = new Request(cmd, key, payload);
+    r->cb = cb;
+    if (subtree)
+	r->list = new UniListIter(this);
+    if (pairs)
     {
-        case UniClientConn::NONE:
-            // do nothing
-            break;
+	r->pairs = pairs;
+	r->cur = new UniConfPairList::Iter(*pairs);
+	r->cur->rewind();
+    }
+    requests.append(r, false);
+    unsent++;
+
+    if (!isok())
+	finish(r, false);
+    else if (unsent == 1 && (version >= UniClientConn::TAGGED_VERSION
+			     || !untagged))
+	send(*r); // nothing's waiting in front of it
+    else
+	send_requests();
+}
+
+
+// Sends a request, or for a split-up batch, its next key.
+void UniClientGen::send(Request &r)
+{
+    if (r.pairs && !r.split && version
+	    && version < UniClientConn::BATCH_VERSION)
+    {
+	split_batch(r);
+	return;
+    }
+
+    if (!r.sent)
+    {
+	r.sent = true;
+	unsent--;
+	if (version >= UniClientConn::TAGGED_VERSION)
+	{
+	    r.id = next_id++;
+	    if (!next_id)
+		next_id = 1;
+	}
+	else
+	{
+	    // the daemon can't tell us which request a reply is for, so we
+	    // can only have one of them at a time
+	    assert(!untagged);
+	    untagged = true;
+	}
+    }
+
+    UniClientConn::Command cmd = r.cmd;
+    WvString payload(r.payload);
+    if (r.split)
+    {
+	cmd = UniClientConn::REQ_GET;
+	payload = wvtcl_escape(r.cur->ptr()->key());
+    }
+
+    if (r.id)
+	conn->writetagged(r.id, cmd, payload);
+    else
+	conn->writecmd(cmd, payload);
+}
+
+
+// The daemon doesn't understand REQ_GETV or REQ_EXISTSV, so ask it for
+// each key in turn instead.
+void UniClientGen::split_batch(Request &r)
+{
+    r.split = true;
+    r.cur->rewind();
+    r.cur->next();
+    send(r);
+}
+
+
+// The answer to one of the REQ_GETs of a split-up batch.
+void UniClientGen::split_reply(Request *r, WvStringParm value)
+{
+    if (!value.isnull())
+	r->cur->ptr()->setvalue(r->cmd == UniClientConn::REQ_EXISTSV
+				? WvString("") : WvString(value));
+    if (r->cur->next())
+	send(*r);
+    else
+	finish(r, true);
+}
+
+
+void UniClientGen::send_requests()
+{
+    RequestList::Iter i(requests);
+    for (i.rewind(); unsent && i.next(); )
+    {
+	if (i->sent)
+	    continue;
+	if (version < UniClientConn::TAGGED_VERSION && untagged)
+	    break;
+	send(*i);
+    }
+}
+
+
+// Which request a reply is for: the one with the given tag, or the oldest
+// untagged one.
+UniClientGen::Request *UniClientGen::find_reply(WvStringParm tag)
+{
+    unsigned id = tag.isnull() ? 0 : tag.num();
+    if (!id && !untagged)
+	return NULL; // nobody's expecting it
+
+    RequestList::Iter i(requests);
+    for (i.rewind(); i.next(); )
+    {
+	if (i->sent && i->id == id)
+	    return i.ptr();
+    }
+    return NULL;
+}
+
+
+void UniClientGen::finish(Request *r, bool success)
+{
+    // take it out of the list first, in case the callback wants to
+    // start more requests (or wait for the others)
+    requests.unlink(r);
+    if (r->sent && !r->id)
+	untagged = false;
+    else if (!r->sent)
+	unsent--;
+
+    r->success = success;
+    r->cb(*r);
+    delete r;
+
+    if (unsent && isok())
+	send_requests();
+}
 
+
+void UniClientGen::fail_requests()
+{
+    while (!requests.isempty())
+	finish(requests.first(), false);
+}
+
+
+void UniClientGen::handle(UniClientConn::Command command, Request *r)
+{
+    switch (command)
+    {
         case UniClientConn::REPLY_OK:
-            cmdsuccess = true;
-            cmdinprogress = false;
+	    if (r)
+		finish(r, true);
             break;
 
         case UniClientConn::REPLY_FAIL:
-            result_key = WvString::null;
-            cmdsuccess = false;
-            cmdinprogress = false;
+	    if (r && r->split)
+		split_reply(r, WvString::null);
+	    else if (r && r->pairs
+		     && version < UniClientConn::BATCH_VERSION)
+		split_batch(*r); // we sent it before we knew any better
+	    else if (r)
+		finish(r, false);
             break;
 
         case UniClientConn::REPLY_CHILD:
+        case UniClientConn::REPLY_ONEVAL:
             {
-                WvString key(wvtcl_getword(conn->payloadbuf, nasty_space));
-                WvString value(wvtcl_getword(conn->payloadbuf, nasty_space));
+                WvString key(conn->readarg());
+                WvString value(conn->readarg());
 
-                if (!key.isnull() && !value.isnull())
-                {
-                    result_key = key;
-                    result = value;
-                    cmdsuccess = true;
-                }
-                cmdinprogress = false;
+		if (r && r->split)
+		{
+		    bool ok = !key.isnull() && !value.isnull()
+			&& key == r->cur->ptr()->key().printable();
+		    split_reply(r, ok ? value : WvString::null);
+		}
+		else if (r)
+		{
+		    bool ok = !key.isnull() && !value.isnull()
+			&& key == r->key.printable();
+		    if (ok)
+			r->result = value;
+		    finish(r, ok);
+		}
                 break;
-
             }
 
-        case UniClientConn::REPLY_ONEVAL:
+        case UniClientConn::PART_VALUE:
             {
-                WvString key(wvtcl_getword(conn->payloadbuf, nasty_space));
-                WvString value(wvtcl_getword(conn->payloadbuf, nasty_space));
+                WvString key(conn->readarg());
+                WvString value(conn->readarg());
 
                 if (!key.isnull() && !value.isnull())
                 {
-                    result_key = key;
-                    result = value;
-                    cmdsuccess = true;
+                    if (r && r->list)
+			r->list->add(key, value);
+		    else if (r && r->pairs)
+		    {
+			// the answers come in the same order as the keys,
+			// but the missing ones are left out
+			UniConfKey k(key);
+			while (r->cur->next())
+			{
+			    if (r->cur->ptr()->key() == k)
+			    {
+				r->cur->ptr()->setvalue(value);
+				break;
+			    }
+			}
+		    }
                 }
-
-                cmdinprogress = false;
                 break;
             }
 
-        case UniClientConn::PART_VALUE:
-            {
-                WvString key(wvtcl_getword(conn->payloadbuf, nasty_space));
-                WvString value(wvtcl_getword(conn->payloadbuf, nasty_space));
+        default:
+            // discard unrecognized replies
+            break;
+    }
+}
 
-                if (!key.isnull() && !value.isnull())
-                {
-                    if (result_list)
-			result_list->add(key, value);
-                }
+
+void UniClientGen::conncallback()
+{
+    UniClientConn::Command command = conn->readcmd();
+    static const WvStringMask nasty_space(' ');
+    switch (command)
+    {
+        case UniClientConn::NONE:
+            // do nothing
+            break;
+
+        case UniClientConn::REPLY_TAGGED:
+            {
+		WvString tag(conn->readarg());
+		WvString reply(conn->readarg());
+		if (!tag.isnull() && !reply.isnull())
+		    handle(UniClientConn::findcmd(reply), find_reply(tag));
                 break;
             }
 
+        case UniClientConn::REPLY_OK:
+        case UniClientConn::REPLY_FAIL:
+        case UniClientConn::REPLY_CHILD:
+        case UniClientConn::REPLY_ONEVAL:
+        case UniClientConn::PART_VALUE:
+	    handle(command, find_reply(WvString::null));
+	    break;
+
         case UniClientConn::EVENT_HELLO:
             {
 		WvStringList greeting;
@@ -351,9 +701,6 @@ void UniClientGen::conncallback()
 		{
 		    // wrong type of server!
 		    log(WvLog::Error, "Connected to a non-UniConf server!\n");
-
-		    cmdinprogress = false;
-		    cmdsuccess = false;
 		    conn->close();
 		}
 		else
@@ -361,38 +708,56 @@ void UniClientGen::conncallback()
 		    version = 0;
 		    sscanf(version_string, "%d", &version);
 		    log(WvLog::Debug3, "UniConf version %s.\n", version);
+
+		    // the rest of the greeting is the features it supports
+		    WvStringList::Iter i(greeting);
+		    for (i.rewind(); binary && i.next(); )
+		    {
+			if (*i == UniClientConn::BINARY_FEATURE)
+			{
+			    conn->request_binary();
+			    break;
+			}
+		    }
+		    
+		    // anything queued up can go now, if it's allowed
+		    send_requests();
 		}
                 break;
             }
 
         case UniClientConn::EVENT_NOTICE:
             {
-                WvString key(wvtcl_getword(conn->payloadbuf, nasty_space));
-                WvString value(wvtcl_getword(conn->payloadbuf, nasty_space));
+                WvString key(conn->readarg());
+                WvString value(conn->readarg());
                 delta(key, value);
+		break;
             }   
 
         default:
             // discard unrecognized commands
             break;
     }
+
+    if (!conn->isok())
+	fail_requests();
 }
 
 
+// Wait until *done is true, or if done is NULL, until there are no more
+// requests waiting.  Returns false if the connection dies first.
+//
 // FIXME: horribly horribly evil!!
-bool UniClientGen::do_select()
+bool UniClientGen::do_select(const bool *done)
 {
     wvstime_sync();
 
     hold_delta();
     
-    cmdinprogress = true;
-    cmdsuccess = false;
-
     time_t remaining = timeout;
     const time_t clock_error = 10*1000;
     WvTime timeout_at = msecadd(wvstime(), timeout);
-    while (conn->isok() && cmdinprogress)
+    while (conn->isok() && (done ? !*done : !requests.isempty()))
     {
 	// We would really like to run the "real" wvstreams globallist
 	// select loop here, but we can't because we may already be inside
@@ -410,8 +775,6 @@ bool UniClientGen::do_select()
         else if (remaining <= 0 && remaining > -clock_error)
         {
             log(WvLog::Warning, "Command timeout; connection closed.\n");
-            cmdinprogress = false;
-            cmdsuccess = false;
             conn->close();
         }
 
@@ -428,10 +791,11 @@ bool UniClientGen::do_select()
         }
     }
 
-//    if (!cmdsuccess)
-//        seterror("Error: server timed out on response.");
+    // nobody's going to answer these now
+    if (!conn->isok())
+	fail_requests();
 
     unhold_delta();
     
-    return cmdsuccess;
+    return conn->isok();
 }
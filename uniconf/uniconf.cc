@@ -65,6 +65,48 @@ void UniConf::prefetch(bool recursive) const
 }
 
 
+// the generators want full keys, but the caller gave us relative ones
+static void batch(UniMountGen &mounts, const UniConfKey &base,
+		  UniConfPairList &pairs, bool exists)
+{
+    UniConfPairList full;
+    UniConfPairList *list = &pairs;
+    if (!base.isempty())
+    {
+	UniConfPairList::Iter i(pairs);
+	for (i.rewind(); i.next(); )
+	    full.append(new UniConfPair(UniConfKey(base, i->key()),
+					WvString::null), true);
+	list = &full;
+    }
+
+    if (exists)
+	mounts.existsv(*list);
+    else
+	mounts.getv(*list);
+
+    if (list == &full)
+    {
+	UniConfPairList::Iter i(pairs), j(full);
+	j.rewind();
+	for (i.rewind(); i.next() && j.next(); )
+	    i->setvalue(j->value());
+    }
+}
+
+
+void UniConf::getv(UniConfPairList &pairs) const
+{
+    batch(xroot->mounts, xfullkey, pairs, false);
+}
+
+
+void UniConf::existsv(UniConfPairList &pairs) const
+{
+    batch(xroot->mounts, xfullkey, pairs, true);
+}
+
+
 WvString UniConf::getme(WvStringParm defvalue) const
 {
     WvString value = xroot->mounts.get(xfullkey);
@@ -428,12 +470,15 @@ int UniConf::SortedIterBase::defcomparator(const UniConf &a,
 }
 
 
-static UniConf::SortedIterBase::Comparator innercomparator = NULL;
-
-static bool wrapcomparator(const UniConf &a, const UniConf &b)
+// lets std::sort use a Comparator without needing a global variable
+struct WrapComparator
 {
-    return innercomparator(a, b) < 0;
-}
+    UniConf::SortedIterBase::Comparator cmp;
+    WrapComparator(UniConf::SortedIterBase::Comparator _cmp)
+        : cmp(_cmp) { }
+    bool operator() (const UniConf &a, const UniConf &b) const
+        { return cmp(a, b) < 0; }
+};
 
 
 void UniConf::SortedIterBase::_purge()
@@ -448,9 +493,7 @@ void UniConf::SortedIterBase::_rewind()
     index = 0;
     count = xkeys.size();
     
-    // This code is NOT reentrant because qsort makes it too hard
-    innercomparator = xcomparator;
-    std::sort(xkeys.begin(), xkeys.end(), wrapcomparator);
+    std::sort(xkeys.begin(), xkeys.end(), WrapComparator(xcomparator));
 }
 
 
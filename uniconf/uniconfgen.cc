@@ -123,6 +123,22 @@ bool UniConfGen::exists(const UniConfKey &key)
 }
 
 
+void UniConfGen::getv(UniConfPairList &pairs)
+{
+    UniConfPairList::Iter pair(pairs);
+    for (pair.rewind(); pair.next(); )
+	pair->setvalue(get(pair->key()));
+}
+
+
+void UniConfGen::existsv(UniConfPairList &pairs)
+{
+    UniConfPairList::Iter pair(pairs);
+    for (pair.rewind(); pair.next(); )
+	pair->setvalue(exists(pair->key()) ? WvString("") : WvString::null);
+}
+
+
 int UniConfGen::str2int(WvStringParm value, int defvalue) const
 {
     // also recognize bool strings as integers
@@ -52,16 +52,29 @@ UniConfKey::Store::Store(int size, int _ref_count,
     if (!key)
         return;
 
-    WvStringList parts;
-    parts.split(key, "/");
-
-    segments.resize(parts.count());
-    WvStringList::Iter part(parts);
-    for (part.rewind(); part.next(); )
+    // Split it up ourselves rather than with WvStringList::split(): most
+    // segments are short enough to live inside their WvString, so this
+    // way building a key needs no memory allocation per segment at all.
+    const char *cptr, *end;
+    int slashes = 0;
+    for (cptr = key; *cptr; cptr++)
+        if (*cptr == '/')
+            slashes++;
+    segments.resize(slashes + 1);
+    
+    for (cptr = key; *cptr; cptr = end)
     {
-        if (!*part)
-            continue;
-        segments.append(*part);
+        for (end = cptr; *end && *end != '/'; end++)
+            ;
+        if (end > cptr)
+        {
+            WvString segment;
+            segment.setsize(end - cptr);
+            memcpy(segment.edit(), cptr, end - cptr);
+            segments.append(segment);
+        }
+        if (*end)
+            end++;
     }
     if (!!key && key[key.len()-1] == '/' && segments.used() > 0)
         segments.append(Segment());
@@ -12,11 +12,19 @@
 #include "wvstringtable.h"
 #include <assert.h>
 
+// where in the mounttree a key goes: a trailing slash doesn't count
+static UniConfKey mountpath(const UniConfKey &key)
+{
+    return key.hastrailingslash() ? key.removelast() : key;
+}
+
+
 /***** UniMountGen *****/
 
 UniMountGen::UniMountGen()
+    : mounttree(NULL, UniConfKey::EMPTY)
 {
-    // nothing special
+    lastserial = 0;
 }
 
 
@@ -57,6 +65,7 @@ struct UniMountGen::UniGenMountPairs
     UniGenMount *mount;
     WvString key;
     UniConfPairList pairs;
+    UniConfPairList sources;    // for getv(): where each of 'pairs' came from
 
     UniGenMountPairs(UniGenMount *_mount)
 	: mount(_mount)
@@ -97,6 +106,84 @@ void UniMountGen::setv(const UniConfPairList &pairs)
 }
 
 
+void UniMountGen::getv(UniConfPairList &pairs)
+{
+    batch(pairs, false);
+}
+
+
+void UniMountGen::existsv(UniConfPairList &pairs)
+{
+    batch(pairs, true);
+}
+
+
+void UniMountGen::batch(UniConfPairList &pairs, bool exists)
+{
+    UniGenMountPairsDict mountpairs(mounts.count());
+
+    {
+	MountList::Iter m(mounts);
+	for (m.rewind(); m.next(); )
+	    mountpairs.add(new UniGenMountPairs(m.ptr()), true);
+    }
+
+    // split the keys up by generator, so each one gets a single batch
+    {
+	UniConfPairList::Iter pair(pairs);
+	for (pair.rewind(); pair.next(); )
+	{
+	    UniGenMount *found = findmount(pair->key());
+	    if (!found)
+	    {
+		// just like get() and exists()
+		pair->setvalue(has_subkey(pair->key(), NULL)
+			       ? WvString("") : WvString::null);
+		continue;
+	    }
+	    UniGenMountPairs *mp = mountpairs[found->key];
+	    if (mp->mount != found)
+	    {
+		// another generator is mounted at the same place, so this
+		// one can't share its batch
+		if (exists)
+		    pair->setvalue(UniMountGen::exists(pair->key())
+				   ? WvString("") : WvString::null);
+		else
+		    pair->setvalue(get(pair->key()));
+		continue;
+	    }
+	    mp->pairs.append(new UniConfPair(trimkey(found->key, pair->key()),
+					     WvString::null), true);
+	    mp->sources.append(pair.ptr(), false);
+	}
+    }
+
+    UniGenMountPairsDict::Iter i(mountpairs);
+    for (i.rewind(); i.next(); )
+    {
+	if (i->pairs.isempty())
+	    continue;
+
+	if (exists)
+	    i->mount->gen->existsv(i->pairs);
+	else
+	    i->mount->gen->getv(i->pairs);
+
+	UniConfPairList::Iter result(i->pairs), source(i->sources);
+	result.rewind();
+	for (source.rewind(); source.next() && result.next(); )
+	{
+	    WvString value(result->value());
+	    // a key exists if anything is mounted underneath it, too
+	    if (exists && value.isnull() && has_subkey(source->key(), i->mount))
+		value = "";
+	    source->setvalue(value);
+	}
+    }
+}
+
+
 bool UniMountGen::exists(const UniConfKey &key)
 {
     UniGenMount *found = findmount(key);
@@ -126,24 +213,9 @@ bool UniMountGen::haschildren(const UniConfKey &key)
 
 bool UniMountGen::has_subkey(const UniConfKey &key, UniGenMount *found)
 {
-    MountList::Iter i(mounts);
-    for (i.rewind(); i.next(); )
-    {
-        if (key.suborsame(i->key) && key < i->key)
-        {
-            //fprintf(stdout, "%s has_subkey %s : true\n", key.printable().cstr(), 
-            //        i->key.printable().cstr());            
-            return true;
-        }
-
-	// the list is sorted innermost-first.  So if we find the key
-	// we started with, we've finished searching all children of it.
-        if (found && (i->gen == found->gen))
-            break;
-    }
-
-    //fprintf(stdout, "%s has_subkey false \n", key.printable().cstr());
-    return false;
+    // anything mounted below the key before 'found' was is hidden by it
+    UniMountTree *node = mounttree.find(mountpath(key));
+    return node && node->subnewest > (found ? found->serial : 0);
 }
 
 bool UniMountGen::refresh()
@@ -197,7 +269,7 @@ IUniConfGen *UniMountGen::mountgen(const UniConfKey &key,
     if (!gen)
 	return NULL;
     
-    UniGenMount *newgen = new UniGenMount(gen, key);
+    UniGenMount *newgen = new UniGenMount(gen, key, ++lastserial);
     gen->add_callback(this, wv::bind(&UniMountGen::gencallback, this,
 				     newgen->key, _1, _2));
 
@@ -210,6 +282,7 @@ IUniConfGen *UniMountGen::mountgen(const UniConfKey &key,
         gen->refresh();
 
     mounts.prepend(newgen, true);
+    index(newgen);
     
     delta(key, get(key));
     unhold_delta();
@@ -247,6 +320,7 @@ void UniMountGen::unmount(IUniConfGen *gen, bool commit)
     // any). This way we can make sure that each generator still has keys
     // leading up to it (in case they lost their mountpoint due to the
     // unmounted generator)
+    unindex(i.ptr());
     i.xunlink();
     if (i.next())
         next = i->gen;
@@ -274,26 +348,23 @@ void UniMountGen::zap()
 IUniConfGen *UniMountGen::whichmount(const UniConfKey &key,
 				    UniConfKey *mountpoint)
 {
-    MountList::Iter i(mounts);
-
-    for (i.rewind(); i.next(); )
-    {
-        if (i->key.suborsame(key))
-        {
-            if (mountpoint)
-                *mountpoint = i->key;
-            return i->gen;
-        }
-    }
+    UniGenMount *found = findmount(key);
+    if (!found)
+	return NULL;
 
-    return NULL;
+    if (mountpoint)
+	*mountpoint = found->key;
+    return found->gen;
 }
 
 
 bool UniMountGen::ismountpoint(const UniConfKey &key)
 {
-    MountList::Iter i(mounts);
+    UniMountTree *node = mounttree.find(mountpath(key));
+    if (!node)
+	return false;
 
+    MountList::Iter i(node->here);
     for (i.rewind(); i.next(); )
     {
         if (i->key == key)
@@ -320,21 +391,14 @@ IUniConfGen::Iter *UniMountGen::iterator(const UniConfKey &key)
 	// in a more general way.
 	ListIter *it = new ListIter(this);
 
-	MountList::Iter i(mounts);
+	// every child of its node in the mounttree leads to a mount
+	UniMountTree *node = mounttree.find(mountpath(key));
         WvStringTable t(10);
-	for (i.rewind(); i.next(); )
+	if (node)
 	{
-	    if (key.numsegments() < i->key.numsegments()
-	      && key.suborsame(i->key))
-            {
-                // trim off any stray segments coming between the virtual
-                // "key" we're iterating over and the mount
-                UniConfKey k1 = i->key.first(key.numsegments() + 1);
-                UniConfKey k2 = k1.last(); // final "key" should be size 1
-
-                if (!t[k2])
-                    t.add(new WvString(k2), true);
-            }
+	    UniMountTree::Iter i(*node);
+	    for (i.rewind(); i.next(); )
+		t.add(new WvString(i->key()), true);
 	}
         WvStringTable::Sorter s(t, &::wvstrcmp);
         for (s.rewind(); s.next();)
@@ -360,44 +424,41 @@ IUniConfGen::Iter *UniMountGen::recursiveiterator(const UniConfKey &key)
 
 UniMountGen::UniGenMount *UniMountGen::findmount(const UniConfKey &key)
 {
-    // Find the needed generator and keep it as a lastfound
-    MountList::Iter i(mounts);
-    for (i.rewind(); i.next(); )
+    // Of everything mounted on the way down to the key, the newest one
+    // wins.  (Usually that's the innermost one too, but if someone
+    // mounted something on top of an existing mount, it hides it.)
+    UniMountTree *node = &mounttree;
+    UniGenMount *found = node->here.isempty() ? NULL : node->here.first();
+    
+    UniConfKey::Iter i(key);
+    for (i.rewind(); i.next() && node->count; )
     {
-        if (i->key.suborsame(key))
-	    return i.ptr();
-    } 
+	node = node->findchild(i());
+	if (!node)
+	    break;
+	if (!node->here.isempty()
+	  && (!found || node->here.first()->serial > found->serial))
+	    found = node->here.first();
+    }
 
-    return NULL;
+    return found;
 }
 
 
 UniMountGen::UniGenMount *UniMountGen::findmountunder(const UniConfKey &key)
 {
-    UniMountGen::UniGenMount * foundmount = NULL;
-    int num_found_mounts = 0;
-
-    // Find the needed generator and keep it as a lastfound
-    MountList::Iter i(mounts);
-    for (i.rewind(); i.next(); )
-    {
-        // key lies beneath mount (only care about the first)
-        if (i->key.suborsame(key) && !foundmount)
-        {
-            foundmount = i.ptr();
-            num_found_mounts++;
-        }
-        // mount lies beneath key
-        else if (key.suborsame(i->key))
-        {
-            num_found_mounts++;
-        }
-    }
-
-    if (num_found_mounts == 1 && foundmount)
-        return foundmount;
+    UniGenMount *found = findmount(key);
+    if (!found)
+	return NULL;
 
-    return NULL;
+    // it's the only one unless something else is mounted at or below key
+    UniMountTree *node = mounttree.find(mountpath(key));
+    size_t under = node ? node->count : 0;
+    if (under && mountpath(found->key).numsegments()
+		     == mountpath(key).numsegments())
+	under--; // that's the one we found
+    
+    return under ? NULL : found;
 }
 
 
@@ -432,3 +493,63 @@ void UniMountGen::makemount(const UniConfKey &key)
     if (found->gen->get(trimkey(found->key, key)).isnull())
         found->gen->set(trimkey(found->key, key), "");
 }
+
+
+void UniMountGen::index(UniGenMount *mount)
+{
+    UniMountTree *node = &mounttree;
+    node->count++;
+
+    UniConfKey path(mountpath(mount->key));
+    UniConfKey::Iter i(path);
+    for (i.rewind(); i.next(); )
+    {
+	// serials only go up, so this one is the newest of the lot
+	node->subnewest = mount->serial;
+
+	UniMountTree *child = node->findchild(i());
+	if (!child)
+	    child = new UniMountTree(node, i());
+	node = child;
+	node->count++;
+    }
+
+    node->here.prepend(mount, false);
+}
+
+
+void UniMountGen::unindex(UniGenMount *mount)
+{
+    UniMountTree *node = mounttree.find(mountpath(mount->key));
+    assert(node);
+
+    MountList::Iter i(node->here);
+    for (i.rewind(); i.next(); )
+    {
+	if (i.ptr() == mount)
+	{
+	    i.xunlink();
+	    break;
+	}
+    }
+
+    // fix up the nodes on the way back to the root, dropping the ones
+    // that don't lead to any mounts anymore
+    while (node)
+    {
+	UniMountTree *parent = node->parent();
+
+	node->count--;
+	node->subnewest = 0;
+	UniMountTree::Iter child(*node);
+	for (child.rewind(); child.next(); )
+	{
+	    if (child->newest() > node->subnewest)
+		node->subnewest = child->newest();
+	}
+
+	if (!node->count && parent)
+	    delete node;
+	node = parent;
+    }
+}
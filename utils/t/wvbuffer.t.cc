@@ -157,3 +157,34 @@ WVTEST_MAIN("wvdynbuf big lines")
     WVPASS(*buf.get(4096) == '1');
 }
 
+
+
+WVTEST_MAIN("strchr and match across chunks")
+{
+    WvDynBuf buf;
+    
+    // make sure the data is spread over more than one chunk
+    for (int i = 0; i < 5; i++)
+    {
+        WvDynBuf chunk;
+        chunk.putstr("    abcd");
+        buf.merge(chunk);
+    }
+    buf.putstr("x;y");
+    WVPASSEQ(buf.used(), 43);
+    
+    WVPASSEQ(buf.strchr('a'), 5);
+    WVPASSEQ(buf.strchr('a', 5), 13);
+    WVPASSEQ(buf.strchr('a', 37), 0);
+    WVPASSEQ(buf.strchr(';'), 42);
+    WVPASSEQ(buf.strchr(';', 40), 42);
+    WVPASSEQ(buf.strchr('z'), 0);
+    WVPASSEQ(buf.strchr(';', 43), 0);
+    
+    WVPASSEQ(buf.match(" "), 4);
+    WVPASSEQ(buf.match(" abcd"), 40);
+    WVPASSEQ(buf.notmatch("a"), 4);
+    WVPASSEQ(buf.notmatch("xy"), 40);
+    WVPASSEQ(buf.notmatch("z"), 43);
+    WVPASSEQ(buf.notmatch("z;"), 41);
+}
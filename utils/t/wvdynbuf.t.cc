@@ -129,3 +129,60 @@ WVTEST_MAIN("dynbuf contiguous getting")
     }
 }
 
+
+
+WVTEST_MAIN("DynBuf chunk cache")
+{
+    WvLinkedBufferStore::pool_flush();
+    WvBufStorePoolStats before = WvLinkedBufferStore::pool_stats();
+    WVPASSEQ(before.cached, 0);
+    WVPASSEQ(before.cached_bytes, 0);
+
+    // a buffer's chunk goes back to the cache when it's destroyed...
+    {
+        WvDynBuf b;
+        b.putstr("hello");
+    }
+    WvBufStorePoolStats s = WvLinkedBufferStore::pool_stats();
+    WVPASSEQ(s.misses, before.misses + 1);
+    WVPASSEQ(s.cached, 1);
+    WVPASSEQ(s.cached_bytes, 1024);
+
+    // ...and the next buffer gets it back
+    {
+        WvDynBuf b;
+        b.putstr("hello again");
+        WVPASSEQ(WvLinkedBufferStore::pool_stats().hits, before.hits + 1);
+        WVPASSEQ(WvLinkedBufferStore::pool_stats().cached, 0);
+        WVPASSEQ(b.getstr(), "hello again");
+        b.putstr("x");
+        WVPASSEQ(b.getstr(), "x");
+    }
+    s = WvLinkedBufferStore::pool_stats();
+    WVPASSEQ(s.misses, before.misses + 1);
+    WVPASSEQ(s.cached, 1);
+
+    // big chunks aren't cached
+    {
+        WvDynBuf b;
+        b.alloc(200000);
+    }
+    WVPASSEQ(WvLinkedBufferStore::pool_stats().cached, 1);
+
+    WvLinkedBufferStore::pool_flush();
+    WVPASSEQ(WvLinkedBufferStore::pool_stats().cached, 0);
+}
+
+
+#if __cplusplus >= 201103L
+WVTEST_MAIN("DynBuf move")
+{
+    WvDynBuf a(16);
+    for (int i = 0; i < 10; i++)
+        a.putstr("0123456789");
+    WvDynBuf b(std::move(a));
+    WVPASSEQ(a.used(), 0);
+    WVPASSEQ(b.used(), 100);
+    WVPASSEQ(b.getstr(10), "0123456789");
+}
+#endif
@@ -0,0 +1,137 @@
+#include "wvtest.h"
+#include "wvflathash.h"
+#include "wvstring.h"
+
+
+DeclareWvFlatTable2(TestFlat, WvString);
+
+struct IntStr
+{
+    int i;
+    WvString s;
+    IntStr(int _i) : i(_i), s(_i) { }
+};
+
+DeclareWvFlatDict(IntStr, int, i);
+
+static int intcmp(const IntStr *a, const IntStr *b)
+{
+    return a->i - b->i;
+}
+
+
+WVTEST_MAIN("flathash basics")
+{
+    TestFlat h;
+    WVPASS(h.isempty());
+    WVFAIL(h.count());
+    
+    WvString s("foo");
+    
+    h.add(new WvString(s), true);
+    WVPASSEQ(h.count(), 1);
+    WVPASSEQ(*h[s], "foo");
+    WVFAIL(h["bar"]);
+    h.remove(&s); // not the same object we added, but compares equal
+    WVPASS(h.isempty());
+    WVFAIL(h[s]);
+}
+
+
+WVTEST_MAIN("flathash grows")
+{
+    // a tiny size hint doesn't stop us from adding lots of elements
+    IntStrDict d(1);
+    const int size = 10000;
+    for (int i = 0; i < size; i++)
+	d.add(new IntStr(i), true);
+    WVPASSEQ(d.count(), size);
+    WVPASSEQ(d.slowcount(), size);
+    
+    int found = 0;
+    for (int i = 0; i < size; i++)
+	if (d[i] && d[i]->s == WvString(i))
+	    found++;
+    WVPASSEQ(found, size);
+    WVFAIL(d[size]);
+    
+    // removing and re-adding fills the deleted slots without losing any
+    for (int round = 0; round < 5; round++)
+    {
+	for (int i = 0; i < size; i += 2)
+	    d.remove(d[i]);
+	WVPASSEQ(d.count(), size / 2);
+	WVFAIL(d[0]);
+	WVPASS(d[1]);
+	for (int i = 0; i < size; i += 2)
+	    d.add(new IntStr(i), true);
+	WVPASSEQ(d.count(), size);
+    }
+    found = 0;
+    for (int i = 0; i < size; i++)
+	if (d[i] && d[i]->i == i)
+	    found++;
+    WVPASSEQ(found, size);
+    
+    d.zap();
+    WVPASS(d.isempty());
+    WVFAIL(d[1]);
+}
+
+
+WVTEST_MAIN("flathash autofree")
+{
+    TestFlat h(100);
+    WvString *test1 = new WvString("test1");
+    h.add(test1, false);
+    WVFAIL(h.get_autofree(test1));
+    h.set_autofree(test1, true);
+    WVPASS(h.get_autofree(test1));
+    h.set_autofree(WvString("test1"), false);
+    WVFAIL(h.get_autofree(test1));
+    h.set_autofree(test1, true);
+    h.zap();
+    WVPASS(h.isempty());
+}
+
+
+WVTEST_MAIN("flathash Iter")
+{
+    const int size = 100;
+    IntStrDict d;
+    for (int i = 0; i < size; i++)
+	d.add(new IntStr(i), true);
+    
+    int seen[size], total = 0;
+    memset(seen, 0, sizeof(seen));
+    IntStrDict::Iter i(d);
+    for (i.rewind(); i.next(); )
+    {
+	seen[i->i]++;
+	total++;
+	
+	// removing the current element while iterating is fine
+	if (i->i % 3 == 0)
+	    d.remove(i.ptr());
+    }
+    WVPASSEQ(total, size);
+    int once = 0;
+    for (int n = 0; n < size; n++)
+	if (seen[n] == 1)
+	    once++;
+    WVPASSEQ(once, size);
+    WVPASSEQ(d.count(), size - (size + 2) / 3);
+    
+    // sorting works too
+    IntStrDict::Sorter s(d, intcmp);
+    int last = -1;
+    bool sorted = true;
+    for (s.rewind(); s.next(); )
+    {
+	if (s->i <= last)
+	    sorted = false;
+	last = s->i;
+    }
+    WVPASS(sorted);
+    WVPASSEQ(last, 98); // 99 was removed
+}
@@ -268,3 +268,186 @@ WVTEST_MAIN("listtest.cc")
         j++;
     }
 }
+
+
+#if __cplusplus >= 201103L
+WVTEST_MAIN("append_new")
+{
+    WvStringList l;
+    WvString *s = l.append_new("%s-%s", "one", 2);
+    l.prepend_new("zero");
+    l.append_new();
+    WVPASSEQ(l.count(), 3);
+    WVPASSEQ(*s, "one-2");
+    WVPASSEQ(*l.first(), "zero");
+    WVPASS(l.last()->isnull());
+    WVPASSEQ(l.join(","), "zero,one-2,");
+}
+#endif
+
+
+class Item
+{
+public:
+    int n;
+    static int deleted;
+    
+    Item(int _n) : n(_n) { }
+    ~Item() { deleted++; }
+    
+    WvEmbeddedLink listlink;
+};
+
+int Item::deleted = 0;
+
+DeclareWvIntrusiveList(Item, listlink);
+
+static int itemcmp(const Item *a, const Item *b)
+{
+    return b->n - a->n;
+}
+
+
+WVTEST_MAIN("intrusive list")
+{
+    Item *a = new Item(1), *b = new Item(2), *c = new Item(3);
+    Item::deleted = 0;
+    
+    // a list uses the item's own link when it's free
+    ItemList l1;
+    l1.append(a, true);
+    l1.append(b, true);
+    l1.prepend(c, true);
+    WVPASSEQ(l1.count(), 3);
+    WVPASS(l1.first() == c);
+    WVPASS(l1.last() == b);
+    WVFAIL(a->listlink.available());
+    
+    ItemList::Iter i(l1);
+    int out[3] = {3, 1, 2}, j = 0;
+    for (i.rewind(); i.next(); j++)
+    {
+        WVPASSEQ(i->n, out[j]);
+        WVPASS(i.cur() == &i->listlink);
+    }
+    
+    // when it's busy, it's just a normal list
+    ItemList l2;
+    l2.append(a, true);
+    l2.append(a, false);
+    WVPASSEQ(l2.count(), 2);
+    ItemList::Iter i2(l2);
+    for (i2.rewind(); i2.next(); )
+    {
+        WVPASS(i2.ptr() == a);
+        WVPASS(i2.cur() != &a->listlink);
+    }
+    l2.zap(false);
+    
+    // once it's unlinked, the item's link can be used again
+    l1.unlink(a);
+    WVPASSEQ(Item::deleted, 1);
+    a = new Item(1);
+    WVPASS(a->listlink.available());
+    WVPASSEQ(l1.count(), 2);
+    WVPASS(l1.last() == b);
+    l2.append(a, false);
+    WVFAIL(a->listlink.available());
+    WVPASS(l2.first() == a);
+    l2.zap();
+    WVPASS(a->listlink.available());
+    l2.append(a, true);
+    WVPASS(l2.first() == a);
+    WVFAIL(a->listlink.available());
+    l2.zap(false);
+    WVPASS(a->listlink.available());
+    WVPASSEQ(Item::deleted, 1);
+    
+    // removing while iterating, and the sorter, work as usual
+    l1.append(a, true);
+    for (i.rewind(); i.next(); )
+        if (i->n == 1)
+            i.xunlink(false);
+    WVPASSEQ(l1.count(), 2);
+    WVPASS(a->listlink.available());
+    l1.append(a, true);
+    ItemList::Sorter s(l1, itemcmp);
+    j = 3;
+    for (s.rewind(); s.next(); j--)
+        WVPASSEQ(s->n, j);
+    WVPASSEQ(Item::deleted, 1);
+    l1.zap();
+    WVPASSEQ(Item::deleted, 4);
+    
+    // the list still deletes what it owns when it goes away
+    Item::deleted = 0;
+    {
+        ItemList l3;
+        for (int k = 0; k < 10; k++)
+            l3.append(new Item(k), true);
+        l3.unlink_first();
+        WVPASSEQ(Item::deleted, 1);
+    }
+    WVPASSEQ(Item::deleted, 10);
+}
+
+
+WVTEST_MAIN("intrusive list - whatever the static type")
+{
+    Item *a = new Item(1);
+    ItemList l1;
+    WvList<Item> &base = l1;
+    
+    // adding through a plain WvList reference still uses the item's link
+    base.append(a, true);
+    WVFAIL(a->listlink.available());
+    WVPASS(l1.first() == a);
+    base.unlink(a);
+    
+    // plain lists never do
+    WvList<Item> plain;
+    a = new Item(1);
+    plain.append(a, true);
+    WVPASS(a->listlink.available());
+    WVPASS(plain.head.next != &a->listlink);
+}
+
+
+WVTEST_MAIN("intrusive list - items destroyed while in a list")
+{
+    Item::deleted = 0;
+    Item *a = new Item(1), *b = new Item(2), *c = new Item(3);
+    ItemList l;
+    l.append(a, false);
+    l.append(b, false);
+    l.append(c, false);
+    WVPASS(l.head.next == &a->listlink);
+    
+    // an item that goes away while it's in a list that doesn't own it
+    // takes itself out, wherever it is in the list
+    delete b;
+    WVPASSEQ(l.count(), 2);
+    WVPASS(l.first() == a);
+    WVPASS(l.last() == c);
+    delete c;
+    WVPASSEQ(l.count(), 1);
+    WVPASS(l.last() == a);
+    l.append(c = new Item(3), false);
+    WVPASS(l.last() == c);
+    delete a;
+    WVPASS(l.first() == c);
+    delete c;
+    WVPASS(l.isempty());
+    WVPASS(l.tail == &l.head);
+    WVPASSEQ(Item::deleted, 4);
+    
+    // but only from the list it's actually in
+    ItemList l2;
+    a = new Item(1);
+    l.append(a, false);
+    l2.append(a, false);
+    WVPASS(l2.head.next != &a->listlink);
+    l2.zap();
+    delete a;
+    WVPASS(l.isempty());
+}
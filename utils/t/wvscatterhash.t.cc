@@ -106,3 +106,95 @@ WVTEST_MAIN("scatter hashing Iter")
     WVPASS(scatterHash.isempty());
     WVPASS(scatterHash.count() == 0);
 }
+
+
+// counts the rehashing done while resizing
+class CountingScatter : public TestScatter
+{
+public:
+    unsigned hashes;
+    
+    CountingScatter() : hashes(0) { }
+    unsigned slots() const { return numslots; }
+    bool resizing() const { return oldslots != NULL; }
+    
+protected:
+    virtual unsigned do_hash(const void *data)
+        { hashes++; return TestScatter::do_hash(data); }
+};
+
+
+WVTEST_MAIN("scatter hashing incremental resize")
+{
+    const int size = 100000;
+    WvString **strings = new WvString*[size];
+    for (int i = 0; i < size; i++)
+        strings[i] = new WvString("Test%s", i);
+    
+    // once the table is big, no add() ever does more than a few slots'
+    // worth of rehashing
+    CountingScatter h;
+    unsigned maxhashes = 0, resizes = 0;
+    bool found = true, counted = true;
+    for (int i = 0; i < size; i++)
+    {
+        unsigned before = h.hashes;
+        bool was_resizing = h.resizing();
+        bool big = h.slots() >= INCREMENTAL_SLOTS;
+        h.add(strings[i], true);
+        if (big && h.hashes - before > maxhashes)
+            maxhashes = h.hashes - before;
+        if (h.resizing() && !was_resizing)
+            resizes++;
+        
+        // everything is still there halfway through a resize
+        if (h.resizing() && (i % 1000) == 0)
+        {
+            for (int j = 0; j <= i; j += 7)
+                if (h[*strings[j]] != strings[j])
+                    found = false;
+            
+            int seen = 0;
+            TestScatter::Iter it(h);
+            for (it.rewind(); it.next(); )
+                seen++;
+            if (seen != i + 1)
+                counted = false;
+        }
+    }
+    WVPASS(found);
+    WVPASS(counted);
+    WVPASS(resizes > 3);
+    WVPASS(maxhashes <= MIGRATE_SLOTS);
+    WVPASSEQ(h.count(), size);
+    WVPASSEQ(h.slowcount(), size);
+    for (int i = 0; i < size; i++)
+        if (h[*strings[i]] != strings[i])
+            found = false;
+    WVPASS(found);
+    
+    // removing most things shrinks the table once we add more
+    unsigned bigslots = h.slots();
+    for (int i = 100; i < size; i++)
+        h.remove(strings[i]);
+    WVPASSEQ(h.count(), 100);
+    for (int i = 0; i < 1000; i++)
+        h.add(new WvString("More%s", i), true);
+    WVPASS(h.slots() < bigslots / 4);
+    WVPASSEQ(h.count(), 1100);
+    WVPASSEQ(h.slowcount(), 1100);
+    for (int i = 0; i < 100; i++)
+        if (h[*strings[i]] != strings[i])
+            found = false;
+    WVPASS(found);
+    
+    // compact() does it right away
+    for (int i = 0; i < 1000; i++)
+        h.remove(h[WvString("More%s", i)]);
+    h.compact();
+    WVFAIL(h.resizing());
+    WVPASS(h.slots() < 1000);
+    WVPASSEQ(h.slowcount(), 100);
+    
+    delete[] strings;
+}
@@ -125,3 +125,97 @@ WVTEST_MAIN("sorttest.cc")
 	}	
     }
 }
+
+
+static int compares;
+
+// compares only the first letter, so lots of things are equal
+static int first_letter(const WvString *a, const WvString *b)
+{
+    compares++;
+    return (*a)[0] - (*b)[0];
+}
+
+
+WVTEST_MAIN("stable and cached sorting")
+{
+    const char *unsorted[8] = {"six", "one", "seven", "two", "five",
+        "three", "ten", "four"};
+    const char *stable[8] = {"five", "four", "one", "six", "seven",
+        "two", "three", "ten"};
+    WvStringList l;
+    for (int i = 0; i < 8; i++)
+        l.append(new WvString(unsorted[i]), true);
+    
+    // equal elements stay in list order
+    WvStringList::Sorter s(l, first_letter, true);
+    int i = 0;
+    for (s.rewind(); s.next(); i++)
+        WVPASSEQ(*s, stable[i]);
+    WVPASSEQ(i, 8);
+    
+    // a sorted list only takes one compare per element to check
+    WvStringList sorted;
+    for (i = 0; i < 8; i++)
+        sorted.append(new WvString(stable[i]), true);
+    WvStringList::Sorter s2(sorted, first_letter, true);
+    compares = 0;
+    s2.rewind();
+    WVPASSEQ(compares, 7);
+    
+    // rewinding a cached sorter doesn't sort again unless the list changed
+    s.set_cache(true);
+    s.rewind();
+    compares = 0;
+    s.rewind();
+    WVPASSEQ(compares, 0);
+    for (i = 0; s.next(); i++)
+        WVPASSEQ(*s, stable[i]);
+    WVPASSEQ(i, 8);
+    
+    l.append(new WvString("eight"), true);
+    s.rewind();
+    WVPASS(compares > 0);
+    s.next();
+    WVPASSEQ(*s, "eight");
+    compares = 0;
+    s.invalidate();
+    s.rewind();
+    WVPASS(compares > 0);
+    
+    // an empty list is fine too
+    WvStringList empty;
+    WvStringList::Sorter s3(empty, first_letter);
+    s3.rewind();
+    WVFAIL(s3.next());
+}
+
+
+static WvStringList *inner;
+
+// sorts another list in the middle of sorting
+static int nested(const WvString *a, const WvString *b)
+{
+    WvStringList::Sorter s(*inner, oranges_to_apples);
+    s.rewind();
+    s.next();
+    return strcmp(*a, *b);
+}
+
+
+WVTEST_MAIN("reentrant sorting")
+{
+    WvStringList l, l2;
+    l.append(new WvString("b"), true);
+    l.append(new WvString("c"), true);
+    l.append(new WvString("a"), true);
+    l2.append(new WvString("x"), true);
+    l2.append(new WvString("y"), true);
+    inner = &l2;
+    
+    WvStringList::Sorter s(l, nested);
+    WvString out;
+    for (s.rewind(); s.next(); )
+        out.append(*s);
+    WVPASSEQ(out, "abc");
+}
@@ -61,13 +61,21 @@ WVTEST_MAIN("copying")
     
     // if we didn't crash yet, we're halfway there!
     
-    // equivalent pointers
-    WVPASS(e1+0 == e2+0);
-    WVPASS(e1.edit()+0 != e2+0);
+    // short strings are stored in the object, so copies are separate
+    WVPASS(e1+0 != e2+0);
+    WVPASS(e1.is_unique());
     const char *olde1 = e1;
     { WvString x(e1); } // copy and destroy
     WVPASS(e1.edit() == olde1); // no unnecessary copies
     
+    // but long ones are shared until you edit them
+    WvString j1("a string too long to keep inside a WvString"), j2(j1);
+    WVPASS(j1+0 == j2+0);
+    WVPASS(j1.edit()+0 != j2+0);
+    const char *oldj1 = j1;
+    { WvString x(j1); } // copy and destroy
+    WVPASS(j1.edit() == oldj1); // no unnecessary copies
+    
     // make sure values are equivalent
     WVPASS(a1 == a2);
     WVPASS(b1 == b2);
@@ -88,6 +96,89 @@ WVTEST_MAIN("copying")
 }
 
 
+WVTEST_MAIN("short strings")
+{
+    WvString a("short"), b(a), c, d(12345), e(WvString("%s-%s", 1, 2));
+    
+    // assigning copies the characters, so nothing points at a dead string
+    {
+        WvString tmp("temporary");
+        c = tmp;
+    }
+    WVPASSEQ(c, "temporary");
+    c = c.offset(4);
+    WVPASSEQ(c, "orary");
+    b.edit()[0] = 'S';
+    WVPASSEQ(a, "short");
+    WVPASSEQ(b, "Short");
+    WVPASSEQ(d, "12345");
+    WVPASSEQ(e, "1-2");
+    
+    // strings right at the limit, and just past it
+    WvString fits("%s", WvString("%23s", "x"));
+    WvString toobig("%s", WvString("%24s", "x"));
+    WVPASSEQ(fits.len(), 23);
+    WVPASSEQ(toobig.len(), 24);
+    WvString fits2(fits), toobig2(toobig);
+    WVPASS(fits2.cstr() != fits.cstr());
+    WVPASS(toobig2.cstr() == toobig.cstr());
+    WVPASSEQ(fits2, fits);
+    WVPASSEQ(toobig2, toobig);
+    
+    // a WvFastString copy of a short string doesn't copy it
+    WvFastString f(a);
+    WVPASS(f.cstr() == a.cstr());
+    WvString g(f);
+    WVPASS(g.cstr() != a.cstr());
+    WVPASSEQ(g, "short");
+}
+
+
+WVTEST_MAIN("append in place")
+{
+    WvString a("x"), b;
+    const char *olda = a;
+    for (int i = 0; i < 10; i++)
+        a.append("y");
+    WVPASSEQ(a, "xyyyyyyyyyy");
+    WVPASS(a.cstr() == olda); // still fits inside the object
+    
+    // once it's bigger, appends mostly reuse the spare room
+    int moves = 0;
+    for (int i = 0; i < 1000; i++)
+    {
+        olda = a;
+        a.append("0123456789");
+        if (a.cstr() != olda)
+            moves++;
+    }
+    WVPASSEQ(a.len(), 10011);
+    WVPASS(moves < 15);
+    
+    // but never change a buffer somebody else is using
+    b = a;
+    a.append("z");
+    WVPASSEQ(b.len(), 10011);
+    WVPASSEQ(a.len(), 10012);
+    
+    // appending ourselves
+    WvString c("abc");
+    c.append(c);
+    WVPASSEQ(c, "abcabc");
+    c.append(c.offset(3));
+    WVPASSEQ(c, "abcabcabc");
+    
+#if __cplusplus >= 201103L
+    WvString d(std::move(a));
+    WVPASSEQ(d.len(), 10012);
+    WVPASS(a.isnull());
+    a = std::move(c);
+    WVPASSEQ(a, "abcabcabc");
+    WVPASS(c.isnull());
+#endif
+}
+
+
 WVTEST_MAIN("append")
 {
     WvString a, b, c(""), d("hello");
@@ -144,6 +235,41 @@ WVTEST_MAIN("fancy formatting")
     WVPASS(WvString("%-6.3s", "hello") == "hel   ");
     WVPASS(WvString("%6.3s", "hello") == "   hel");
     WVPASS(WvString("%6.3s", "a") == "     a");
+    WVPASS(WvString("%10.2s", "hello") == "        he");
+    WVPASS(WvString("%05s", 42) == "00042");
+    WVPASS(WvString("a%db%s", "x") == "abx");
+    WVPASSEQ(WvString("a%-5.2fb%s", "x"), "abx");
+    WVPASSEQ(WvString("%s%", "x"), "x");
+    WVPASS(WvString("%s", WvString()) == "(nil)");
+}
+
+
+WVTEST_MAIN("long format strings")
+{
+    // enough pieces that the formatter has to take its slow path
+    WvString format(""), expect("");
+    for (int i = 0; i < 20; i++)
+    {
+        format.append("<%s>%%");
+        expect.append("<%s>%%", i);
+    }
+    WvString x(format, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+               15, 16, 17, 18, 19);
+    WVPASSEQ(x, expect);
+    
+    // unknown conversions come out the same way as on the fast path
+    format = "a%db";
+    expect = "ab";
+    for (int i = 0; i < 19; i++)
+    {
+        format.append("<%s>%%");
+        expect.append("<%s>%%", i);
+    }
+    format.append("%s%");
+    expect.append("x");
+    WvString y(format, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+               15, 16, 17, 18, "x");
+    WVPASSEQ(y, expect);
 }
 
 
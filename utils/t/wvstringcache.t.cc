@@ -0,0 +1,148 @@
+#include "wvtest.h"
+#include "wvstringcache.h"
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+static const char *longstr = "a string that is too long to fit inline";
+
+
+WVTEST_MAIN("sharing")
+{
+    WvStringCache cache;
+    
+    // long strings come back sharing one buffer
+    WvString a(cache.get(WvString(longstr)));
+    WvString b(cache.get(longstr));
+    WVPASSEQ(a, longstr);
+    WVPASSEQ(b, longstr);
+    WVPASS(a.cstr() == b.cstr());
+    
+    // ...which nobody can change behind our backs
+    b.edit()[0] = 'A';
+    WVPASSEQ(a, longstr);
+    WVPASS(a.cstr() != b.cstr());
+    
+    // short ones are just copied
+    WvString c(cache.get("short")), d(cache.get("short"));
+    WVPASSEQ(c, "short");
+    WVPASS(c.cstr() != d.cstr());
+    
+    WVPASS(cache.get(WvString::null).isnull());
+}
+
+
+WVTEST_MAIN("cleanup")
+{
+    WvStringCache cache;
+    WvString keep(cache.get(longstr));
+    cache.clean();
+    size_t before = WvStringCache::stats().strings;
+    
+    {
+	WvString tmp(cache.get(WvString("%s (temporary)", longstr)));
+	WVPASSEQ(WvStringCache::stats().strings, before + 1);
+    }
+    cache.clean();
+    WVPASSEQ(WvStringCache::stats().strings, before);
+    
+    // strings we're still using stay put
+    WVPASS(cache.get(longstr).cstr() == keep.cstr());
+    
+    // unused strings get dropped as we go, without calling clean()
+    for (int i = 0; i < 10000; i++)
+	cache.get(WvString("%s %s", longstr, i));
+    WVPASS(WvStringCache::stats().strings < before + 10000);
+}
+
+
+// strings that haven't been moved to the new table yet while a shard is
+// being resized still get cleaned up
+WVTEST_MAIN("cleanup while resizing")
+{
+    WvStringCache cache;
+    cache.clean();
+    size_t before = WvStringCache::stats().strings;
+    
+    const int count = 40000;
+    WvString *keep = new WvString[count];
+    int kept = 0, wrong = 0;
+    for (int i = 0; i < count; i++)
+    {
+	keep[i] = cache.get(WvString("%s %s (resizing)", longstr, i));
+	kept++;
+	if (i % 1000 != 999)
+	    continue;
+	
+	// let go of some of the older strings, which are the ones that
+	// might still be in the old table
+	for (int j = i % 7000; j < i; j += 37)
+	{
+	    if (!keep[j].isnull())
+	    {
+		keep[j] = WvString::null;
+		kept--;
+	    }
+	}
+	cache.clean();
+	if (WvStringCache::stats().strings != before + kept)
+	    wrong++;
+    }
+    WVPASSEQ(wrong, 0);
+    
+    delete[] keep;
+    cache.clean();
+    WVPASSEQ(WvStringCache::stats().strings, before);
+}
+
+
+WVTEST_MAIN("stats")
+{
+    WvStringCache cache;
+    WvStringCacheStats st1 = WvStringCache::stats();
+    
+    WvString s[10];
+    for (int i = 0; i < 10; i++)
+	s[i] = cache.get(WvString("%s (stats)", longstr));
+    
+    WvStringCacheStats st2 = WvStringCache::stats();
+    WVPASSEQ(st2.lookups - st1.lookups, 10);
+    WVPASSEQ(st2.hits - st1.hits, 9);
+    WVPASS(st2.bytes > st1.bytes);
+    WVPASS(st2.saved - st1.saved >= 9 * strlen(longstr));
+}
+
+
+#ifndef _WIN32
+
+static void *getter(void *_cache)
+{
+    WvStringCache *cache = (WvStringCache *)_cache;
+    WvString keep[20];
+    for (int i = 0; i < 20000; i++)
+    {
+	WvString s(cache->get(WvString("%s %s", longstr, i % 50)));
+	if (s != WvString("%s %s", longstr, i % 50))
+	    return (void *)1;
+	keep[i % 20] = s;
+    }
+    return NULL;
+}
+
+
+WVTEST_MAIN("threads")
+{
+    WvStringCache cache;
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++)
+	WVPASS(!pthread_create(&threads[i], NULL, getter, &cache));
+    for (int i = 0; i < 4; i++)
+    {
+	void *ret = (void *)1;
+	pthread_join(threads[i], &ret);
+	WVPASS(!ret);
+    }
+    cache.clean();
+}
+
+#endif // _WIN32
@@ -0,0 +1,121 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2003 Net Integration Technologies, Inc.
+ *
+ * Compares WvHashTable, WvScatterHash and WvFlatHash doing what
+ * stresshashtest does: add a lot of elements, look them up, remove some,
+ * and iterate through the rest.
+ */
+#include "wvhashtable.h"
+#include "wvscatterhash.h"
+#include "wvflathash.h"
+#include "wvstring.h"
+#include "wvtimeutils.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+struct Intstr
+{
+    int i;
+    WvString s;
+    
+    Intstr(int _i, WvStringParm _s)
+        { i = _i; s = _s; }
+};
+
+DeclareWvDict2(ChainedDict, Intstr, WvString, s);
+DeclareWvScatterDict2(ScatterDict, Intstr, WvString, s);
+DeclareWvFlatDict2(FlatDict, Intstr, WvString, s);
+
+static WvString *keys;
+static WvTime start;
+
+
+static void begin()
+{
+    start = wvtime();
+}
+
+
+// print the nanoseconds per operation, for 'n' operations since begin()
+static void end(unsigned n)
+{
+    WvTime t = tvdiff(wvtime(), start);
+    printf("%12.1f", (t.tv_sec * 1e9 + t.tv_usec * 1e3) / n);
+    fflush(stdout);
+}
+
+
+template <class Dict>
+static void run(const char *name, unsigned hint, unsigned elems)
+{
+    Dict d(hint);
+    Intstr **objs = new Intstr*[elems];
+    for (unsigned i = 0; i < elems; i++)
+	objs[i] = new Intstr(i, keys[i]);
+    
+    printf("%-10s", name);
+    
+    begin();
+    for (unsigned i = 0; i < elems; i++)
+	d.add(objs[i], true);
+    end(elems);
+    
+    unsigned found = 0;
+    begin();
+    for (unsigned r = 0; r < 10; r++)
+	for (unsigned i = 0; i < elems; i++)
+	    found += d[keys[(i * 7919) % elems]] != NULL;
+    end(elems * 10);
+    
+    WvString missing("not a key");
+    begin();
+    for (unsigned r = 0; r < elems * 10; r++)
+	found += d[missing] != NULL;
+    end(elems * 10);
+    
+    begin();
+    for (unsigned i = 0; i < elems; i += 5)
+	d.remove(objs[i]);
+    end(elems / 5);
+    
+    unsigned seen = 0;
+    begin();
+    for (unsigned r = 0; r < 100; r++)
+    {
+	typename Dict::Iter it(d);
+	for (it.rewind(); it.next(); )
+	    seen += it->i & 1;
+    }
+    end(elems * 100);
+    
+    printf("\n");
+    if (!seen || found != elems * 10 || d.count() != elems - (elems + 4) / 5)
+	printf("  ...but it got the wrong answer!\n");
+    delete[] objs;
+}
+
+
+int main(int argc, char **argv)
+{
+    unsigned elems = argc > 1 ? atoi(argv[1]) : 100000;
+    
+    keys = new WvString[elems];
+    for (unsigned i = 0; i < elems; i++)
+	keys[i] = WvString("/cfg/net/interface%s/name", i);
+    
+    printf("%u elements, ns per operation\n", elems);
+    const unsigned hints[] = { 1000, elems };
+    for (int h = 0; h < 2; h++)
+    {
+	printf("\nsize hint %u:\n", hints[h]);
+	printf("%-10s%12s%12s%12s%12s%12s\n", "",
+	       "add", "find", "miss", "remove", "iterate");
+	run<ChainedDict>("chained", hints[h], elems);
+	run<ScatterDict>("scatter", hints[h], elems);
+	run<FlatDict>("flat", hints[h], elems);
+    }
+    
+    delete[] keys;
+    return 0;
+}
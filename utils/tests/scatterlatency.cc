@@ -0,0 +1,85 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2003 Net Integration Technologies, Inc.
+ *
+ * Measures how long each WvScatterHash::add() takes while a table grows
+ * to a few million elements, and prints the distribution.  The worst
+ * case is what matters here: an add() that has to resize the table.
+ */
+#include "wvscatterhash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+
+struct IntObj
+{
+    int i;
+};
+
+DeclareWvScatterDict(IntObj, int, i);
+
+
+static long long nsec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+int main(int argc, char **argv)
+{
+    int elems = argc > 1 ? atoi(argv[1]) : 4000000;
+    
+    IntObj *objs = new IntObj[elems];
+    for (int i = 0; i < elems; i++)
+	objs[i].i = i;
+    long long *times = new long long[elems];
+    
+    IntObjDict d;
+    long long start = nsec();
+    for (int i = 0; i < elems; i++)
+    {
+	long long t = nsec();
+	d.add(&objs[i], false);
+	times[i] = nsec() - t;
+    }
+    long long total = nsec() - start;
+    
+    // then remove most of them, and add them back
+    for (int i = 0; i < elems; i++)
+	if (i % 10)
+	    d.remove(&objs[i]);
+    long long *times2 = new long long[elems];
+    int n2 = 0;
+    for (int i = 0; i < elems; i++)
+	if (i % 10)
+	{
+	    long long t = nsec();
+	    d.add(&objs[i], false);
+	    times2[n2++] = nsec() - t;
+	}
+    
+    printf("%d adds in %lld ms\n", elems, total / 1000000);
+    printf("%-22s%10s%10s%10s%10s%12s\n", "(ns per add)",
+	   "median", "99%", "99.9%", "99.99%", "max");
+    
+    long long *sets[] = { times, times2 };
+    int counts[] = { elems, n2 };
+    const char *names[] = { "growing", "refilling" };
+    for (int s = 0; s < 2; s++)
+    {
+	long long *t = sets[s];
+	int n = counts[s];
+	std::sort(t, t + n);
+	printf("%-22s%10lld%10lld%10lld%10lld%12lld\n", names[s],
+	       t[n / 2], t[n / 100 * 99], t[n / 1000 * 999],
+	       t[n / 10000 * 9999], t[n - 1]);
+    }
+    
+    delete[] times;
+    delete[] times2;
+    delete[] objs;
+    return 0;
+}
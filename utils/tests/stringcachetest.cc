@@ -0,0 +1,57 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 2005 Net Integration Technologies, Inc.
+ *
+ * Times WvStringCache::get() from several threads at once, the way a big
+ * config tree would use it: lots of copies of not very many values.
+ */
+#include "wvstringcache.h"
+#include "wvtimeutils.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const int nvalues = 1000;
+static const int gets = 1000000;
+
+static WvStringCache cache;
+static WvString values[nvalues];
+
+
+static void *getter(void *_keep)
+{
+    WvString *keep = (WvString *)_keep;
+    for (int i = 0; i < gets; i++)
+	keep[i % nvalues] = cache.get(values[(i * 7) % nvalues]);
+    return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+    int nthreads = argc > 1 ? atoi(argv[1]) : 4;
+    for (int i = 0; i < nvalues; i++)
+	values[i] = WvString("/cfg/interfaces/eth%s/description", i);
+    
+    // each thread keeps its copies until we've counted them
+    pthread_t *threads = new pthread_t[nthreads];
+    WvString *keep = new WvString[nthreads * nvalues];
+    WvTime start = wvtime();
+    for (int i = 0; i < nthreads; i++)
+	pthread_create(&threads[i], NULL, getter, &keep[i * nvalues]);
+    for (int i = 0; i < nthreads; i++)
+	pthread_join(threads[i], NULL);
+    time_t msec = msecdiff(wvtime(), start);
+    delete[] threads;
+    
+    WvStringCacheStats st = WvStringCache::stats();
+    printf("%d threads: %.1f ns/get\n", nthreads,
+	   msec * 1000000.0 / ((double)gets * nthreads));
+    printf("lookups %lu, hits %lu (%.1f%%)\n", (unsigned long)st.lookups,
+	   (unsigned long)st.hits, st.hits * 100.0 / st.lookups);
+    printf("%lu strings, %lu bytes, %lu bytes saved\n",
+	   (unsigned long)st.strings, (unsigned long)st.bytes,
+	   (unsigned long)st.saved);
+    delete[] keep;
+    return 0;
+}
@@ -5,6 +5,7 @@
  * Specializations of the generic buffering API.
  */
 #include "wvbuf.h"
+#include <string.h>
 
 /***** Specialization for raw memory buffers *****/
 
@@ -43,17 +44,18 @@ WvString WvBufBase<unsigned char>::getstr(size_t len)
 }
 
 
-size_t WvBufBase<unsigned char>::strchr(int ch)
+size_t WvBufBase<unsigned char>::strchr(int ch, size_t offset)
 {
-    size_t offset = 0;
     size_t avail = used();
     while (offset < avail)
     {
+        // memchr() is much faster than a loop, since the C library
+        // checks many bytes at once with whatever SIMD the CPU has
         size_t len = optpeekable(offset);
         const unsigned char *str = peek(offset, len);
-        for (size_t i = 0; i < len; ++i)
-            if (str[i] == ch)
-                return offset + i + 1;
+        const void *found = memchr(str, ch, len);
+        if (found)
+            return offset + ((const unsigned char *)found - str) + 1;
         offset += len;
     }
     return 0;
@@ -63,32 +65,29 @@ size_t WvBufBase<unsigned char>::strchr(int ch)
 size_t WvBufBase<unsigned char>::_match(const void *bytelist,
     size_t numbytes, bool reverse)
 {
+    // looking for a single byte is just strchr()
+    if (reverse && numbytes == 1)
+    {
+        size_t found = strchr(*(const unsigned char *)bytelist);
+        return found ? found - 1 : used();
+    }
+    
+    // otherwise, look each byte up in a table instead of in the list
+    bool inlist[256];
+    memset(inlist, 0, sizeof(inlist));
+    const unsigned char *chlist = (const unsigned char*)bytelist;
+    for (size_t c = 0; c < numbytes; ++c)
+        inlist[chlist[c]] = true;
+    
     size_t offset = 0;
     size_t avail = used();
-    const unsigned char *chlist = (const unsigned char*)bytelist;
     while (offset < avail)
     {
         size_t len = optpeekable(offset);
         const unsigned char *str = peek(offset, len);
         for (size_t i = 0; i < len; ++i)
-        {
-            int ch = str[i];
-            size_t c;
-            for (c = 0; c < numbytes; ++c)
-                if (chlist[c] == ch)
-                    break;
-            if (reverse)
-            {
-                if (c == numbytes)
-                    continue;
-            }
-            else
-            {
-                if (c != numbytes)
-                    continue;
-            }
-            return offset + i;
-        }
+            if (inlist[str[i]] == reverse)
+                return offset + i;
         offset += len;
     }
     return reverse ? offset : 0;
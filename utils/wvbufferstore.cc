@@ -9,6 +9,9 @@
 #include "wvbufstore.h"
 #include <string.h>
 #include <sys/types.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
 /**
  * An abstraction for memory transfer operations.
@@ -734,6 +737,150 @@ void WvCircularBufStore::compact(void *data, size_t size,
 
 
 
+/***** Chunk cache *****/
+
+// cached chunk sizes are powers of two from 1k to 64k
+#define POOL_MIN_SHIFT 10
+#define POOL_MAX_SHIFT 16
+#define POOL_CLASSES (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+
+// don't keep more than this much memory cached in any one size class
+#define POOL_MAX_CLASS_BYTES (256 * 1024)
+
+/** A chunk that goes back into the cache when its buffer is done with it. */
+class WvPooledBufStore : public WvCircularBufStore
+{
+public:
+    int sizeclass;
+    WvPooledBufStore *next_free;
+
+    WvPooledBufStore(int _sizeclass) :
+        WvCircularBufStore(1, (size_t)1 << (_sizeclass + POOL_MIN_SHIFT)),
+        sizeclass(_sizeclass), next_free(NULL)
+        { }
+};
+
+
+struct WvBufStorePool
+{
+    WvPooledBufStore *free[POOL_CLASSES];
+    size_t count[POOL_CLASSES];
+    WvBufStorePoolStats stats;
+};
+
+
+static void pool_flush_one(WvBufStorePool *p)
+{
+    for (int c = 0; c < POOL_CLASSES; c++)
+    {
+        while (p->free[c])
+        {
+            WvPooledBufStore *buf = p->free[c];
+            p->free[c] = buf->next_free;
+            delete buf;
+        }
+        p->count[c] = 0;
+    }
+    p->stats.cached = p->stats.cached_bytes = 0;
+}
+
+
+#ifndef _WIN32
+
+static __thread WvBufStorePool *thread_pool;
+static pthread_key_t pool_key;
+static pthread_once_t pool_key_once = PTHREAD_ONCE_INIT;
+
+// runs when a thread with a cache exits
+static void pool_destroy(void *_p)
+{
+    WvBufStorePool *p = (WvBufStorePool *)_p;
+    pool_flush_one(p);
+    delete p;
+    thread_pool = NULL;
+}
+
+
+static void pool_make_key()
+{
+    pthread_key_create(&pool_key, pool_destroy);
+}
+
+
+static WvBufStorePool *getpool()
+{
+    if (!thread_pool)
+    {
+        pthread_once(&pool_key_once, pool_make_key);
+        thread_pool = new WvBufStorePool;
+        memset(thread_pool, 0, sizeof(*thread_pool));
+        pthread_setspecific(pool_key, thread_pool);
+    }
+    return thread_pool;
+}
+
+#else // _WIN32
+
+// no cache here; every chunk comes from the heap as before
+static WvBufStorePool *getpool()
+{
+    return NULL;
+}
+
+#endif // _WIN32
+
+
+// Returns a cached chunk of at least 'size' bytes, or NULL if chunks that
+// size aren't cached.
+static WvBufStore *pool_get(size_t size)
+{
+    int c = 0;
+    while (((size_t)1 << (c + POOL_MIN_SHIFT)) < size)
+        if (++c >= POOL_CLASSES)
+            return NULL;
+    
+    WvBufStorePool *p = getpool();
+    if (!p)
+        return NULL;
+    WvPooledBufStore *buf = p->free[c];
+    if (!buf)
+    {
+        p->stats.misses++;
+        return new WvPooledBufStore(c);
+    }
+    
+    p->free[c] = buf->next_free;
+    p->count[c]--;
+    p->stats.hits++;
+    p->stats.cached--;
+    p->stats.cached_bytes -= buf->size();
+    buf->zap();
+    return buf;
+}
+
+
+// Puts 'buffer' back in the cache if it came from there, or deletes it.
+static void pool_put(WvBufStore *buffer)
+{
+    WvPooledBufStore *buf = dynamic_cast<WvPooledBufStore *>(buffer);
+    WvBufStorePool *p = buf ? getpool() : NULL;
+    if (!p || (p->count[buf->sizeclass] + 1) * buf->size()
+                > POOL_MAX_CLASS_BYTES)
+    {
+        delete buffer;
+        return;
+    }
+    
+    int c = buf->sizeclass;
+    buf->next_free = p->free[c];
+    p->free[c] = buf;
+    p->count[c]++;
+    p->stats.cached++;
+    p->stats.cached_bytes += buf->size();
+}
+
+
+
 /***** WvLinkedBufferStore *****/
 
 WvLinkedBufferStore::WvLinkedBufferStore(int _granularity) :
@@ -742,6 +889,40 @@ WvLinkedBufferStore::WvLinkedBufferStore(int _granularity) :
 }
 
 
+WvLinkedBufferStore::~WvLinkedBufferStore()
+{
+    // the list would just delete our chunks; give them back to the cache
+    WvBufStoreList::Iter it(list);
+    for (it.rewind(); it.next(); )
+    {
+        WvBufStore *buf = it.ptr();
+        bool autofree = it.get_autofree();
+        it.set_autofree(false);
+        it.xunlink();
+        if (autofree)
+            pool_put(buf);
+    }
+}
+
+
+WvBufStorePoolStats WvLinkedBufferStore::pool_stats()
+{
+    WvBufStorePool *p = getpool();
+    if (p)
+        return p->stats;
+    WvBufStorePoolStats empty = { 0, 0, 0, 0 };
+    return empty;
+}
+
+
+void WvLinkedBufferStore::pool_flush()
+{
+    WvBufStorePool *p = getpool();
+    if (p)
+        pool_flush_one(p);
+}
+
+
 bool WvLinkedBufferStore::usessubbuffers() const
 {
     return true;
@@ -994,6 +1175,12 @@ void *WvLinkedBufferStore::mutablepeek(int offset, size_t count)
 WvBufStore *WvLinkedBufferStore::newbuffer(size_t minsize)
 {
     minsize = roundup(minsize, granularity);
+    if (granularity == 1)
+    {
+        WvBufStore *buf = pool_get(minsize);
+        if (buf)
+            return buf;
+    }
     //return new WvInPlaceBufStore(granularity, minsize);
     return new WvCircularBufStore(granularity, minsize);
 }
@@ -1001,7 +1188,7 @@ WvBufStore *WvLinkedBufferStore::newbuffer(size_t minsize)
 
 void WvLinkedBufferStore::recyclebuffer(WvBufStore *buffer)
 {
-    delete buffer;
+    pool_put(buffer);
 }
 
 
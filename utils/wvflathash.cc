@@ -0,0 +1,233 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2003 Net Integration Technologies, Inc.
+ *
+ * An open-addressing hash table container.  See wvflathash.h.
+ */
+#include "wvflathash.h"
+#include <assert.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+// WvHash() doesn't spread its bits around much (the low ones only depend
+// on the last few characters of a string), and we need both the low bits
+// and the high ones, so stir them up first.
+static inline unsigned mix(unsigned h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+
+// a bitmask of the control bytes in the group at 'ctrl' that equal 'c'
+static inline unsigned match(const signed char *ctrl, signed char c)
+{
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(c)));
+#else
+    unsigned mask = 0;
+    for (int i = 0; i < 16; i++)
+	if (ctrl[i] == c)
+	    mask |= 1 << i;
+    return mask;
+#endif
+}
+
+
+// a bitmask of the empty or deleted slots in the group at 'ctrl'; those
+// are the only control bytes with the high bit set
+static inline unsigned match_free(const signed char *ctrl)
+{
+#ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+    unsigned mask = 0;
+    for (int i = 0; i < 16; i++)
+	if (ctrl[i] < 0)
+	    mask |= 1 << i;
+    return mask;
+#endif
+}
+
+
+WvFlatHashBase::WvFlatHashBase(unsigned _numslots)
+{
+    // leave room to add the suggested number of elements without
+    // rebuilding the table
+    unsigned n = GROUP;
+    while (n / 8 * 7 < _numslots && n < 0x80000000u)
+	n *= 2;
+    alloc(n);
+}
+
+
+void WvFlatHashBase::alloc(unsigned _numslots)
+{
+    numslots = _numslots;
+    xslots = new Slot[numslots];
+    xctrl = new signed char[numslots];
+    xfree = new bool[numslots];
+    memset(xslots, 0, numslots * sizeof(xslots[0]));
+    memset(xctrl, EMPTY, numslots * sizeof(xctrl[0]));
+    memset(xfree, 0, numslots * sizeof(xfree[0]));
+    num = used = 0;
+}
+
+
+size_t WvFlatHashBase::slowcount() const
+{
+    size_t count = 0;
+    for (unsigned i = 0; i < numslots; i++)
+	if (xctrl[i] >= 0)
+	    count++;
+    return count;
+}
+
+
+// Move everything into a fresh table of '_numslots' slots.  That's how we
+// grow, and also how we get rid of deleted slots once there are too many.
+void WvFlatHashBase::rebuild(unsigned _numslots)
+{
+    unsigned oldnumslots = numslots;
+    Slot *oldslots = xslots;
+    signed char *oldctrl = xctrl;
+    bool *oldfree = xfree;
+
+    alloc(_numslots);
+    for (unsigned i = 0; i < oldnumslots; i++)
+	if (oldctrl[i] >= 0)
+	    insert(oldslots[i], do_hash(oldslots[i]), oldfree[i]);
+
+    deletev oldslots;
+    deletev oldctrl;
+    deletev oldfree;
+}
+
+
+// Groups are probed in the order g, g+1, g+3, g+6, ... which, since the
+// number of groups is a power of two, visits every one of them.
+void WvFlatHashBase::insert(void *data, unsigned hash, bool autofree)
+{
+    unsigned h = mix(hash), groupmask = numslots / GROUP - 1;
+    unsigned g = (h >> 7) & groupmask;
+
+    for (unsigned step = 1; ; g = (g + step++) & groupmask)
+    {
+	unsigned mask = match_free(xctrl + g * GROUP);
+	if (mask)
+	{
+	    unsigned slot = g * GROUP + __builtin_ctz(mask);
+	    if (xctrl[slot] == EMPTY)
+		used++;
+	    num++;
+	    xctrl[slot] = h & 0x7f;
+	    xslots[slot] = data;
+	    xfree[slot] = autofree;
+	    return;
+	}
+    }
+}
+
+
+void WvFlatHashBase::_add(void *data, unsigned hash, bool autofree)
+{
+    // keep at least 1/8 of the slots empty, so lookups always end
+    // quickly.  If it's deleted slots that are in the way, we can just
+    // clean them out; otherwise we need more room.
+    if (used + 1 > numslots / 8 * 7)
+	rebuild(num + 1 > numslots / 16 * 7 ? numslots * 2 : numslots);
+    insert(data, hash, autofree);
+}
+
+
+unsigned WvFlatHashBase::genfind(const void *data, unsigned hash) const
+{
+    unsigned h = mix(hash), groupmask = numslots / GROUP - 1;
+    unsigned g = (h >> 7) & groupmask;
+
+    for (unsigned step = 1; step <= groupmask + 1;
+	 g = (g + step++) & groupmask)
+    {
+	const signed char *ctrl = xctrl + g * GROUP;
+	for (unsigned mask = match(ctrl, h & 0x7f); mask; mask &= mask - 1)
+	{
+	    unsigned slot = g * GROUP + __builtin_ctz(mask);
+	    if (compare(data, xslots[slot]))
+		return slot;
+	}
+
+	// if it had been added, it would have gone in this empty slot
+	if (match(ctrl, EMPTY))
+	    break;
+    }
+
+    return null_idx;
+}
+
+
+WvFlatHashBase::Slot WvFlatHashBase::genfind_or_null(const void *data,
+						     unsigned hash) const
+{
+    unsigned slot = genfind(data, hash);
+    if (slot == null_idx)
+	return NULL;
+    else
+	return xslots[slot];
+}
+
+
+void WvFlatHashBase::_remove(const void *data, unsigned hash)
+{
+    unsigned slot = genfind(data, hash);
+
+    if (slot != null_idx)
+    {
+	if (xfree[slot])
+	    do_delete(xslots[slot]);
+	xctrl[slot] = DELETED;
+	num--;
+    }
+}
+
+
+void WvFlatHashBase::_zap()
+{
+    for (unsigned i = 0; i < numslots; i++)
+    {
+	if (xctrl[i] >= 0 && xfree[i])
+	    do_delete(xslots[i]);
+	xctrl[i] = EMPTY;
+    }
+
+    used = num = 0;
+}
+
+
+void WvFlatHashBase::_set_autofree(const void *data,
+				   unsigned hash, bool autofree)
+{
+    unsigned slot = genfind(data, hash);
+
+    if (slot != null_idx)
+	xfree[slot] = autofree;
+}
+
+
+bool WvFlatHashBase::_get_autofree(const void *data, unsigned hash)
+{
+    unsigned slot = genfind(data, hash);
+
+    if (slot != null_idx)
+	return xfree[slot];
+
+    assert(0 && "You checked auto_free of a nonexistant thing.");
+    return false;
+}
@@ -11,6 +11,14 @@
 
 WvLink::WvLink(void *_data, WvLink *prev, WvLink *&tail, bool _autofree,
 	       const char *_id)
+{
+    embedded = false;
+    insert(_data, prev, tail, _autofree, _id);
+}
+
+
+void WvLink::insert(void *_data, WvLink *prev, WvLink *&tail, bool _autofree,
+		    const char *_id)
 {
     data = _data;
     next = prev->next;
@@ -21,6 +29,13 @@ WvLink::WvLink(void *_data, WvLink *prev, WvLink *&tail, bool _autofree,
 }
 
 
+WvEmbeddedLink::~WvEmbeddedLink()
+{
+    if (data && list)
+	list->unlink_link(this);
+}
+
+
 size_t WvListBase::count() const
 {
     WvLink *l;
@@ -52,6 +67,23 @@ void WvListBase::reverse()
     tail = head.next;
     tail->next = NULL;
     head.next = prev;
+    generation++;
+}
+
+
+void WvListBase::unlink_link(WvLink *link)
+{
+    for (WvLink *prev = &head; prev->next; prev = prev->next)
+    {
+	if (prev->next == link)
+	{
+	    if (tail == link)
+		tail = prev;
+	    generation++;
+	    link->unlink(prev);
+	    return;
+	}
+    }
 }
 
 
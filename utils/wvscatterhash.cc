@@ -7,6 +7,12 @@
 
 #include "wvscatterhash.h"
 #include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 // Prime numbers close to powers of 2
 const unsigned WvScatterHashBase::prime_numbers[]
@@ -25,114 +31,264 @@ const unsigned WvScatterHashBase::prime_numbers[]
 WvScatterHashBase::WvScatterHashBase(unsigned _numslots)
 {
     num = 0;
-    used = 0;
+    oldslots = NULL;
+    oldstatus = NULL;
+    oldnumslots = migrate_pos = 0;
 
     if (_numslots == 0)
-        prime_index = 0;
+        min_index = 0;
     else
     {
-        prime_index = 1;
+        min_index = 1;
         while ((_numslots >>= 1) != 0)
-            prime_index++;
+            min_index++;
+    }
+
+    alloc(min_index);
+}
+
+
+// Big tables come straight from mmap(), whose pages are zeroed by the
+// kernel as they're first touched, so a new table costs almost nothing up
+// front.  calloc() usually does the same, but not if malloc has enough
+// memory lying around from earlier, which it then has to clear first,
+// taking milliseconds while someone's waiting for add().
+#if !defined(_WIN32) && defined(MAP_ANONYMOUS)
+#define BIG_TABLE (1024*1024)
+#endif
+
+static void *zalloc(size_t bytes)
+{
+#ifdef BIG_TABLE
+    if (bytes >= BIG_TABLE)
+    {
+	void *p = mmap(NULL, bytes, PROT_READ|PROT_WRITE,
+		       MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	return p == MAP_FAILED ? NULL : p;
     }
+#endif
+    return calloc(bytes, 1);
+}
 
+
+static void zfree(void *p, size_t bytes)
+{
+#ifdef BIG_TABLE
+    if (bytes >= BIG_TABLE)
+    {
+	if (p)
+	    munmap(p, bytes);
+	return;
+    }
+#endif
+    free(p);
+}
+
+
+WvScatterHashBase::~WvScatterHashBase()
+{
+    zfree(xslots, numslots * sizeof(Slot));
+    zfree(xstatus, numslots * sizeof(Status));
+    zfree(oldslots, oldnumslots * sizeof(Slot));
+    zfree(oldstatus, oldnumslots * sizeof(Status));
+}
+
+
+void WvScatterHashBase::alloc(int _prime_index)
+{
+    prime_index = _prime_index;
     numslots = prime_numbers[prime_index];
-    xslots = new Slot[numslots];
-    xstatus = new Status[numslots];
-    memset(xslots, 0, numslots * sizeof(xslots[0]));
-    memset(xstatus, 0, numslots * sizeof(xstatus[0]));
+    xslots = (Slot *)zalloc(numslots * sizeof(xslots[0]));
+    xstatus = (Status *)zalloc(numslots * sizeof(xstatus[0]));
+    used = 0;
 }
 
+
 size_t WvScatterHashBase::slowcount() const 
 {   
     unsigned count = 0;
-    for (unsigned index = 0; index < numslots; index++)
+    for (unsigned index = 0; index < allslots(); index++)
     {
-        if (IS_OCCUPIED(xstatus[index]))
+        if (IS_OCCUPIED(status(index)))
             count++;
     }
 
     return count;
 }
 
-void WvScatterHashBase::rebuild()
+
+// Start moving everything into a new table with prime_numbers[index]
+// slots.
+void WvScatterHashBase::start_resize(int index)
+{
+    if (oldslots)
+        migrate(oldnumslots);
+
+    oldslots = xslots;
+    oldstatus = xstatus;
+    oldnumslots = numslots;
+    migrate_pos = 0;
+    alloc(index);
+}
+
+
+// The smallest size with room for 'extra' more elements.
+int WvScatterHashBase::fit_index(size_t extra) const
 {
-    if (!(numslots * REBUILD_LOAD_FACTOR <= used + 1))
-        return;
+    size_t need = num + 1 + extra;
+    int index = min_index;
+    while (prime_numbers[index] * RESIZE_LOAD_FACTOR <= need)
+        index++;
+    return index;
+}
 
-    unsigned oldnumslots = numslots;
 
-    if (numslots * RESIZE_LOAD_FACTOR <= num + 1) 
-        numslots = prime_numbers[++prime_index];
+// Give the pages between 'start' and 'end' back to the kernel, if they
+// cover any whole ones.  For a table with millions of slots, freeing the
+// old one all at once takes milliseconds, mostly unmapping pages; this
+// lets us do it a bit at a time instead.
+static void release_pages(void *start, void *end)
+{
+#ifdef MADV_DONTNEED
+    static uintptr_t pagesize = sysconf(_SC_PAGESIZE);
+    uintptr_t first = ((uintptr_t)start + pagesize - 1) & ~(pagesize - 1);
+    uintptr_t last = (uintptr_t)end & ~(pagesize - 1);
+    if (last > first)
+	madvise((void *)first, last - first, MADV_DONTNEED);
+#endif
+}
 
-    Slot *tmpslots = xslots;
-    Status *tmpstatus = xstatus;
-    xslots = new Slot[numslots];
-    xstatus = new Status[numslots];
-    memset(xslots, 0, numslots * sizeof(xslots[0]));
-    memset(xstatus, 0, numslots * sizeof(xstatus[0]));
-    used = num = 0;
 
-    for (unsigned i = 0; i < oldnumslots; i++)
+// Move the elements in the next 'n' slots of the old table to the new one.
+void WvScatterHashBase::migrate(unsigned n)
+{
+    // we never look at slots we've moved (their status says they're
+    // deleted), so the memory they're in can go as soon as we're done
+    // with a few pages of them.
+    const unsigned release_slots = 4096;
+    unsigned release_from = migrate_pos - migrate_pos % release_slots;
+
+    for (; n > 0 && migrate_pos < oldnumslots; n--, migrate_pos++)
     {
-        if (IS_OCCUPIED(tmpstatus[i]))
-            _add(tmpslots[i], IS_AUTO_FREE(tmpstatus[i]));
+        if (IS_OCCUPIED(oldstatus[migrate_pos]))
+        {
+            void *data = oldslots[migrate_pos];
+            place(data, do_hash(data), oldstatus[migrate_pos]);
+
+            // not empty, or lookups for things after it would stop here
+            oldstatus[migrate_pos] = 1;
+        }
     }
 
-    deletev tmpslots;
-    deletev tmpstatus;
-}
+    unsigned release_to = migrate_pos - migrate_pos % release_slots;
+    if (release_to > release_from && migrate_pos < oldnumslots)
+        release_pages(oldslots + release_from, oldslots + release_to);
 
-void WvScatterHashBase::_add(void *data, bool auto_free)
-{
-    _add(data, do_hash(data), auto_free);
+    if (migrate_pos >= oldnumslots)
+    {
+        zfree(oldslots, oldnumslots * sizeof(Slot));
+        zfree(oldstatus, oldnumslots * sizeof(Status));
+        oldslots = NULL;
+        oldstatus = NULL;
+        oldnumslots = migrate_pos = 0;
+    }
 }
 
-void WvScatterHashBase::_add(void *data, unsigned hash, bool auto_free)
+
+void WvScatterHashBase::place(void *data, unsigned hash, Status stat)
 {
-    rebuild();
     unsigned slot = hash % numslots;
 
     if (IS_OCCUPIED(xstatus[slot]))
     {
         unsigned attempt = 0;
-        unsigned hash2 = second_hash(hash);
+        unsigned hash2 = second_hash(hash, numslots);
 
         while (IS_OCCUPIED(xstatus[slot]))
-            slot = curhash(hash, hash2, ++attempt);
+            slot = curhash(hash, hash2, ++attempt, numslots);
     }
 
-    num++;
     if (!IS_DELETED(xstatus[slot]))
         used++;
 
     xslots[slot] = data;
-    xstatus[slot] = auto_free ? 3 : 2;
+    xstatus[slot] = stat;
+}
+
+
+void WvScatterHashBase::_add(void *data, bool auto_free)
+{
+    _add(data, do_hash(data), auto_free);
+}
+
+void WvScatterHashBase::_add(void *data, unsigned hash, bool auto_free)
+{
+    if (oldslots)
+        migrate(MIGRATE_SLOTS);
+
+    if (numslots * REBUILD_LOAD_FACTOR <= used + 1)
+    {
+        if (numslots < INCREMENTAL_SLOTS)
+        {
+            // small enough to just rebuild it all now
+            int index = prime_index;
+            if (numslots * RESIZE_LOAD_FACTOR <= num + 1)
+                index++;
+            start_resize(index);
+            migrate(oldnumslots);
+        }
+        else
+        {
+            // By the time we've moved all the old slots, MIGRATE_SLOTS at
+            // a time, we might have added another numslots/MIGRATE_SLOTS
+            // elements, so leave room for those.  That's usually about
+            // twice as big as before, but it can also be the same size
+            // (when it's mostly deleted slots we're getting rid of).
+            start_resize(fit_index(numslots / MIGRATE_SLOTS));
+        }
+    }
+    else if (!oldslots && numslots >= INCREMENTAL_SLOTS
+             && prime_index > min_index
+             && num < numslots * SHRINK_LOAD_FACTOR)
+        start_resize(fit_index(numslots / MIGRATE_SLOTS));
+
+    place(data, hash, auto_free ? 3 : 2);
+    num++;
 }
 
+
+void WvScatterHashBase::compact()
+{
+    start_resize(fit_index(0));
+    migrate(oldnumslots);
+}
+
+
 void WvScatterHashBase::_remove(const void *data, unsigned hash)
 {
     unsigned res = genfind(data, hash);
 
     if (res != null_idx)
     {
-        if (IS_AUTO_FREE(xstatus[res]))
-            do_delete(xslots[res]);
-	xstatus[res] = 1;
+        if (IS_AUTO_FREE(status(res)))
+            do_delete(slot(res));
+	status(res) = 1;
         num--;
     }
 }
 
 void WvScatterHashBase::_zap()
 {
-    for (unsigned i = 0; i < numslots; i++)
+    for (unsigned i = 0; i < allslots(); i++)
     {
-        if (IS_AUTO_FREE(xstatus[i]))
-            do_delete(xslots[i]);
+        if (IS_AUTO_FREE(status(i)))
+            do_delete(slot(i));
 
-        xstatus[i] = 0;
+        status(i) = 0;
     }
     
+    if (oldslots)
+        migrate(oldnumslots);
     used = num = 0;
 }
 
@@ -142,7 +298,7 @@ void WvScatterHashBase::_set_autofree(const void *data,
     unsigned res = genfind(data, hash);
 
     if (res != null_idx)
-        xstatus[res] = auto_free ? 3 : 2;
+        status(res) = auto_free ? 3 : 2;
 }
 
 bool WvScatterHashBase::_get_autofree(const void *data, unsigned hash)
@@ -150,27 +306,29 @@ bool WvScatterHashBase::_get_autofree(const void *data, unsigned hash)
     unsigned res = genfind(data, hash);
 
     if (res != null_idx)
-        return IS_AUTO_FREE(xstatus[res]);
+        return IS_AUTO_FREE(status(res));
 
     assert(0 && "You checked auto_free of a nonexistant thing.");
     return false;
 }
 
-unsigned WvScatterHashBase::genfind(const void *data, unsigned hash) const
+unsigned WvScatterHashBase::find_in(Slot *slots, Status *stat,
+				    unsigned nslots,
+				    const void *data, unsigned hash) const
 {
-    unsigned slot = hash % numslots;
+    unsigned slot = hash % nslots;
 
-    if (IS_OCCUPIED(xstatus[slot]) && compare(data, xslots[slot]))
+    if (IS_OCCUPIED(stat[slot]) && compare(data, slots[slot]))
         return slot;
 
     unsigned attempt = 0;
-    unsigned hash2 = second_hash(hash);
+    unsigned hash2 = second_hash(hash, nslots);
 
-    while (xstatus[slot])
+    while (stat[slot])
     {
-        slot = curhash(hash, hash2, ++attempt);
+        slot = curhash(hash, hash2, ++attempt, nslots);
 
-        if (IS_OCCUPIED(xstatus[slot]) && compare(data, xslots[slot]))
+        if (IS_OCCUPIED(stat[slot]) && compare(data, slots[slot]))
             return slot;
     } 
 
@@ -178,11 +336,24 @@ unsigned WvScatterHashBase::genfind(const void *data, unsigned hash) const
 }
 
 
+unsigned WvScatterHashBase::genfind(const void *data, unsigned hash) const
+{
+    unsigned res = find_in(xslots, xstatus, numslots, data, hash);
+    if (res == null_idx && oldslots)
+    {
+        res = find_in(oldslots, oldstatus, oldnumslots, data, hash);
+        if (res != null_idx)
+            res += numslots;
+    }
+    return res;
+}
+
+
 void *WvScatterHashBase::genfind_or_null(const void *data, unsigned hash) const
 {
     unsigned slot = genfind(data, hash);
     if (slot == null_idx)
 	return NULL;
     else
-	return xslots[slot];
+	return this->slot(slot);
 }
@@ -9,12 +9,33 @@
  */
 #include "wvsorter.h"
 
-WvSorterBase::CompareFunc *WvSorterBase::actual_compare;
+WvSorterBase::WvSorterBase(void *_list, bool _stable)
+{
+    list = _list;
+    array = lptr = seen = NULL;
+    stable = _stable;
+    cache = valid = false;
+    count = size = 0;
+}
+
 
-int WvSorterBase::magic_compare(const void *_a, const void *_b)
+WvSorterBase::~WvSorterBase()
 {
-    void *a = *(void **)_a, *b = *(void **)_b;
-    return actual_compare(a, b);
+    deletev array;
+    deletev seen;
 }
 
 
+// make room for n elements, plus the NULLs at each end of the array.
+void WvSorterBase::reserve(size_t n)
+{
+    if (array && n <= size)
+	return;
+    
+    deletev array;
+    deletev seen;
+    size = n;
+    typedef void *VoidPtr;
+    array = new VoidPtr[size+2];
+    seen = new VoidPtr[size ? size : 1];
+}
@@ -9,7 +9,9 @@
 #include <ctype.h>
 #include <assert.h>
 
-WvStringBuf WvFastString::nullbuf = { 0, 1, {0} };
+// nullbuf is shared by every thread, so its links are never counted; they
+// stay at 2 so nobody mistakes it for a buffer of their own.
+WvStringBuf WvFastString::nullbuf = { 0, 2, {0} };
 const WvFastString WvFastString::null;
 
 const WvString WvString::empty("");
@@ -38,13 +40,13 @@ WvFastString::WvFastString()
 
 WvFastString::WvFastString(const WvFastString &s)
 {
-    link(s.buf, s.str);
+    link(s.is_inline() ? NULL : s.buf, s.str);
 }
 
 
 WvFastString::WvFastString(const WvString &s)
 {
-    link(s.buf, s.str);
+    link(s.is_inline() ? NULL : s.buf, s.str);
 }
 
 
@@ -62,11 +64,27 @@ WvFastString::WvFastString(const char *_str)
 }
 
 
+void WvFastString::steal(WvFastString &s)
+{
+    if (s.is_inline())
+    {
+	memcpy(inl, s.inl, WVSTRING_INLINE);
+	str = inl;
+    }
+    else
+    {
+	buf = s.buf;
+	str = s.str;
+    }
+    s.link(&nullbuf, NULL);
+}
+
+
 void WvString::copy_constructor(const WvFastString &s)
 {
     unlink();	// WvFastString has already been created by now
 
-    if (!s.buf)
+    if (s.is_inline() || !s.buf)
     {
 	link(&nullbuf, s.str);
 	unique();
@@ -173,67 +191,69 @@ inline static void wv_strrev(char *begin, char *end)
 
 
 
-// NOTE: make sure that 32 bytes is big enough for your longest int.
-// This is true up to at least 64 bits.
+// NOTE: make sure that WVSTRING_NUMLEN bytes is big enough for your
+// longest int.  This is true up to at least 64 bits.  It also fits in
+// WVSTRING_INLINE, so numbers never need a malloc().
+#define WVSTRING_NUMLEN 22
 WvFastString::WvFastString(short i)
 {
-    newbuf(32);
+    newbuf(WVSTRING_NUMLEN);
     wv_strrev(str, wv_itoar(str, i));
 }
 
 
 WvFastString::WvFastString(unsigned short i)
 {
-    newbuf(32);
+    newbuf(WVSTRING_NUMLEN);
     wv_strrev(str, wv_uitoar(str, i));
 }
 
 
 WvFastString::WvFastString(int i)
 {
-    newbuf(32);
+    newbuf(WVSTRING_NUMLEN);
     wv_strrev(str, wv_itoar(str, i));
 }
 
 
 WvFastString::WvFastString(unsigned int i)
 {
-    newbuf(32);
+    newbuf(WVSTRING_NUMLEN);
     wv_strrev(str, wv_uitoar(str, i));
 }
 
 
 WvFastString::WvFastString(long i)
 {
-    newbuf(32);
+    newbuf(WVSTRING_NUMLEN);
     wv_strrev(str, wv_itoar(str, i));
 }
 
 
 WvFastString::WvFastString(unsigned long i)
 {
-    newbuf(32);
+    newbuf(WVSTRING_NUMLEN);
     wv_strrev(str, wv_uitoar(str, i));
 }
 
 
 WvFastString::WvFastString(long long i)
 {
-    newbuf(32);
+    newbuf(WVSTRING_NUMLEN);
     wv_strrev(str, wv_itoar(str, i));
 }
 
 
 WvFastString::WvFastString(unsigned long long i)
 {
-    newbuf(32);
+    newbuf(WVSTRING_NUMLEN);
     wv_strrev(str, wv_uitoar(str, i));
 }
 
 
 WvFastString::WvFastString(double i)
 {
-    newbuf(32);
+    newbuf(WVSTRING_NUMLEN);
     sprintf(str, "%g", i);
 }
 
@@ -246,7 +266,18 @@ WvFastString::~WvFastString()
 
 void WvFastString::unlink()
 { 
-    if (buf && ! --buf->links)
+    if (is_inline() || !buf || buf == &nullbuf)
+	return;
+    if (__atomic_load_n(&buf->links, __ATOMIC_RELAXED) & WVSTRINGBUF_SHARED)
+    {
+	if (__atomic_sub_fetch(&buf->links, 1, __ATOMIC_ACQ_REL)
+	        == WVSTRINGBUF_SHARED)
+	{
+	    free(buf);
+	    buf = NULL;
+	}
+    }
+    else if (! --buf->links)
     {
 	free(buf);
         buf = NULL;
@@ -257,8 +288,13 @@ void WvFastString::unlink()
 void WvFastString::link(WvStringBuf *_buf, const char *_str)
 {
     buf = _buf;
-    if (buf)
-	buf->links++;
+    if (buf && buf != &nullbuf)
+    {
+	if (__atomic_load_n(&buf->links, __ATOMIC_RELAXED) & WVSTRINGBUF_SHARED)
+	    __atomic_add_fetch(&buf->links, 1, __ATOMIC_RELAXED);
+	else
+	    buf->links++;
+    }
     str = (char *)_str; // I promise not to change it without asking!
 }
     
@@ -278,7 +314,32 @@ WvString &WvString::append(WvStringParm s)
     if (s)
     {
 	if (*this)
-	    *this = WvString("%s%s", *this, s);
+	{
+	    size_t mylen = len(), slen = s.len(), need = mylen + slen;
+	    
+	    // if nobody else is looking at our buffer and there's room
+	    // left in it, just add to the end
+	    size_t room = 0;
+	    if (is_inline())
+		room = WVSTRING_INLINE;
+	    else if (buf && buf != &nullbuf && buf->links == 1)
+		room = buf->data + buf->size - WVSTRINGBUF_SIZE(buf) - str;
+	    if (need + WVSTRING_EXTRA <= room)
+	    {
+		memcpy(str + mylen, s.str, slen);
+		str[need] = 0;
+		return *this;
+	    }
+	    
+	    // otherwise, leave room to grow so repeated appends don't
+	    // keep copying the whole thing
+	    WvString newstr;
+	    newstr.setsize(need > mylen * 2 ? need : mylen * 2);
+	    memcpy(newstr.str, str, mylen);
+	    memcpy(newstr.str + mylen, s.str, slen);
+	    newstr.str[need] = 0;
+	    *this = newstr;
+	}
 	else
 	    *this = s;
     }
@@ -295,6 +356,12 @@ size_t WvFastString::len() const
 
 void WvFastString::newbuf(size_t size)
 {
+    if (size + WVSTRING_EXTRA <= WVSTRING_INLINE)
+    {
+	memset(inl, 0, WVSTRING_INLINE);
+	str = inl;
+	return;
+    }
     buf = alloc(size);
     buf->links = 1;
     str = buf->data;
@@ -308,10 +375,22 @@ WvString &WvString::unique()
     if (!is_unique() && str)
     {
 	size_t mylen = len();
-	WvStringBuf *newb = alloc(mylen);
-	memcpy(newb->data, str, mylen);
-	unlink();
-	link(newb, newb->data);
+	if (mylen + WVSTRING_EXTRA <= WVSTRING_INLINE)
+	{
+	    // we're not unique, so unlink() won't free our old string
+	    const char *old = str;
+	    unlink();
+	    memcpy(inl, old, mylen);
+	    inl[mylen] = 0;
+	    str = inl;
+	}
+	else
+	{
+	    WvStringBuf *newb = alloc(mylen);
+	    memcpy(newb->data, str, mylen);
+	    unlink();
+	    link(newb, newb->data);
+	}
     }
 	    
     return *this; 
@@ -320,14 +399,22 @@ WvString &WvString::unique()
 
 bool WvString::is_unique() const
 {
-    return (buf->links <= 1);
+    return is_inline() || buf->links <= 1;
 }
 
 
 WvFastString &WvFastString::operator= (const WvFastString &s2)
 {
-    if (s2.buf == buf && s2.str == str)
+    if (s2.str == str)
 	return *this; // no change
+    else if (s2.is_inline())
+    {
+	// this is what WvString's copy assignment uses, so we can't just
+	// point at somebody else's short string; copy it.
+	unlink();
+	memcpy(inl, s2.inl, WVSTRING_INLINE);
+	str = inl;
+    }
     else
     {
 	unlink();
@@ -340,7 +427,7 @@ WvFastString &WvFastString::operator= (const WvFastString &s2)
 WvString &WvString::operator= (int i)
 {
     unlink();
-    newbuf(32);
+    newbuf(WVSTRING_NUMLEN);
     sprintf(str, "%d", i);
     return *this;
 }
@@ -348,12 +435,28 @@ WvString &WvString::operator= (int i)
 
 WvString &WvString::operator= (const WvFastString &s2)
 {
-    if (s2.str == str && (!s2.buf || s2.buf == buf))
+    if (s2.str == str
+	    && (s2.is_inline() || !s2.buf || (!is_inline() && s2.buf == buf)))
 	return *this; // no change
+    else if (s2.is_inline())
+    {
+	// short strings are never shared, so copy it
+	size_t len = strlen(s2.str);
+	unlink();
+	memcpy(inl, s2.str, len + 1);
+	str = inl;
+    }
     else if (!s2.buf)
     {
+	if (is_inline() && s2.str > inl && s2.str < inl + WVSTRING_INLINE)
+	{
+	    // assigning from a piece of ourselves, eg. s = s.offset(1)
+	    memmove(inl, s2.str, strlen(s2.str) + 1);
+	    return *this;
+	}
+	
 	// We have a string, and we're about to free() it.
-	if (str && buf && buf->links == 1)
+	if (str && !is_inline() && buf && buf->links == 1)
 	{
 	    // FIXME:  This assert has to go, but I'm not sure why the previous
 	    // code (which just set buf->size) was actually here, so I'll keep
@@ -494,6 +597,108 @@ static const char *pparse(const char *cptr, bool &zeropad,
 }
 
 
+// One piece of the output of do_format(): 'len' bytes from 'src', with
+// 'lpad' and 'rpad' copies of 'padch' on either side.
+struct WvFormatSeg
+{
+    const char *src;
+    int len, lpad, rpad;
+    char padch, ch;
+};
+
+#define MAX_FORMAT_SEGS 64
+
+
+/**
+ * Split 'format' into segments, resolving each %-expression to the
+ * argument it refers to, and add up the length of the result as we go.
+ * That way each part of the format string and each argument is only
+ * looked at once.  Returns -1 if there are more than MAX_FORMAT_SEGS
+ * segments.
+ */
+static int split_format(WvFormatSeg *segs, int &total, const char *format,
+			const WvFastString * const *argv)
+{
+    static const char blank[] = "(nil)";
+    const WvFastString * const *argptr = argv;
+    const WvFastString * const *argP;
+    const char *iptr = format, *arg;
+    int nsegs = 0, aplen, justify, maxlen, argnum;
+    bool zeropad;
+    
+    total = 0;
+    while (*iptr)
+    {
+	if (nsegs == MAX_FORMAT_SEGS)
+	    return -1;
+	WvFormatSeg &seg = segs[nsegs++];
+	seg.lpad = seg.rpad = 0;
+	
+	if (*iptr != '%')
+	{
+	    const char *pct = strchr(iptr, '%');
+	    seg.src = iptr;
+	    seg.len = pct ? pct - iptr : strlen(iptr);
+	    total += seg.len;
+	    iptr += seg.len;
+	    continue;
+	}
+	
+	// otherwise, iptr is at a percent expression
+	argnum = 0;
+	iptr = pparse(iptr, zeropad, justify, maxlen, argnum);
+	if (*iptr == '%') // literal percent
+	{
+	    seg.src = iptr++;
+	    seg.len = 1;
+	    total++;
+	    continue;
+	}
+	
+	if (*iptr == 's')
+	{
+	    argP = (argnum > 0) ? (argv + argnum - 1) : argptr++;
+	    if (!*argP || !(**argP).cstr())
+		arg = blank;
+	    else
+		arg = (**argP).cstr();
+	    aplen = strlen(arg);
+	    if (maxlen && maxlen < aplen)
+		aplen = maxlen;
+	    
+	    seg.src = arg;
+	    seg.len = aplen;
+	    seg.padch = zeropad ? '0' : ' ';
+	    if (justify > aplen)
+		seg.lpad = justify - aplen;
+	    else if (justify < 0 && -justify > aplen)
+		seg.rpad = -justify - aplen;
+	    total += seg.lpad + aplen + seg.rpad;
+	    iptr++;
+	    continue;
+	}
+	
+	if (*iptr == 'c')
+	{
+	    argP = (argnum > 0) ? (argv + argnum - 1) : argptr++;
+	    seg.ch = (!*argP || !(**argP)) ? ' ' : (char)atoi(**argP);
+	    seg.src = &seg.ch;
+	    seg.len = 1;
+	    total++;
+	    iptr++;
+	    continue;
+	}
+	
+	// an unknown conversion (or the end of the string) prints nothing
+	nsegs--;
+	if (*iptr)
+	    iptr++;
+    }
+    
+    return nsegs;
+}
+
+
 /**
  * Accept a printf-like format specifier (but more limited) and an array
  * of WvStrings, and render them into another WvString.  For example:
@@ -502,7 +707,8 @@ static const char *pparse(const char *cptr, bool &zeropad,
  *
  * The 'ret' string will be:  "foo        bl1234      "
  * Note that only '%s' is supported, though integers can be rendered
- * automatically into WvStrings.  %d, %f, etc are not allowed!
+ * automatically into WvStrings.  %d, %f, etc are not allowed!  They
+ * don't use up an argument, and print nothing.
  *
  * This function is usually called from some other function which allocates
  * the array automatically.
@@ -521,7 +727,35 @@ void WvFastString::do_format(WvFastString &output, const char *format,
     int total = 0, aplen, ladd, justify, maxlen, argnum;
     bool zeropad;
     
-    // count the number of bytes we'll need
+    WvFormatSeg segs[MAX_FORMAT_SEGS];
+    int nsegs = split_format(segs, total, format, argv);
+    if (nsegs >= 0)
+    {
+	output.setsize(total);
+	optr = output.str;
+	for (int i = 0; i < nsegs; i++)
+	{
+	    const WvFormatSeg &seg = segs[i];
+	    if (seg.lpad)
+	    {
+		memset(optr, seg.padch, seg.lpad);
+		optr += seg.lpad;
+	    }
+	    memcpy(optr, seg.src, seg.len);
+	    optr += seg.len;
+	    if (seg.rpad)
+	    {
+		memset(optr, seg.padch, seg.rpad);
+		optr += seg.rpad;
+	    }
+	}
+	*optr = 0;
+	return;
+    }
+    
+    // too many pieces to keep track of: go through the format twice,
+    // counting the number of bytes we'll need first
+    total = 0;
     while (*iptr)
     {
 	if (*iptr != '%')
@@ -541,7 +775,13 @@ void WvFastString::do_format(WvFastString &output, const char *format,
 	    continue;
 	}
 	
-	assert(*iptr == 's' || *iptr == 'c');
+	if (*iptr != 's' && *iptr != 'c')
+	{
+	    // unknown conversion: prints nothing, like in split_format()
+	    if (*iptr)
+		iptr++;
+	    continue;
+	}
 
 	if (*iptr == 's')
 	{
@@ -550,10 +790,10 @@ void WvFastString::do_format(WvFastString &output, const char *format,
 		arg = blank;
 	    else
 		arg = (**argP).cstr();
-	    ladd = _max(abs(justify), strlen(arg));
+	    ladd = strlen(arg);
 	    if (maxlen && maxlen < ladd)
 		ladd = maxlen;
-	    total += ladd;
+	    total += _max(abs(justify), ladd);
 	    if ( argnum <= 0 ) 
                 argptr++;
 	    iptr++;
@@ -590,6 +830,12 @@ void WvFastString::do_format(WvFastString &output, const char *format,
 	    *optr++ = *iptr++;
 	    continue;
 	}
+	if (*iptr != 's' && *iptr != 'c')
+	{
+	    if (*iptr)
+		iptr++;
+	    continue;
+	}
 	if (*iptr == 's')
 	{
             argP = (argnum > 0 ) ?  (argv + argnum -1): argptr;
@@ -5,93 +5,221 @@
  * Definition for the WvStringCache class.  See wvstringcache.h.
  */
 #include "wvstringcache.h"
-#include "wvstringlist.h"
+#include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
-WvStringTable *WvStringCache::t;
-int WvStringCache::refcount;
-size_t WvStringCache::clean_threshold;
+// the table is split into this many shards, each with its own lock
+#define CACHE_SHARDS 16
 
-WvStringCache::WvStringCache()
+// how many table slots to check for unused strings on each insert
+#define SWEEP_SLOTS 8
+
+
+// A WvStringTable that can be cleaned out a few slots at a time.
+class WvStringCacheTable : public WvStringTable
 {
-    refcount++;
-    if (!t)
+public:
+    // like operator[] and add(), but with the hash already worked out.
+    // The comparison only uses WvFastString::operator==, so we can look
+    // up 's' without copying it into a WvString first.
+    WvString *find(WvStringParm s, unsigned hash) const
+	{ return (WvString *)genfind_or_null(&s, hash); }
+    void add(WvString *s, unsigned hash)
+	{ _add(s, hash, true); }
+    
+    /**
+     * Drop the unused strings in the 'n' slots starting at 'pos', and
+     * leave 'pos' pointing after them.  While the table is being resized,
+     * the slots count through the new table and then the old one, so
+     * strings that haven't been moved yet get swept too.  Removing entries
+     * never moves the others around, so 'pos' stays good until the next
+     * add(); and if that moves things, we just sweep some slots twice and
+     * some not at all until next time around.
+     */
+    void sweep(unsigned &pos, unsigned n)
     {
-	t = new WvStringTable;
-	clean_threshold = 0;
+	for (; n > 0; n--, pos++)
+	{
+	    if (pos >= allslots())
+		pos = 0;
+	    if (IS_OCCUPIED(status(pos))
+		    && WvStringCache::is_unused(*(WvString *)slot(pos)))
+		remove((WvString *)slot(pos));
+	}
     }
+    
+    void sweep_all(unsigned &pos)
+	{ sweep(pos, allslots()); }
+};
+
+
+struct WvStringCacheShard
+{
+#ifndef _WIN32
+    pthread_mutex_t lock;
+#endif
+    WvStringCacheTable *t;
+    unsigned pos;
+    size_t lookups, hits;
+};
+
+static WvStringCacheShard shards[CACHE_SHARDS];
+
+
+#ifndef _WIN32
+
+static pthread_once_t shards_once = PTHREAD_ONCE_INIT;
+
+static void init_shards()
+{
+    for (int i = 0; i < CACHE_SHARDS; i++)
+	pthread_mutex_init(&shards[i].lock, NULL);
+}
+
+static void lock(WvStringCacheShard &sh)
+{
+    pthread_mutex_lock(&sh.lock);
+}
+
+static void unlock(WvStringCacheShard &sh)
+{
+    pthread_mutex_unlock(&sh.lock);
+}
+
+#else // _WIN32
+
+// no threads to worry about
+static void lock(WvStringCacheShard &sh) { }
+static void unlock(WvStringCacheShard &sh) { }
+
+#endif // _WIN32
+
+
+int WvStringCache::refcount;
+
+WvStringCache::WvStringCache()
+{
+#ifndef _WIN32
+    pthread_once(&shards_once, init_shards);
+#endif
+    __atomic_add_fetch(&refcount, 1, __ATOMIC_RELAXED);
 }
 
 
 WvStringCache::~WvStringCache()
 {
-    refcount--;
-    if (!refcount)
+    if (__atomic_sub_fetch(&refcount, 1, __ATOMIC_ACQ_REL))
+	return;
+    
+    // the last one out frees the table; any strings still in use keep
+    // their buffers until they're done with them.
+    for (int i = 0; i < CACHE_SHARDS; i++)
     {
-	delete t;
-	t = NULL;
-	clean_threshold = 0;
+	lock(shards[i]);
+	delete shards[i].t;
+	shards[i].t = NULL;
+	shards[i].pos = 0;
+	unlock(shards[i]);
     }
-    else
-	clean();
 }
-    
+
+
+bool WvStringCache::is_unused(const WvString &s)
+{
+    // only the table's own link is left
+    return __atomic_load_n(&s.buf->links, __ATOMIC_ACQUIRE)
+	== (WVSTRINGBUF_SHARED | 1);
+}
+
+
+size_t WvStringCache::memsize(const WvString &s, size_t *saved)
+{
+    unsigned users = (__atomic_load_n(&s.buf->links, __ATOMIC_RELAXED)
+		      & ~WVSTRINGBUF_SHARED) - 1;
+    if (users > 1)
+	*saved += (users - 1) * s.buf->size;
+    return s.buf->size;
+}
+
 
 WvString WvStringCache::get(WvStringParm s)
 {
     // return s; // disable cache
-    WvString *ret = (*t)[s];
-    if (ret)
+    size_t len = s.len();
+    if (!s || len + WVSTRING_EXTRA <= WVSTRING_INLINE)
+	return s;
+    
+    // WvHash()'s low bits only depend on the end of the string, so stir
+    // them all into the top ones and pick a shard with those
+    unsigned hash = WvHash(s);
+    WvStringCacheShard &sh
+	= shards[((hash * 0x9e3779b1u) >> 24) % CACHE_SHARDS];
+    WvString ret;
+    
+    lock(sh);
+    if (!sh.t)
+	sh.t = new WvStringCacheTable;
+    sh.lookups++;
+    
+    WvString *found = sh.t->find(s, hash);
+    if (found)
     {
-	// printf("found(%s)\n", s.cstr());
-	return *ret;
+	sh.hits++;
+	ret = *found;
     }
     else
     {
-	// printf("  new(%s)\n", s.cstr());
-	ret = new WvString(s);
-	t->add(ret, true);
-	return *ret;
+	// give the table its own buffer, so nobody outside has a link to
+	// it that isn't counted atomically
+	found = new WvString;
+	found->setsize(len);
+	memcpy(found->str, s.cstr(), len);
+	found->buf->links |= WVSTRINGBUF_SHARED;
+	sh.t->add(found, hash);
+	ret = *found;
+	sh.t->sweep(sh.pos, SWEEP_SLOTS);
     }
+    unlock(sh);
+    
+    return ret;
 }
 
 
 void WvStringCache::clean()
 {
-    // do we actually need to clean yet?  Skip it if we haven't added too
-    // many items since the last clean, since cleaning is pretty slow.
-    if (t->count() < clean_threshold)
-	return;
-    
-    WvStringList l;
+    for (int i = 0; i < CACHE_SHARDS; i++)
+    {
+	lock(shards[i]);
+	if (shards[i].t)
+	    shards[i].t->sweep_all(shards[i].pos);
+	unlock(shards[i]);
+    }
+}
+
+
+WvStringCacheStats WvStringCache::stats()
+{
+    WvStringCacheStats st;
+    memset(&st, 0, sizeof(st));
     
-    // use a two-stage process so the iterator doesn't get messed up
-    // FIXME: this might actually be unnecessary with WvScatterHash, but
-    // someone should actually confirm that before taking this out.
+    for (int i = 0; i < CACHE_SHARDS; i++)
     {
-	WvStringTable::Iter i(*t);
-	for (i.rewind(); i.next(); )
+	lock(shards[i]);
+	st.lookups += shards[i].lookups;
+	st.hits += shards[i].hits;
+	if (shards[i].t)
 	{
-	    if (i->is_unique()) // last remaining instance
+	    WvStringTable::Iter s(*shards[i].t);
+	    for (s.rewind(); s.next(); )
 	    {
-		// printf("CLEANUP(%s)\n", i->cstr());
-		l.append(i.ptr(), false);
+		st.strings++;
+		st.bytes += memsize(*s, &st.saved);
 	    }
 	}
+	unlock(shards[i]);
     }
     
-//    printf("CLEANUP-1: %d elements at start (%d to remove)\n",
-//	   (int)t->count(), (int)l.count());
-    
-    {
-	WvStringList::Iter i(l);
-	for (i.rewind(); i.next(); )
-	    t->remove(i.ptr());
-    }
-    
-    clean_threshold = t->count() + t->count()/10 + 1;
-    
-//    printf("CLEANUP-2: %d elements left (thres=%d).\n", 
-//	   (int)t->count(), (int)clean_threshold);
+    return st;
 }
-
-
@@ -1213,7 +1213,8 @@ WvString depunctuate(WvStringParm line)
     WvString ret = line;
     char * edit = ret.edit();
     int last = ret.len() - 1;
-    if (edit[last] == '.' || edit[last] == '?' || edit[last] == '!')
+    if (last >= 0
+	    && (edit[last] == '.' || edit[last] == '?' || edit[last] == '!'))
         edit[last] = '\0';
 
     return ret;